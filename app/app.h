@@ -6,7 +6,11 @@ extern "C" {
 #endif
 
 #include <stdint.h>
-#include <nvdata.h>
+#include "nvjournal.h"
+#include "profiler.h"
+#ifdef ENABLE_TRACE
+#include "trace.h"
+#endif
 #include <stdout.h>
 #include <fifo.h>
 #include <console.h>
@@ -28,7 +32,8 @@ extern "C" {
 /* Indexes of constants in eeprom */
 #define EEPROM_ID_OFFSET        0UL
 #define IDX_BUZ_VOLUME          28          
-#define EEPROM_BIND_FLAG        29 //EEPROM_SIZE - 1
+#define EEPROM_BIND_FLAG        29
+#define IDX_MODEL               30          // selected model slot
 // 32-bit indexes
 #define IDX_BAT_VOLTAGE_DIV     2
 #define IDX_SENSE_RESISTOR      4
@@ -86,6 +91,10 @@ extern "C" {
 #define TIMER_LOWBAT_TIME   500U    // ms
 #define WATCHDOG_TIME       3000U   // ms
 #define TIMER_PPM_TIME      500U
+#define CPU_LOAD_WINDOW     1000U   // ms
+#define ENC_PUSH_DEBOUNCE   50U     // ms
+#define ENC_PUSH_LONG       800U    // ms, push held this long switches screens
+#define ENC_PUSH_PULSE      100U    // ms, shortest push sent on its channel
 
 #define NO                  0
 #define YES                 1
@@ -111,6 +120,15 @@ void appReqModeChange(uint8_t new_mode);
 uint8_t appGetCurrentMode(void);
 void appInitEEPROM(uint8_t *dst);
 void appSaveEEPROM(void);
+void appProcessEEPROM(uint32_t budget_us, uint8_t allow_erase);
+void appFlushEEPROM(void);
+void appIdle(uint8_t wake_on_compare);
+#ifdef ENABLE_DISPLAY
+void appSetScreen(uint8_t screen);
+void appProcessDisplay(uint32_t budget_us);
+uint32_t appChannelSwitches(uint32_t switches);
+#endif
+uint16_t appGetCpuLoad(void);
 
 #ifdef __cplusplus
 #ifdef ENABLE_CLI
@@ -117,6 +117,8 @@ extern "C" {
 #define IS_HW_SW_AUX1_PRESSED   (HW_SW_AUX1_PORT->IDR & (1 << HW_SW_AUX1_PIN)) == 0
 #define IS_HW_SW_AUX3_PRESSED   (HW_SW_AUX3_PORT->IDR & (1 << HW_SW_AUX3_PIN)) == 0
 #define IS_BIND_BUTTON_PRESSED  IS_HW_SW_AUX1_PRESSED
+#define IS_ENC_PUSH_PRESSED     (IS_HW_SW_AUX3_PRESSED)
+#define ENC_PUSH_SWITCH         (1 << 2)            // AUX3 bit on HW_SW_READ
 
 /** RF enable for 35MHz transmiter */
 #define TX35_MHZ_INSTALLED
@@ -147,6 +149,21 @@ extern "C" {
 #define TIMER_BASE_IRQn         TIM3_IRQn
 #define TIMER_BASE_IRQHandler   TIM3_IRQHandler
 
+#ifdef ENABLE_PPM_CAPTURE
+/**
+ * PPM input captured by TIMER_BASE CH1 from TI2 (PB5 with partial remap)
+ * and copied by DMA to a circular buffer, scheduler compare moves to CH3
+ * */
+#define TIMER_BASE_CCR          CCR3
+#define TIMER_BASE_CCIF         TIM_SR_CC3IF
+#define TIMER_BASE_CCIE         TIM_DIER_CC3IE
+#define PPM_CAPTURE_DMA         DMA1_Channel6
+#else
+#define TIMER_BASE_CCR          CCR1
+#define TIMER_BASE_CCIF         TIM_SR_CC1IF
+#define TIMER_BASE_CCIE         TIM_DIER_CC1IE
+#endif
+
 #define PPM_TIM                 TIM4
 
 #define cli                     __disable_irq
@@ -196,17 +213,17 @@ extern "C" {
 /* fast code */
 #define RAM_CODE                __attribute__((section(".ram_code")))
 
-/* Symbols for NVDATA */
-#define NVDATA_SECTOR_INIT      
+/* Symbols for NVDATA, two flash pages for eeprom journal */
 #define NVDATA_SECTOR_START     &_seeprom
 #define NVDATA_SECTOR_END       &_eeeprom
-#define NVDATA_SECTOR_READ      memcpy
 #define NVDATA_SECTOR_WRITE     flashWrite
 #define NVDATA_SECTOR_ERASE     flashPageErase
-#define EEPROM_Read             NV_Read
-#define EEPROM_Write(_A,_B,_C)  NV_Write(_A,_B,_C)
-#define EEPROM_Sync             NV_Sync
-#define EEPROM_SIZE             30
+#define EEPROM_Read             nvj_read
+#define EEPROM_Write(_A,_B,_C)  nvj_write(_A,_B,_C)
+#define EEPROM_Sync             nvj_sync
+#define EEPROM_Commit           nvj_commit
+#define EEPROM_Step             nvj_step
+#define EEPROM_SIZE             32
 
 /* General symbols */
 #define ADC_RDY                 (1 << 0)
@@ -223,10 +240,14 @@ extern "C" {
 
 #define BUZ_PLAYING             (1 << 0)
 
-#define SWTIM_NUM               4
+#define SWTIM_NUM               16
+#define SWTIM_SLOTS             32          // timer wheel slots, one per tick
+#define SWTIM_NONE              0           // never a valid handle
+#define SWTIM_NO_EXPIRY         0xFFFFFFFFUL
 #define SWTIM_RUNNING           (1 << 0)
 #define SWTIM_AUTO_RELOAD       (1 << 1)
 #define SWTIM_IN_USE            (1 << 2)
+#define SWTIM_FIRING            (1 << 3)
 
 
 typedef struct tone{
@@ -252,8 +273,8 @@ extern fifo_t serial_rx_fifo;
 /* Function prototyes */
 void delayMs(uint32_t ms);
 uint32_t getTick(void);
-void SPI_Write(uint8_t data);
-uint8_t SPI_Read(void);
+uint32_t getCycleCount(void);
+uint8_t SPI_Burst(uint8_t header, const uint8_t *tx, uint8_t *rx, uint16_t len);
 void gpioInit(GPIO_TypeDef *port, uint8_t pin, uint8_t mode);
 void gpioAttachInterrupt(GPIO_TypeDef *port, uint8_t pin, uint8_t edge, void(*)(void));
 void gpioRemoveInterrupt(GPIO_TypeDef *port, uint8_t pin);
@@ -283,6 +304,11 @@ uint32_t batteryReadCurrent(uint32_t *dst);
 uint32_t batteryReadVI(vires_t *dst);
 
 void ppmOut(uint16_t *data);
+#ifdef ENABLE_PPM_CAPTURE
+void ppmCaptureStart(volatile uint16_t *buf, uint16_t len);
+void ppmCaptureStop(void);
+uint16_t ppmCaptureIndex(void);
+#endif
 
 void buzPlayTone(uint16_t freq, uint16_t duration);
 void buzPlay(tone_t *tones);
@@ -290,21 +316,45 @@ uint16_t buzSetLevel(uint16_t level);
 void buzWaitEnd(void);
 
 uint32_t xrand(void);
+uint32_t crcCalc(const uint32_t *data, uint32_t len);
 
 void processTimers(void);
 uint32_t startTimer(uint32_t time, uint32_t flags, void (*cb)(void));
-void stopTimer(uint32_t tim);
+void stopTimer(uint32_t handle);
+uint32_t nextTimerExpiry(void);
 
 #ifdef ENABLE_USART
 void usart_init(void);
 #endif
 
 #ifdef ENABLE_DISPLAY
+#define I2C_CLOCK               400000      // Fast mode
+#define I2C_QUEUE_SIZE          8           // power of 2
+#define I2C_RETRIES             2
+#define I2C_IRQ_PRIORITY        2
+
+enum i2c_block_state{
+    I2C_BLOCK_IDLE = 0,
+    I2C_BLOCK_QUEUED,
+    I2C_BLOCK_ACTIVE,
+    I2C_BLOCK_FAILED,                   // retries exhausted, not sent
+};
+
+typedef struct i2c_block{
+    uint8_t *data;
+    uint16_t size;
+    uint8_t address;
+    uint8_t retries;
+    volatile uint8_t state;
+}i2c_block_t;
+
 extern I2C_HandleTypeDef hi2c2;
 #define I2C_Write(_A, _D, _S) HAL_I2C_Master_Transmit(&hi2c2, _A << 1, _D, _S, 100)
 
 void I2C_WriteBlock(uint16_t address, uint8_t *data, uint16_t size);
-uint8_t requestLcdUpdate(void);
+uint8_t I2C_Queue(i2c_block_t *blk);
+uint8_t I2C_IsBusy(void);
+uint8_t requestLcdUpdate(void);         // mpanel.cpp
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,60 @@
+#include <string.h>
+#include "bytering.h"
+
+/**
+ * @brief Queue bytes, published only once all of them are copied
+ *
+ * @return : 0 if they do not fit, nothing is queued
+ * */
+uint8_t bytering_put(bytering_t *ring, const uint8_t *data, uint16_t len){
+    uint16_t head = ring->head;
+    uint16_t first;
+
+    if((uint16_t)(ring->size - (uint16_t)(head - ring->tail)) < len){
+        return 0;
+    }
+
+    head &= ring->size - 1;
+    first = ring->size - head;
+    if(first > len){
+        first = len;
+    }
+    memcpy(&ring->buf[head], data, first);
+    memcpy(ring->buf, data + first, len - first);
+
+    ring->head += len;
+    return 1;
+}
+
+/**
+ * @brief Oldest queued bytes, without removing them
+ *
+ * @param data : set to first byte
+ * @param max : largest span wanted
+ * @return : contiguous bytes available, up to max
+ * */
+uint16_t bytering_peek(bytering_t *ring, uint8_t **data, uint16_t max){
+    uint16_t tail = ring->tail;
+    uint16_t len = ring->head - tail;
+    uint16_t to_end;
+
+    tail &= ring->size - 1;
+    to_end = ring->size - tail;
+
+    if(len > to_end){
+        len = to_end;
+    }
+    if(len > max){
+        len = max;
+    }
+
+    *data = &ring->buf[tail];
+    return len;
+}
+
+/**
+ * @brief Release bytes once the consumer is done with them
+ * */
+void bytering_consume(bytering_t *ring, uint16_t len){
+    ring->tail += len;
+}
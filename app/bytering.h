@@ -0,0 +1,35 @@
+#ifndef _BYTERING_H_
+#define _BYTERING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Byte ring with a single producer, the main loop, and a single
+ * consumer, an output interrupt. Each side only writes its own index,
+ * indexes run free and are masked on access, so no lock is needed.
+ *
+ * Writes go in whole or not at all. The consumer takes contiguous
+ * spans straight from the buffer and releases them once sent.
+ * */
+#define BYTERING_INIT(_BUF)     {(_BUF), sizeof(_BUF), 0, 0}
+
+typedef struct bytering{
+    uint8_t *buf;
+    uint16_t size;                      // power of 2
+    volatile uint16_t head;             // written by producer
+    volatile uint16_t tail;             // written by consumer
+}bytering_t;
+
+uint8_t bytering_put(bytering_t *ring, const uint8_t *data, uint16_t len);
+uint16_t bytering_peek(bytering_t *ring, uint8_t **data, uint16_t max);
+void bytering_consume(bytering_t *ring, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BYTERING_H_ */
@@ -1,7 +1,27 @@
+#include <string.h>
 
 #include "app.h"
 #include "iface_cc2500.h"
 #include "multiprotocol.h"
+#ifdef ENABLE_LATENCY
+#include "latency.h"
+#endif
+#ifdef ENABLE_TELEMETRY
+#include "telemetry.h"
+#endif
+#ifdef ENABLE_RF_STATS
+#include "rf_stats.h"
+#endif
+#ifdef ENABLE_MIXER
+#include "mixer.h"
+#endif
+#ifdef ENABLE_MODELS
+#include "model.h"
+#endif
+#ifdef ENABLE_DISPLAY
+#include "mpanel.h"
+#include "livepanel.h"
+#endif
 
 #ifdef ENABLE_CLI
 
@@ -214,6 +234,9 @@ public:
 			IS_TX_MAIN_PAUSE_on,
 			IS_INPUT_SIGNAL_on
 		);
+#ifdef ENABLE_PPM
+		console->print("PPM missed      [%u]\n", (unsigned int)radio.ppm_missed);
+#endif
 	}
 
 	void channelValues(void){
@@ -227,6 +250,19 @@ public:
 		console->print("Mode: %s\n", aux == MODE_MULTIPROTOCOL ? "Multiprotocol" : "Game Controller");
 	}
 
+	void cpuLoad(void){
+		uint16_t load = appGetCpuLoad();
+		console->print("CPU load: %u.%u%%\n", load / 10, load % 10);
+	}
+
+#ifdef ENABLE_VCOM
+	void usbOutput(void){
+		vcp_tx_stats_t *st = vcp_getTxStats();
+		console->print("USB tx: %u sent, %u dropped on %u overflows\n",
+			(unsigned int)st->sent, (unsigned int)st->dropped, (unsigned int)st->overflows);
+	}
+#endif
+
 	char execute(void *ptr) {
 		console->xputs("\n----------------------------------------");
         batteryVoltage();
@@ -236,6 +272,10 @@ public:
 		channelValues();
 		console->xputs("----------------------------------------");
 		mode();
+		cpuLoad();
+#ifdef ENABLE_VCOM
+		usbOutput();
+#endif
 		console->xputs("----------------------------------------");
         return CMD_OK;        
 	}	
@@ -276,7 +316,7 @@ public:
     CmdReset() : ConsoleCommand("reset") {}
 	void init(void *params) { console = static_cast<Console*>(params); }
 	void help(void) {}
-	char execute(void *ptr) {NVIC_SystemReset();}
+	char execute(void *ptr) {appFlushEEPROM(); NVIC_SystemReset();}
 }cmdreset;
 
 class CmdBind : public ConsoleCommand {
@@ -302,15 +342,15 @@ public:
 
 uint16_t ppm_sim_data[] = {3000, 3000, 1950, 3000};
 void ppm_sim(void){
-	setPpmFlag(ppm_sim_data, 4);
+	ppm_putFrame(ppm_sim_data, 4);
 }
 
 class CmdTest : public ConsoleCommand {
 	Console *console;
-	int32_t tim;
+	uint32_t tim;
 public:
     CmdTest() : ConsoleCommand("test") {}
-	void init(void *params) { console = static_cast<Console*>(params); tim = -1;}
+	void init(void *params) { console = static_cast<Console*>(params); tim = SWTIM_NONE;}
 	void help(void) {}
 	char execute(void *ptr) {
 		uint32_t test_code;
@@ -331,7 +371,7 @@ public:
 				break;
 
 			case 2:
-				if(tim != -1 ){
+				if(tim != SWTIM_NONE){
 					break;
 				}
 				console->xputs("Starting ppm simulation");
@@ -340,7 +380,7 @@ public:
 			case 3:
 				console->xputs("Stoping ppm simulation");
 				stopTimer(tim);
-				tim = -1;
+				tim = SWTIM_NONE;
 				break;
 			case 4:
 				//uint32_t start = HAL_GetTick();				
@@ -406,6 +446,20 @@ public:
 		);
 	}
 
+	void journal(void){
+		nvj_stats_t *st = nvj_getStats();
+
+		console->print(
+			"Journal page\t\t%u, seq %u, %u/%u bytes%s\n",
+			st->page, st->seq, st->used, NVJ_PAGE_SIZE,
+			st->dirty_tail ? ", torn tail" : ""
+		);
+		console->print(
+			"Journal pending\t\t%u chunks, spare page %s\n",
+			st->pending, st->spare_dirty ? "to erase" : "ready"
+		);
+	}
+
 	char execute(void *ptr) {
 		char *p = (char*)ptr;
 
@@ -413,6 +467,7 @@ public:
 			console->xputs("----------------------------------------");
 			channelRanges();
 			id();
+			journal();
 			console->xputs("----------------------------------------");
 			return CMD_OK;
 		}
@@ -423,7 +478,7 @@ public:
 		}
 
 		if(xstrcmp(p,"erase") == 0){
-			console->print("Erasing NV Data: %s\n", NV_Erase() == 0? "Fail": "ok");
+			console->print("Erasing NV Data: %s\n", nvj_erase() == 0? "Fail": "ok");
 			return CMD_OK;
 		}
 		
@@ -595,6 +650,7 @@ public:
     	//LCD_Update();
 
 		DFU_Enable();
+		appFlushEEPROM();
     	NVIC_SystemReset();
     
     	return CMD_OK; 
@@ -603,6 +659,601 @@ public:
 }cmddfu;
 #endif
 
+#ifdef ENABLE_LATENCY
+class CmdLatency : public ConsoleCommand {
+	Console *console;
+public:
+    CmdLatency() : ConsoleCommand("latency") {}
+	void init(void *params) { console = static_cast<Console*>(params); }
+	void help(void) {
+		console->xputs("usage: latency [-d|-r]");
+		console->xputs(
+			"\tStick to air latency, min/avg/max in us\n"
+			"\t-d, dump last measurements\n"
+			"\t-r, reset measurements\n"
+		);
+	}
+
+	void dump(latency_stats_t *st){
+		uint32_t n = (st->count < LATENCY_RING_SIZE) ? st->count : LATENCY_RING_SIZE;
+		uint16_t idx = (st->head - n) & (LATENCY_RING_SIZE - 1);
+
+		for(uint32_t i = 0; i < n; i++){
+			console->print("%u\n", st->ring[idx] >> 1);
+			idx = (idx + 1) & (LATENCY_RING_SIZE - 1);
+		}
+	}
+
+	char execute(void *ptr) {
+		char *argv[2];
+		uint32_t argc;
+		latency_stats_t *st = latency_getStats();
+
+		argc = strToArray((char*)ptr, argv);
+
+		if(getOptValue((char*)"help", argc, argv) != NULL){
+			help();
+			return CMD_OK;
+		}
+
+		if(argc > 0 && xstrcmp("-r", argv[0]) == 0){
+			latency_reset();
+			return CMD_OK;
+		}
+
+		if(argc > 0 && xstrcmp("-d", argv[0]) == 0){
+			dump(st);
+			return CMD_OK;
+		}
+
+		if(st->count == 0){
+			console->xputs("No measurements");
+			return CMD_OK;
+		}
+
+		console->print(
+			"Frames: %u\n"
+			"Min:    %uus\n"
+			"Avg:    %uus\n"
+			"Max:    %uus\n",
+			st->count,
+			st->min >> 1,
+			(uint32_t)(st->sum / st->count) >> 1,
+			st->max >> 1
+		);
+		return CMD_OK;
+	}
+}cmdlatency;
+#endif
+
+#ifdef ENABLE_TELEMETRY
+class CmdTelem : public ConsoleCommand {
+	Console *console;
+public:
+    CmdTelem() : ConsoleCommand("telem") {}
+	void init(void *params) { console = static_cast<Console*>(params); }
+	void help(void) {
+		console->xputs("usage: telem [-r]");
+		console->xputs(
+			"\tReceiver telemetry, link quality and hub values\n"
+			"\t-r, reset counters\n"
+		);
+	}
+
+	char execute(void *ptr) {
+		char *argv[2];
+		uint32_t argc;
+		telemetry_t *tlm = telemetry_getData();
+
+		argc = strToArray((char*)ptr, argv);
+
+		if(getOptValue((char*)"help", argc, argv) != NULL){
+			help();
+			return CMD_OK;
+		}
+
+		if(argc > 0 && xstrcmp("-r", argv[0]) == 0){
+			telemetry_reset();
+			return CMD_OK;
+		}
+
+		console->print(
+			"Link:       %s\n"
+			"RSSI:       %ddBm\n"
+			"LQI:        %u\n"
+			"RX RSSI:    %u\n"
+			"A1:         %umV\n"
+			"A2:         %umV\n",
+			tlm->link ? "up" : "down",
+			tlm->tx_rssi,
+			tlm->tx_lqi,
+			tlm->rx_rssi,
+			telemetry_analogMv(tlm->a1, TELEMETRY_A1_RATIO),
+			telemetry_analogMv(tlm->a2, TELEMETRY_A2_RATIO)
+		);
+		console->print(
+			"Packets:    %u\n"
+			"Bad CRC:    %u\n"
+			"Bad addr:   %u\n"
+			"Overflows:  %u\n"
+			"Hub frames: %u\n",
+			tlm->packets,
+			tlm->bad_crc,
+			tlm->bad_addr,
+			tlm->overflows,
+			tlm->hub_frames
+		);
+
+		for(uint8_t id = 0; id < TELEMETRY_HUB_IDS; id++){
+			if(tlm->hub_valid & ((uint64_t)1 << id)){
+				console->print("Hub[0x%02x]: %u\n", id, tlm->hub[id]);
+			}
+		}
+		return CMD_OK;
+	}
+}cmdtelem;
+#endif
+
+#ifdef ENABLE_PROFILER
+class CmdProf : public ConsoleCommand {
+	Console *console;
+public:
+    CmdProf() : ConsoleCommand("prof") {}
+	void init(void *params) { console = static_cast<Console*>(params); }
+	void help(void) {
+		console->xputs("usage: prof");
+		console->xputs(
+			"\tCycles spent on interrupts and main loop phases since last\n"
+			"\tcall, counters are cleared after printing. Loop phases hold\n"
+			"\tthe interrupts taken meanwhile, mp_loop holds idle as well\n"
+		);
+	}
+
+	char execute(void *ptr) {
+		char *argv[2];
+		uint32_t argc;
+		uint32_t cycles_per_us = SystemCoreClock / 1000000;
+		uint32_t window_ms = getTick() - prof_start();
+
+		argc = strToArray((char*)ptr, argv);
+
+		if(getOptValue((char*)"help", argc, argv) != NULL){
+			help();
+			return CMD_OK;
+		}
+
+		if(window_ms == 0){
+			window_ms = 1;
+		}
+
+		console->print("section\t    runs avg cyc max cyc  total us  load\n");
+		for(uint8_t id = 0; id < PROF_NUM; id++){
+			prof_acc_t *acc = prof_get(id);
+			uint32_t load = (uint32_t)(acc->total / ((uint64_t)window_ms * cycles_per_us));
+
+			console->print("%s\t%8u %7u %7u %9u %3u.%u%%\n",
+				prof_name(id),
+				acc->count,
+				acc->count ? (uint32_t)(acc->total / acc->count) : 0,
+				acc->max,
+				(uint32_t)(acc->total / cycles_per_us),
+				load / 10, load % 10
+			);
+		}
+		console->print("window %ums\n", window_ms);
+
+		prof_reset();
+		return CMD_OK;
+	}
+}cmdprof;
+#endif
+
+#ifdef ENABLE_TRACE
+class CmdTrace : public ConsoleCommand {
+	Console *console;
+public:
+    CmdTrace() : ConsoleCommand("trace") {}
+	void init(void *params) { console = static_cast<Console*>(params); }
+	void help(void) {
+		console->xputs("usage: trace [on|off]");
+		console->xputs(
+			"\tBinary trace of channels, callbacks, RF counters and battery\n"
+			"\tsent on the USB serial port, without arguments shows counters\n"
+			"\ton,  start tracing\n"
+			"\toff, stop tracing\n"
+		);
+	}
+
+	char execute(void *ptr) {
+		char *argv[2];
+		uint32_t argc;
+		trace_stats_t *st = trace_getStats();
+
+		argc = strToArray((char*)ptr, argv);
+
+		if(getOptValue((char*)"help", argc, argv) != NULL){
+			help();
+			return CMD_OK;
+		}
+
+		if(argc > 0 && xstrcmp("on", argv[0]) == 0){
+			trace_enable(1);
+			return CMD_OK;
+		}
+
+		if(argc > 0 && xstrcmp("off", argv[0]) == 0){
+			trace_enable(0);
+			return CMD_OK;
+		}
+
+		console->print(
+			"Trace:   %s\n"
+			"Records: %u\n"
+			"Dropped: %u\n"
+			"Sent:    %u bytes\n",
+			trace_isEnabled() ? "on" : "off",
+			st->records,
+			st->dropped,
+			st->bytes
+		);
+		return CMD_OK;
+	}
+}cmdtrace;
+#endif
+
+#ifdef ENABLE_RF_STATS
+class CmdStats : public ConsoleCommand {
+	Console *console;
+public:
+    CmdStats() : ConsoleCommand("stats") {}
+	void init(void *params) { console = static_cast<Console*>(params); }
+	void help(void) {
+		console->xputs("usage: stats [-h|-r]");
+		console->xputs(
+			"\tRF link counters since protocol start\n"
+			"\t-h, telemetry misses per hop: index, channel, misses\n"
+			"\t-r, reset counters\n"
+		);
+	}
+
+	void hops(rf_stats_t *st){
+		for(uint8_t i = 0; i < RF_STATS_HOPS; i++){
+			console->print("%2u %3u %5u", i, radio.hopping_frequency[i], st->hop_miss[i]);
+			console->print(((i % 3) == 2 || i == RF_STATS_HOPS - 1) ? "\n" : "\t");
+		}
+	}
+
+	char execute(void *ptr) {
+		char *argv[2];
+		uint32_t argc;
+		rf_stats_t *st = rf_getStats();
+
+		argc = strToArray((char*)ptr, argv);
+
+		if(getOptValue((char*)"help", argc, argv) != NULL){
+			help();
+			return CMD_OK;
+		}
+
+		if(argc > 0 && xstrcmp("-r", argv[0]) == 0){
+			rf_statsReset();
+			return CMD_OK;
+		}
+
+		if(argc > 0 && xstrcmp("-h", argv[0]) == 0){
+			hops(st);
+			return CMD_OK;
+		}
+
+		console->print(
+			"TX packets:  %u\n"
+			"RX slots:    %u\n"
+			"RX packets:  %u\n"
+			"RX bad CRC:  %u\n"
+			"RX missed:   %u\n"
+			"RX overflow: %u\n"
+			"Late CB:     %u\n",
+			st->tx_packets,
+			st->rx_slots,
+			st->rx_packets,
+			st->rx_bad_crc,
+			st->rx_missed,
+			st->rx_overflows,
+			st->late_callbacks
+		);
+		return CMD_OK;
+	}
+}cmdstats;
+#endif
+
+#ifdef ENABLE_DISPLAY
+class CmdScreen : public ConsoleCommand {
+	Console *console;
+public:
+    CmdScreen() : ConsoleCommand("screen") {}
+	void init(void *params) { console = static_cast<Console*>(params); }
+	void help(void) {
+		console->xputs("usage: screen [main|live]");
+		console->xputs(
+			"\tSelect display screen, same as encoder push. Without\n"
+			"\targuments shows live screen frame counters\n"
+			"\tmain, battery and status\n"
+			"\tlive, channel bars, encoder and RF link\n"
+		);
+	}
+
+	char execute(void *ptr) {
+		char *argv[2];
+		uint32_t argc;
+		live_stats_t *st = LIVE_getStats();
+
+		argc = strToArray((char*)ptr, argv);
+
+		if(getOptValue((char*)"help", argc, argv) != NULL){
+			help();
+			return CMD_OK;
+		}
+
+		if(argc > 0 && xstrcmp("main", argv[0]) == 0){
+			appSetScreen(MPANEL_SCREEN_MAIN);
+			return CMD_OK;
+		}
+
+		if(argc > 0 && xstrcmp("live", argv[0]) == 0){
+			appSetScreen(MPANEL_SCREEN_LIVE);
+			return CMD_OK;
+		}
+
+		if(argc > 0){
+			return CMD_BAD_PARAM;
+		}
+
+		console->print(
+			"Screen:    %s\n"
+			"Frames:    %u\n"
+			"Overruns:  %u\n"
+			"Late:      %u\n"
+			"Steps:     %u\n"
+			"Waits:     %u\n"
+			"Frame:     %uus, max %uus, budget %uus\n"
+			"Step max:  %uus\n",
+			MPANEL_getShown() == MPANEL_SCREEN_LIVE ? "live" : "main",
+			st->frames,
+			st->overruns,
+			st->late,
+			st->steps,
+			st->waits,
+			st->last_us, st->max_us, LIVE_FRAME_BUDGET_US,
+			st->max_step_us
+		);
+		return CMD_OK;
+	}
+}cmdscreen;
+#endif
+
+#ifdef ENABLE_MIXER
+class CmdMix : public ConsoleCommand {
+	Console *console;
+public:
+    CmdMix() : ConsoleCommand("mix") {}
+	void init(void *params) { console = static_cast<Console*>(params); }
+	void help(void) {
+		console->xputs("usage: mix [-p|-c|-a|-e|-t]");
+		console->xputs(
+			"\tList mix lines, stick curves, trims and mixed channels\n"
+			"\t-p <none|vtail|elevon>, replace lines by preset\n"
+			"\t-c, clear lines\n"
+			"\t-a <src> <dst> <weight> [sw], add line, weight in percent\n"
+			"\t-e <ch> <expo> <rate> [<expo2> <rate2> <sw>], stick curve and dual rate\n"
+			"\t-t <ch> <trim>, stick trim in channel units\n"
+		);
+	}
+
+	uint8_t getArgs(char **argv, uint32_t argc, int32_t *val){
+		for(uint32_t i = 0; i < argc; i++){
+			char *p = argv[i];
+			if(!nextInt(&p, &val[i])){
+				return 0;
+			}
+		}
+		return 1;
+	}
+
+	void list(mixer_model_t *model){
+		static const char *presets[] = {"none", "vtail", "elevon"};
+
+		console->print("Preset: %s\n", presets[model->preset]);
+
+		for(uint8_t i = 0; i < model->lines; i++){
+			mixer_line_t *line = &model->line[i];
+			console->print("Line %u: CH[%u] x %d -> CH[%u]", i, line->src, line->weight, line->dst);
+			if(line->sw != MIXER_NO_SWITCH){
+				console->print(" sw%u", line->sw);
+			}
+			console->print("\n");
+		}
+
+		for(uint8_t i = 0; i < MIXER_CURVES; i++){
+			mixer_curve_t *curve = &model->curve[i];
+			console->print("CH[%u]: expo %d rate %u", i, curve->expo[0], curve->rate[0]);
+			if(curve->sw != MIXER_NO_SWITCH){
+				console->print(", sw%u expo %d rate %u", curve->sw, curve->expo[1], curve->rate[1]);
+			}
+			console->print(", trim %d\n", model->trim[i]);
+		}
+
+		for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+			console->print("OUT[%u]:\t%u\n", i, radio.channel_mix[i]);
+		}
+	}
+
+	char execute(void *ptr) {
+		char *argv[8];
+		int32_t val[7];
+		uint32_t argc;
+		mixer_model_t *model = mixer_getModel();
+
+		argc = strToArray((char*)ptr, argv);
+
+		if(argc == 0){
+			list(model);
+			return CMD_OK;
+		}
+
+		if(xstrcmp("help", argv[0]) == 0){
+			help();
+			return CMD_OK;
+		}
+
+		if(xstrcmp("-c", argv[0]) == 0){
+			mixer_preset(model, MIXER_PRESET_NONE);
+		}else if(xstrcmp("-p", argv[0]) == 0 && argc == 2){
+			if(xstrcmp("vtail", argv[1]) == 0){
+				mixer_preset(model, MIXER_PRESET_VTAIL);
+			}else if(xstrcmp("elevon", argv[1]) == 0){
+				mixer_preset(model, MIXER_PRESET_ELEVON);
+			}else if(xstrcmp("none", argv[1]) == 0){
+				mixer_preset(model, MIXER_PRESET_NONE);
+			}else{
+				return CMD_BAD_PARAM;
+			}
+		}else if(xstrcmp("-a", argv[0]) == 0 && (argc == 4 || argc == 5) && getArgs(&argv[1], argc - 1, val)){
+			uint8_t sw = (argc == 5) ? val[3] : MIXER_NO_SWITCH;
+			if(val[2] < -125 || val[2] > 125 || (argc == 5 && (val[3] < 0 || val[3] >= MAX_AUX_CHANNELS))){
+				return CMD_BAD_PARAM;
+			}
+			if(!mixer_addLine(model, val[0], val[1], val[2], sw)){
+				return CMD_BAD_PARAM;
+			}
+		}else if(xstrcmp("-e", argv[0]) == 0 && (argc == 4 || argc == 7) && getArgs(&argv[1], argc - 1, val)){
+			if(argc == 4){
+				// without second rate both switch positions share the same curve
+				val[3] = val[1];
+				val[4] = val[2];
+				val[5] = MIXER_NO_SWITCH;
+			}else if(val[5] < 0 || val[5] >= MAX_AUX_CHANNELS){
+				return CMD_BAD_PARAM;
+			}
+			if(val[0] < 0 || val[0] >= MIXER_CURVES){
+				return CMD_BAD_PARAM;
+			}
+			for(uint8_t r = 0; r < MIXER_RATES; r++){
+				if(val[1 + r * 2] < -100 || val[1 + r * 2] > 100 || val[2 + r * 2] < 0 || val[2 + r * 2] > 125){
+					return CMD_BAD_PARAM;
+				}
+			}
+			mixer_curve_t *curve = &model->curve[val[0]];
+			for(uint8_t r = 0; r < MIXER_RATES; r++){
+				curve->expo[r] = val[1 + r * 2];
+				curve->rate[r] = val[2 + r * 2];
+			}
+			curve->sw = val[5];
+		}else if(xstrcmp("-t", argv[0]) == 0 && argc == 3 && getArgs(&argv[1], 2, val)){
+			if(val[0] < 0 || val[0] >= MIXER_CURVES || val[1] < -MIXER_TRIM_MAX || val[1] > MIXER_TRIM_MAX){
+				return CMD_BAD_PARAM;
+			}
+			model->trim[val[0]] = val[1];
+		}else{
+			return CMD_BAD_PARAM;
+		}
+
+		update_mixer();
+		return CMD_OK;
+	}
+}cmdmix;
+#endif
+
+#ifdef ENABLE_MODELS
+class CmdModel : public ConsoleCommand {
+	Console *console;
+public:
+    CmdModel() : ConsoleCommand("model") {}
+	void init(void *params) { console = static_cast<Console*>(params); }
+	void help(void) {
+		console->xputs("usage: model [-u|-w|-e]");
+		console->xputs(
+			"\tList model slots, * marks model in use\n"
+			"\t-u <n|none>, switch to model n or back to protocol switches\n"
+			"\t-w <n> [name], store protocol, calibration and mixer in use on slot n\n"
+			"\t-e <n>, erase slot n\n"
+		);
+	}
+
+	void list(void){
+		model_t model;
+		char name[MODEL_NAME_LEN + 1];
+		uint8_t selected = multiprotocol_getModel();
+
+		for(uint8_t i = 0; i < MODEL_NUM; i++){
+			console->print("%s%u: ", (i == selected) ? "*" : " ", i);
+			if(!model_load(i, &model)){
+				console->print("empty\n");
+				continue;
+			}
+			memcpy(name, model.name, MODEL_NAME_LEN);
+			name[MODEL_NAME_LEN] = '\0';
+			console->print("%s proto %u sub %u rx %u option %d, %u mix lines\n",
+				name, model.protocol, model.sub_protocol, model.rx_num, model.option, model.mixer.lines);
+		}
+		if(selected == MODEL_NONE){
+			console->print("Protocol switches in use\n");
+		}
+	}
+
+	char execute(void *ptr) {
+		char *argv[4];
+		uint32_t argc;
+		int32_t slot;
+		char *p;
+
+		argc = strToArray((char*)ptr, argv);
+
+		if(argc == 0){
+			list();
+			return CMD_OK;
+		}
+
+		if(xstrcmp("help", argv[0]) == 0){
+			help();
+			return CMD_OK;
+		}
+
+		if(argc < 2){
+			return CMD_BAD_PARAM;
+		}
+
+		if(xstrcmp("-u", argv[0]) == 0 && xstrcmp("none", argv[1]) == 0){
+			slot = MODEL_NONE;
+		}else{
+			p = argv[1];
+			if(!nextInt(&p, &slot) || slot < 0 || slot >= MODEL_NUM){
+				return CMD_BAD_PARAM;
+			}
+		}
+
+		if(xstrcmp("-u", argv[0]) == 0){
+			if(!multiprotocol_selectModel(slot)){
+				console->print("Model %u not valid\n", slot);
+			}
+		}else if(xstrcmp("-w", argv[0]) == 0){
+			if(!multiprotocol_saveModel(slot, (argc > 2) ? argv[2] : "")){
+				console->print("Fail to save model\n");
+			}
+		}else if(xstrcmp("-e", argv[0]) == 0){
+			model_erase(slot);
+			// model in use is replaced by switch selection
+			if(multiprotocol_getModel() != slot || !multiprotocol_selectModel(MODEL_NONE)){
+				appSaveEEPROM();
+			}
+		}else{
+			return CMD_BAD_PARAM;
+		}
+
+		return CMD_OK;
+	}
+}cmdmodel;
+#endif
+
 ConsoleCommand *laser4_commands[]{
     &cmdhelp,
     &cmdcc25,
@@ -615,6 +1266,30 @@ ConsoleCommand *laser4_commands[]{
 	&cmdeeprom,
 	&cmdadc,
 	&cmdbuz,
+#ifdef ENABLE_LATENCY
+	&cmdlatency,
+#endif
+#ifdef ENABLE_TELEMETRY
+	&cmdtelem,
+#endif
+#ifdef ENABLE_RF_STATS
+	&cmdstats,
+#endif
+#ifdef ENABLE_DISPLAY
+	&cmdscreen,
+#endif
+#ifdef ENABLE_MIXER
+	&cmdmix,
+#endif
+#ifdef ENABLE_PROFILER
+	&cmdprof,
+#endif
+#ifdef ENABLE_TRACE
+	&cmdtrace,
+#endif
+#ifdef ENABLE_MODELS
+	&cmdmodel,
+#endif
 #ifdef ENABLE_DFU
 	&cmddfu,
 #endif
@@ -2,6 +2,7 @@
 #include "usb_device.h"
 #include "game_controller.h"
 #include "multiprotocol.h"
+#include "chanmap.h"
 #include "math.h"
 
 
@@ -9,23 +10,18 @@
 //#define TEST_CONTROLLER
 
 static controller_t laser4;
-volatile uint16_t *ppm_data, last_tim;
+volatile uint16_t last_tim;
 volatile uint32_t gflags;
 static uint8_t *channel_map;
 static uint32_t lastppm;
+static chanmap_t pulse_map;
 
 #ifdef TEST_CONTROLLER
 #undef ENABLE_PPM
 static float angle = 0;
 #else
-static int16_t map(int16_t x, int16_t in_min, int16_t in_max, int16_t out_min, int16_t out_max){
-  return ((x - in_min) * (out_max - out_min) / (in_max - in_min)) + out_min;
-}
-
-static void setControllerPpmFlag(volatile uint16_t *buf, uint8_t chan){
+static void setControllerPpmFlag(void){
     SET_PPM_FRAME;
-    ppm_data = buf;
-    radio.ppm_chan_max = chan;
 }
 #endif
 
@@ -36,24 +32,29 @@ RAM_CODE void CONTROLLER_Process(void){
     angle += 0.1;
     SET_PPM_FRAME;
     delayMs(20);
+#elif defined(ENABLE_PPM_CAPTURE)
+    ppm_process();
 #endif
 
     if(IS_PPM_FRAME_READY)
     {
+        CLR_PPM_FRAME;
 #if !defined(TEST_CONTROLLER)
         uint8_t i;
         uint8_t *data = (uint8_t*)&laser4.pitch;
+        ppm_frame_t frame;
         lastppm = getTick();
+
+        ppm_getFrame(&frame);
+        radio.ppm_chan_max = frame.chan;
         
         for(i = 0; i < MIN_PPM_CHANNELS; i++){
-            //PAUSE_CAPTURE;
-            uint16_t val = ppm_data[i];
-            //RESUME_CAPTURE;
+            uint16_t val = frame.data[i];
 
             if(val < laser4.min_pulse || val > laser4.max_pulse){
                 val = (laser4.max_pulse + laser4.min_pulse) / 2;
             }
-            val = map(val, laser4.min_pulse, laser4.max_pulse, LOGICAL_MINIMUM, LOGICAL_MAXIMUM);
+            val = chanmap_apply(&pulse_map, val);
             *(data + (channel_map[i] * 2)) = val;
             *(data + 1 + (channel_map[i] * 2)) = val >> 8;
             // Make data visible to status command
@@ -83,7 +84,6 @@ RAM_CODE void CONTROLLER_Process(void){
         }
 
 #endif  
-        CLR_PPM_FRAME;
         USB_DEVICE_SendReport((uint8_t*)&laser4, REPORT_SIZE);        
     }
 
@@ -109,6 +109,7 @@ void CONTROLLER_Init(void){
     laser4.buttons = 0;
     laser4.max_pulse = PPM_MAX_PERIOD;
     laser4.min_pulse = PPM_MIN_PERIOD;
+    chanmap_compile(&pulse_map, laser4.min_pulse, laser4.max_pulse, LOGICAL_MINIMUM, LOGICAL_MAXIMUM, LOGICAL_MINIMUM, LOGICAL_MAXIMUM);
 
     channel_map = CH_AETR;
 
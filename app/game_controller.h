@@ -10,7 +10,7 @@
 #define PAUSE_CAPTURE           PPM_TIM->DIER &= ~(TIM_DIER_CC4IE)
 #define RESUME_CAPTURE          PPM_TIM->DIER |=  (TIM_DIER_CC4IE)
 
-#pragma pack (1)
+#pragma pack (push, 1)
 // must follow HID report structure
 typedef struct controller{
   int8_t  buttons;
@@ -24,6 +24,7 @@ typedef struct controller{
   uint16_t max_pulse;
   uint16_t min_pulse;
 }controller_t;
+#pragma pack (pop)
 
 void CONTROLLER_Process(void);
 void CONTROLLER_Init(void);
@@ -1,14 +1,40 @@
 #include "app.h"
 #include "multiprotocol.h"
-#include "usb_device.h"
 #include "mpanel.h"
+#include "livepanel.h"
+#ifdef ENABLE_TELEMETRY
+#include "telemetry.h"
+#endif
+#ifdef ENABLE_RF_STATS
+#include "rf_stats.h"
+#endif
+
+#if defined(ENABLE_VCOM) || defined(ENABLE_GAME_CONTROLLER)
+#include "usb_device.h"
+#endif
 
 
 volatile uint8_t state;
 static float bat_consumed = 0;  //mAh
-static uint8_t bat_low_tim;
+static uint32_t bat_low_tim = SWTIM_NONE;
 uint32_t app_flags = 0;
 
+#ifdef ENABLE_DISPLAY
+static struct {
+    uint8_t  pressed;   // debounced state
+    uint8_t  used;      // press already acted on, nothing more until release
+    uint8_t  direct;    // held since power on, goes to its channel as read
+    uint32_t changed;   // ms, last state change
+    uint32_t pulse_end; // ms, short push is sent on its channel until then
+}enc_push;
+#endif
+
+static struct {
+    uint32_t idle;      // TIMER_BASE ticks spent sleeping on current window
+    uint32_t start;     // window start, ms
+    uint16_t busy;      // load on last window, 0.1%
+}cpu_load;
+
 
 tone_t chime[] = {
     {493,200},
@@ -32,6 +58,8 @@ Console con;
 #define ICO_2_4GHZ_POS  53, 1 // 17x7
 #define ICO_USB_POS     70, 1 // 13x7
 #define DRO_MA_POS      88, 1
+#define DRO_RSSI_POS    70, 1 // shares space with usb icon, multiprotocol mode only
+#define DRO_RSSI_SIZE   15, 5
 
 #define VERSION_POS     8,8
 
@@ -39,43 +67,45 @@ Console con;
 #define ICO_CLR_SIZE    15+17+13, 8
 
 #define APP_DRAW_ICON(ICO)      MPANEL_drawIcon(ICO.posx, ICO.posy, ICO.data)
-#define APP_ERASE_ICON(ICO)     LCD_FillRect(ICO.posx, ICO.posy, ICO.data->width, ICO.data->hight, BLACK);                
+#define APP_ERASE_ICON(ICO)     MPANEL_fillRect(ICO.posx, ICO.posy, ICO.data->width, ICO.data->hight, BLACK);                
 
 /**
- * Icons bitmaps
+ * Icons bitmaps, rows converted to page columns at compile time
  * */
-const uint8_t ico_volt_data[] = {7,8,
+MPANEL_BITMAP(ico_volt_data, 7, 8,
     0x7f,0x5d,0x5d,0x5d,0x5d,0x6b,0x77,0x7f
-};
+);
 
-const uint8_t ico_amph_data[] = {10, 8,
+MPANEL_BITMAP(ico_amph_data, 10, 8,
     0x03,0xff,0x03,0x3f,0x02,0xd7,0x02,0xd7,0x02,0x13,0x02,0xd5,0x02,0xd5,0x03,0xff
-};
+);
 
-const uint8_t ico_lowbat_data[] = {29, 7,    
+MPANEL_BITMAP(ico_lowbat_data, 29, 7,
     0x1f,0xff,0xff,0xff,0x17,0xff,0xff,0xff,0x17,0x9b,0xb7,0xb1,0x17,0x6b,
     0xb3,0x5b,0x17,0x6a,0xb5,0x1b,0x11,0x9d,0x71,0x5b,0x1f,0xff,0xff,0xff
-};
+);
 
-const uint8_t ico_35mhz_data[] = {15, 7,
+MPANEL_BITMAP(ico_35mhz_data, 15, 7,
     0x7f,0xff,0x44,0x5d,0x75,0xc9,0x44,0x55,0x77,0x5d,0x44,0x5d,0x7f,0xff
-};
+);
 
-const uint8_t ico_2_4ghz_data[] = {15, 7,
+MPANEL_BITMAP(ico_2_4ghz_data, 15, 7,
     0x7f,0xff,0x46,0xb3,0x76,0xaf,0x46,0x29,0x5f,0xad,0x45,0xb1,0x7f,0xff
-};
+);
 
-const uint8_t ico_usb_data[] = {13, 7,
+#ifdef ENABLE_GAME_CONTROLLER
+MPANEL_BITMAP(ico_usb_data, 13, 7,
     0x1f,0xff,0x15,0x13,0x15,0x75,0x15,0x13,0x15,0xd5,0x11,0x13,0x1f,0xff
-};
+);
+#endif
 
-const uint8_t ico_error_data[] = {7, 7,
-    0x08,0x14,0x1c,0x2a,0x22,0x49,0x7f,
-};
+MPANEL_BITMAP(ico_error_data, 7, 7,
+    0x08,0x14,0x1c,0x2a,0x22,0x49,0x7f
+);
 
-const uint8_t ico_bind_data[] = {7,7,
-    0x04,0x0a,0x01,0x2a,0x40,0x28,0x10,
-};
+MPANEL_BITMAP(ico_bind_data, 7, 7,
+    0x04,0x0a,0x01,0x2a,0x40,0x28,0x10
+);
 
 /**
  * Icons structures
@@ -83,43 +113,45 @@ const uint8_t ico_bind_data[] = {7,7,
 static mpanelicon_t ico_volt = {
     (uint16_t)(font_seven_seg.w * 3 + 7),
     (uint16_t)(font_seven_seg.h/2),
-    (idata_t*)ico_volt_data
+    &ico_volt_data
 };
 
 static mpanelicon_t ico_amph = {
     (uint16_t)(font_seven_seg.w * 3 + 7),
     (uint16_t)(font_seven_seg.h/2),
-    (idata_t*)ico_amph_data
+    &ico_amph_data
 };
 
 static mpanelicon_t ico_35mhz = {
     ICO_35MHZ_POS,
-    (idata_t*)ico_35mhz_data
+    &ico_35mhz_data
 };
 
 static mpanelicon_t ico_2_4ghz = {
     ICO_2_4GHZ_POS,
-    (idata_t*)ico_2_4ghz_data
+    &ico_2_4ghz_data
 };
 
+#ifdef ENABLE_GAME_CONTROLLER
 static mpanelicon_t ico_usb = {
     ICO_USB_POS,
-    (idata_t*)ico_usb_data
+    &ico_usb_data
 };
+#endif
 
 static mpanelicon_t ico_low_bat = {
     ICO_LOWBAT_POS,
-    (idata_t*)ico_lowbat_data
+    &ico_lowbat_data
 };
 
 static mpanelicon_t ico_error = {
     ICO_ERROR_POS,
-    (idata_t*)ico_error_data
+    &ico_error_data
 };
 
 static mpanelicon_t ico_bind = {
     ICO_BIND_POS,
-    (idata_t*)ico_bind_data
+    &ico_bind_data
 };
 
 MpanelDro dro_bat(DRO_BAT_POS, "%.2f",&font_seven_seg);
@@ -140,7 +172,8 @@ uint16_t eeprom_data[EEPROM_SIZE / 2] = {
     CHANNEL_MAX_125, CHANNEL_MIN_125, 
     PPM_MAX_100, PPM_MIN_100, 
     CHANNEL_SWITCH, PPM_DEFAULT_VALUE,
-    BUZ_DEFAULT_VOLUME
+    BUZ_DEFAULT_VOLUME,
+    0xFFFF                  // no model selected
 };
 
 /**
@@ -150,6 +183,7 @@ uint8_t appGetCurrentMode(void){
     return state;
 }
 
+#if defined(ENABLE_VCOM) || defined(ENABLE_GAME_CONTROLLER)
 /**
  * @brief Usb connect callback, called when usb cable is connected
  * or if the system is power on with the usb cable plugged in
@@ -162,7 +196,7 @@ void usbConnectCB(void *ptr){
     dbg_init(&vcom);
 #endif
 
-#ifdef ENABLE_CLI
+#if defined(ENABLE_CLI) && defined(ENABLE_VCOM)
     // redirect cli to vcom
     con.setOutput(&vcom);
 #endif
@@ -184,6 +218,7 @@ void usbDisconnectCB(void *ptr){
     con.setOutput(&pcom);
 #endif
 }
+#endif /* ENABLE_VCOM || ENABLE_GAME_CONTROLLER */
 
 /**
  * @brief Operating mode change request
@@ -202,7 +237,7 @@ uint8_t cur_state = state & STATE_MASK;
         } 
     }
 #ifdef ENABLE_DISPLAY
-    LCD_FillRect(ICO_CLR_START, ICO_CLR_SIZE, BLACK);
+    MPANEL_fillRect(ICO_CLR_START, ICO_CLR_SIZE, BLACK);
 #endif
     // set the requested mode by overwriting the previous
     state = (new_mode << STATE_BITS) | REQ_MODE_CHANGE;
@@ -249,6 +284,9 @@ static void changeMode(uint8_t new_mode){
 void appCheckBattery(void){
 vires_t res;
     if(batteryReadVI(&res)){
+#ifdef ENABLE_TRACE
+        trace_battery(res.vbat, res.cur);
+#endif
         if(res.vbat < BATTERY_VOLTAGE_MIN && !(IS_BAT_LOW)){
             SET_BAT_LOW;
             DBG_PRINT("!!Low battery !! (%dmV)\n", res.vbat);
@@ -258,6 +296,7 @@ vires_t res;
             if(IS_BAT_LOW){
                 CLR_BAT_LOW;
                 stopTimer(bat_low_tim);
+                bat_low_tim = SWTIM_NONE;
                 if(IS_BAT_ICO_ON){
                     appToggleLowBatIco();
                 }
@@ -275,6 +314,31 @@ vires_t res;
     }    
 }
 
+#if defined(ENABLE_TRACE) && defined(ENABLE_RF_STATS)
+/**
+ * @brief Periodic RF counters and RSSI on trace stream
+ * */
+static void appTraceRf(void){
+    rf_stats_t *st;
+    int16_t tx_rssi = 0;
+    uint8_t rx_rssi = 0;
+
+    if(!trace_isEnabled() || (state & STATE_MASK) != MODE_MULTIPROTOCOL){
+        return;
+    }
+
+    st = rf_getStats();
+#ifdef ENABLE_TELEMETRY
+    telemetry_t *tlm = telemetry_getData();
+    if(tlm->link){
+        tx_rssi = tlm->tx_rssi;
+        rx_rssi = tlm->rx_rssi;
+    }
+#endif
+    trace_rf(st->tx_packets, st->rx_packets, st->rx_bad_crc, st->rx_missed, tx_rssi, rx_rssi);
+}
+#endif
+
 #ifdef ENABLE_DISPLAY
 /**
  * @brief blink low battery icon
@@ -290,6 +354,35 @@ void appToggleLowBatIco(void){
     SET_LCD_UPDATE;
 }
 
+#ifdef ENABLE_TELEMETRY
+/**
+ * @brief Show telemetry RSSI while the link is up
+ * */
+static void appCheckTelemetry(void){
+    static uint8_t shown = 0;
+    static int16_t rssi;
+    telemetry_t *tlm = telemetry_getData();
+
+    if((state & STATE_MASK) != MODE_MULTIPROTOCOL){
+        shown = 0;
+        return;
+    }
+
+    if(tlm->link){
+        if(!shown || tlm->tx_rssi != rssi){
+            rssi = tlm->tx_rssi;
+            MPANEL_print(DRO_RSSI_POS, &pixelDustFont, "%3d", rssi);
+            shown = 1;
+            SET_LCD_UPDATE;
+        }
+    }else if(shown){
+        MPANEL_fillRect(DRO_RSSI_POS, DRO_RSSI_SIZE, BLACK);
+        shown = 0;
+        SET_LCD_UPDATE;
+    }
+}
+#endif
+
 /**
  * @brief check multiprotocol flags and place icons 
  * accordingly
@@ -323,15 +416,95 @@ void appCheckProtocolFlags(void){
             SET_LCD_UPDATE;
         }
     }
+
+#ifdef ENABLE_TELEMETRY
+    appCheckTelemetry();
+#endif
+}
+
+/**
+ * @brief Show main or live screen, live screen is drawn from scratch
+ * */
+void appSetScreen(uint8_t screen){
+    if(screen == MPANEL_getShown()){
+        return;
+    }
+
+    if(screen == MPANEL_SCREEN_LIVE){
+        LIVE_start();
+    }else{
+        LIVE_stop();
+    }
+    MPANEL_show(screen);
+    SET_LCD_UPDATE;
+}
+
+/**
+ * @brief Long encoder push switches screens, then live screen steps.
+ * Called on idle windows. A push is kept off its AUX3 channel until it
+ * is known to be short, it is then sent on release for as long as it
+ * was held. Pushes that switch screens never reach the channel.
+ *
+ * @param budget_us : time that can be spent drawing
+ * */
+void appProcessDisplay(uint32_t budget_us){
+    uint8_t pressed = IS_ENC_PUSH_PRESSED;
+    uint32_t held;
+
+    if(pressed != enc_push.pressed && getTick() - enc_push.changed >= ENC_PUSH_DEBOUNCE){
+        held = getTick() - enc_push.changed;
+        enc_push.pressed = pressed;
+        enc_push.changed = getTick();
+        if(!pressed){
+            if(!enc_push.used){
+                enc_push.pulse_end = getTick() + ((held > ENC_PUSH_PULSE) ? held : ENC_PUSH_PULSE);
+            }
+            enc_push.used = 0;
+            enc_push.direct = 0;
+        }
+    }
+
+    if(enc_push.pressed && !enc_push.used && getTick() - enc_push.changed >= ENC_PUSH_LONG){
+        enc_push.used = 1;
+        appSetScreen(MPANEL_getShown() == MPANEL_SCREEN_LIVE ? MPANEL_SCREEN_MAIN : MPANEL_SCREEN_LIVE);
+    }
+
+    LIVE_process(budget_us);
+}
+
+/**
+ * @brief Switches as the channels see them, the encoder push is
+ * replaced by its short pushes
+ *
+ * @param switches : bitmask as HW_SW_READ
+ * @return : bitmask as HW_SW_READ
+ * */
+uint32_t appChannelSwitches(uint32_t switches){
+    if(enc_push.direct){
+        return switches;
+    }
+    switches &= ~ENC_PUSH_SWITCH;
+    if((int32_t)(enc_push.pulse_end - getTick()) > 0){
+        switches |= ENC_PUSH_SWITCH;
+    }
+    return switches;
 }
 
 #endif /* ENABLE_DISPLAY */
 /**
- * @brief
+ * @brief Load eeprom data, taking it from the old flat page on first start
  * 
  * */
 void appInitEEPROM(uint8_t *dst){
 uint8_t bind_flag;
+const uint8_t *legacy = nvj_legacy();
+
+    if(legacy != NULL && legacy[EEPROM_BIND_FLAG] == BIND_FLAG_VALUE){
+        // First start after update, settings and models are still on the old flat page
+        if(!nvj_import(legacy, NVJ_SIZE)){
+            DBG_PRINT("Error importing EEPROM\n");
+        }
+    }
     
     if(EEPROM_Read(EEPROM_BIND_FLAG, &bind_flag, 1) != 1){
         DBG_PRINT("Error reading EEPROM\n");
@@ -339,7 +512,7 @@ uint8_t bind_flag;
     }
         
     if(bind_flag == BIND_FLAG_VALUE){    
-        if(NV_Restore(dst, EEPROM_SIZE) != EEPROM_SIZE){
+        if(EEPROM_Read(EEPROM_ID_OFFSET, dst, EEPROM_SIZE) != EEPROM_SIZE){
             DBG_PRINT("Error reading EEPROM\n");
             return;
         }
@@ -349,24 +522,107 @@ uint8_t bind_flag;
 
 
 /**
- * @brief Save the ram eeprom content to flash memory
- * Note: In order to save eeprom
- * 
+ * @brief Queue the ram eeprom content for saving, flash is
+ * programmed later on appProcessEEPROM() calls
  * */
 void appSaveEEPROM(void){
 
-    // FIXME: Really should implement CRC
     *((uint8_t*)eeprom_data+EEPROM_BIND_FLAG) = BIND_FLAG_VALUE;
 
     EEPROM_Write(EEPROM_ID_OFFSET, (uint8_t*)eeprom_data, EEPROM_SIZE);
+    EEPROM_Commit();
+}
+
+/**
+ * @brief Program queued eeprom data on flash
+ *
+ * @param budget_us : time that can be spent on flash programming
+ * @param allow_erase : a page erase stalls for up to NVJ_ERASE_US
+ * */
+void appProcessEEPROM(uint32_t budget_us, uint8_t allow_erase){
+    switch(EEPROM_Step(budget_us, allow_erase)){
+        case NVJ_STEP_DONE:
+            DBG_PRINT("EEPROM Saved\n");
+            break;
+
+        case NVJ_STEP_FAIL:
+            DBG_PRINT("!! Fail to sync EEPROM !!\n");
+            break;
+
+        default:
+            break;
+    }
+}
 
+/**
+ * @brief Save queued eeprom data now, blocks until done.
+ * Used before reset
+ * */
+void appFlushEEPROM(void){
     if(!EEPROM_Sync()){
         DBG_PRINT("!! Fail to sync EEPROM !!\n");
-    }else{
-        DBG_PRINT("EEPROM Saved\n");
     }
 }
 
+/**
+ * @brief Close the cpu load window once it is long enough
+ * */
+static void appUpdateCpuLoad(void){
+    uint32_t elapsed = getTick() - cpu_load.start;
+
+    if(elapsed >= CPU_LOAD_WINDOW){
+        // TIMER_BASE ticks are 0.5us, 2000 per ms
+        uint32_t idle = cpu_load.idle / (elapsed * 2);
+        cpu_load.busy = (idle < 1000) ? 1000 - idle : 0;
+        cpu_load.idle = 0;
+        cpu_load.start += elapsed;
+    }
+}
+
+/**
+ * @brief Sleep until next interrupt, SysTick wakes the cpu at least every 1ms.
+ * Time spent sleeping is measured with TIMER_BASE, that keeps running on sleep.
+ *
+ * @param wake_on_compare : also wake on scheduler compare match, the sleep is
+ *                          skipped if it has already happened
+ * */
+void appIdle(uint8_t wake_on_compare){
+    uint16_t start, end;
+
+    if(!wake_on_compare && nextTimerExpiry() == 0){
+        return;
+    }
+
+    cli();
+    if(wake_on_compare){
+        // Masked again by its handler
+        TIMER_BASE->DIER |= TIMER_BASE_CCIE;
+    }
+    if(wake_on_compare && (TIMER_BASE->SR & TIMER_BASE_CCIF)){
+        sei();
+        return;
+    }
+    start = TIMER_BASE->CNT;
+    PROF_START(sleep_start);
+    __WFI();
+    PROF_END(PROF_IDLE, sleep_start);
+    sei();                              // handler of wake up source runs first
+    end = TIMER_BASE->CNT;
+
+    cpu_load.idle += (uint16_t)(end - start);
+    appUpdateCpuLoad();
+}
+
+/**
+ * @brief Time not spent on appIdle() over the last window
+ *
+ * @return : cpu load in 0.1%
+ * */
+uint16_t appGetCpuLoad(void){
+    appUpdateCpuLoad();
+    return cpu_load.busy;
+}
+
 /**
  * @brief Application setup call
  * */
@@ -375,7 +631,7 @@ void setup(void){
     state = STARTING;
         
     laser4Init();
-    NV_Init();
+    nvj_init();
 
 #if defined(ENABLE_USART) && defined(ENABLE_DEBUG)
     usart_init();
@@ -414,11 +670,11 @@ void setup(void){
     DBG_PRINT("Battery voltage: %dmV\n", batteryGetVoltage());   
 
 #ifdef ENABLE_DISPLAY
-
+    MPANEL_init();
     MPANEL_print(VERSION_POS, &pixelDustFont, "V%u.%u.%u", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
-    LCD_Update();
+    requestLcdUpdate();                 // pages are sent while waiting
     delayMs(1000);
-    LCD_FillRect(VERSION_POS, 64, pixelDustFont.h, BLACK); // Erase version from display
+    MPANEL_fillRect(VERSION_POS, 64, pixelDustFont.h, BLACK); // Erase version from display
 
     dro_bat.setIcon(&ico_volt);
     dro_amph.setIcon(&ico_amph);
@@ -430,8 +686,15 @@ void setup(void){
     appCheckBattery();
 
     startTimer(TIMER_PPM_TIME, SWTIM_AUTO_RELOAD, appCheckProtocolFlags);
+    // held at power on selects the 35MHz radio, not a screen change
+    enc_push.pressed = IS_ENC_PUSH_PRESSED;
+    enc_push.used = enc_push.pressed;
+    enc_push.direct = enc_push.pressed;
     SET_LCD_UPDATE;
 #endif 
+#if defined(ENABLE_TRACE) && defined(ENABLE_RF_STATS)
+    startTimer(TRACE_RF_PERIOD, SWTIM_AUTO_RELOAD, appTraceRf);
+#endif
     // wait for melody to finish
     buzWaitEnd();    
     // Configure watchdog
@@ -444,9 +707,12 @@ void setup(void){
 void loop(void){
 
     switch(state & STATE_MASK){
-        case MODE_MULTIPROTOCOL:
-            multiprotocol_loop();
+        case MODE_MULTIPROTOCOL:{
+            PROF_START(start);
+            multiprotocol_loop();       // saves eeprom on its idle windows
+            PROF_END(PROF_MP_LOOP, start);
             break;
+        }
 
         case MODE_HID:
 #ifdef ENABLE_GAME_CONTROLLER
@@ -471,16 +737,41 @@ void loop(void){
     }
 
 #ifdef ENABLE_CLI
+    PROF_START(cli_start);
     con.process();
+    PROF_END(PROF_CLI, cli_start);
+#endif
+
+    if((state & STATE_MASK) != MODE_MULTIPROTOCOL){
+        appProcessEEPROM(NVJ_NO_LIMIT, 1);
+#ifdef ENABLE_DISPLAY
+        appProcessDisplay(LIVE_NO_LIMIT);
 #endif
+    }
 
+    PROF_START(timers_start);
     processTimers();
+    PROF_END(PROF_TIMERS, timers_start);
+
     if(IS_LCD_UPDATE){
+        PROF_START(lcd_start);
         if(requestLcdUpdate()){
             CLR_LCD_UPDATE;
         }
+        PROF_END(PROF_LCD, lcd_start);
+    }
+
+#if defined(ENABLE_TRACE) && defined(ENABLE_VCOM)
+    if(trace_isEnabled()){
+        vcp_txService();        // starts the stream, USB interrupt keeps it going
     }
+#endif
     reloadWatchDog();
+
+    // Radio mode sleeps on multiprotocol_loop, between callbacks
+    if((state & STATE_MASK) == MODE_HID && !(IS_LCD_UPDATE)){
+        appIdle(0);
+    }
 }
 
 
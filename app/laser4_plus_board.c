@@ -3,6 +3,7 @@
 #include "stm32f1xx_hal.h"
 #include <stdout.h>
 #include "usbd_conf.h"
+#include "profiler.h"
 
 typedef struct {
     volatile uint16_t status;
@@ -16,15 +17,6 @@ typedef struct {
 }adc_t;
 
 
-typedef struct {
-        uint32_t time;
-        uint32_t count;
-        uint32_t status;
-        void (*action)(void);
-}swtimer_t;
-
-swtimer_t timers[SWTIM_NUM];
-
 typedef struct {
     tone_t *ptone;
     tone_t tone;
@@ -45,6 +37,7 @@ static void (*pinIntCB)(void);
 
 #ifdef ENABLE_DISPLAY
 I2C_HandleTypeDef hi2c2;
+static DMA_HandleTypeDef hdma_i2c2_tx;
 static void i2cInit(void);
 #endif
 
@@ -54,6 +47,7 @@ static void timInit(void);
 static void adcInit(void);
 static void encInit(void);
 static void crcInit(void);
+static void cycleCounterInit(void);
 static void ppmOutInit(void);
 static void buzInit(void);
 
@@ -78,6 +72,7 @@ void laser4Init(void){
     ppmOutInit();
     buzInit();
     crcInit();
+    cycleCounterInit();
 #ifdef ENABLE_SERIAL_FIFOS
     fifo_init(&serial_rx_fifo);
     fifo_init(&serial_tx_fifo);
@@ -127,14 +122,41 @@ void gpioRemoveInterrupt(GPIO_TypeDef *port, uint8_t pin){
 }
 
 
-void SPI_Write(uint8_t data){
-  HAL_SPI_Transmit(&hspi, &data, 1, 10);
-} 
+/**
+ * @brief Transfer header plus payload to CC2500 on a single chip select window.
+ * Next byte is written only after the previous one is read, so an interrupt
+ * taken between bytes delays the transfer but can not overrun the receiver.
+ * 
+ * @param header : first byte, address or strobe
+ * @param tx : payload, NULL to send zeros
+ * @param rx : buffer for received payload, can be NULL
+ * @param len : payload length, excluding header
+ * @return : chip status byte received with header
+ * */
+RAM_CODE uint8_t SPI_Burst(uint8_t header, const uint8_t *tx, uint8_t *rx, uint16_t len){
+    SPI_TypeDef *spi = SPI2;
+    uint8_t status, data;
+
+    CC25_CS_TRUE;
+
+    spi->DR = header;
+    while(!(spi->SR & SPI_SR_RXNE));
+    status = spi->DR;
+
+    for(uint16_t i = 0; i < len; i++){
+        spi->DR = (tx != NULL) ? tx[i] : 0;
+        while(!(spi->SR & SPI_SR_RXNE));
+        data = spi->DR;
+        if(rx != NULL){
+            rx[i] = data;
+        }
+    }
+
+    while(spi->SR & SPI_SR_BSY);
+
+    CC25_CS_FALSE;
 
-uint8_t SPI_Read(void){
-uint8_t data;
-    HAL_SPI_Receive(&hspi, &data, 1, 10);
-    return data;
+    return status;
 }
 
 /**
@@ -159,6 +181,9 @@ static void spiInit(){
         Error_Handler(__FILE__, __LINE__);
     }
 
+    // Transfers are done by SPI_Burst without HAL
+    __HAL_SPI_ENABLE(&hspi);
+
     SPI_PINS_INIT;
 }
 
@@ -170,7 +195,7 @@ static void spiInit(){
   */
 static void i2cInit(void){
     hi2c2.Instance = I2C2;
-    hi2c2.Init.ClockSpeed = 100000;
+    hi2c2.Init.ClockSpeed = I2C_CLOCK;
     hi2c2.Init.DutyCycle = I2C_DUTYCYCLE_2;
     hi2c2.Init.OwnAddress1 = 0;
     hi2c2.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
@@ -200,50 +225,153 @@ void HAL_I2C_MspInit(I2C_HandleTypeDef *hi2c){
     gpioInit(GPIOB, 10, GPO_10MHZ | GPO_AF | GPO_OD);
     gpioInit(GPIOB, 11, GPO_10MHZ | GPO_AF | GPO_OD);
     __HAL_RCC_I2C2_CLK_ENABLE();
-    HAL_NVIC_SetPriority(I2C2_EV_IRQn, 0, 0);
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    // I2C2 TX is on DMA1 channel 4
+    hdma_i2c2_tx.Instance = DMA1_Channel4;
+    hdma_i2c2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_i2c2_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_i2c2_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_i2c2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_i2c2_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_i2c2_tx.Init.Mode = DMA_NORMAL;
+    hdma_i2c2_tx.Init.Priority = DMA_PRIORITY_LOW;
+    if(HAL_DMA_Init(&hdma_i2c2_tx) != HAL_OK){
+        Error_Handler(__FILE__, __LINE__);
+    }
+    __HAL_LINKDMA(hi2c, hdmatx, hdma_i2c2_tx);
+
+    // Below PPM input and scheduler, display can wait
+    HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, I2C_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+    HAL_NVIC_SetPriority(I2C2_EV_IRQn, I2C_IRQ_PRIORITY, 0);
     HAL_NVIC_EnableIRQ(I2C2_EV_IRQn);
-    HAL_NVIC_SetPriority(I2C2_ER_IRQn, 0, 0);
+    HAL_NVIC_SetPriority(I2C2_ER_IRQn, I2C_IRQ_PRIORITY, 0);
     HAL_NVIC_EnableIRQ(I2C2_ER_IRQn);
 }
 
 void I2C2_EV_IRQHandler(void){
+    PROF_START(start);
     HAL_I2C_EV_IRQHandler(&hi2c2);
+    PROF_END(PROF_I2C, start);
 }
 
 void I2C2_ER_IRQHandler(void){
     HAL_I2C_ER_IRQHandler(&hi2c2);
 }
 
-static volatile uint8_t lcd_busy;
+void DMA1_Channel4_IRQHandler(void){
+    PROF_START(start);
+    HAL_DMA_IRQHandler(&hdma_i2c2_tx);
+    PROF_END(PROF_I2C, start);
+}
+
+/**
+ * Blocks waiting for transfer, taken in order by the transfer complete
+ * interrupt. Queued blocks may be taken back by the owner, setting their
+ * state to idle, their entry is skipped when reached.
+ * */
+static struct {
+    i2c_block_t *blk[I2C_QUEUE_SIZE];
+    uint8_t head;
+    uint8_t tail;
+    i2c_block_t *active;
+}i2c_queue;
+
+/**
+ * @brief Start next queued block, called with interrupts disabled or
+ * from I2C interrupts
+ * */
+static void I2C_StartNext(void){
+    i2c_block_t *blk;
+
+    while(i2c_queue.active == NULL && i2c_queue.tail != i2c_queue.head){
+        blk = i2c_queue.blk[i2c_queue.tail++ & (I2C_QUEUE_SIZE - 1)];
+        if(blk->state != I2C_BLOCK_QUEUED){
+            continue;
+        }
+        blk->state = I2C_BLOCK_ACTIVE;
+        i2c_queue.active = blk;
+        if(HAL_I2C_Master_Transmit_DMA(&hi2c2, blk->address << 1, blk->data, blk->size) != HAL_OK){
+            blk->state = I2C_BLOCK_FAILED;
+            i2c_queue.active = NULL;
+        }
+    }
+}
+
 void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c){
-    lcd_busy = 0;
+    if(i2c_queue.active != NULL){
+        i2c_queue.active->state = I2C_BLOCK_IDLE;
+        i2c_queue.active = NULL;
+    }
+    I2C_StartNext();
 }
 
-void I2C_WriteBlock(uint16_t address, uint8_t *data, uint16_t size){
-#if 0    
-    uint32_t retry = 100;
-    while(retry--){
-        if(HAL_I2C_Master_Transmit_IT(&hi2c2, address << 1, data, size) == HAL_OK){
-            break;
+/**
+ * @brief Bus error or no acknowledge, the block is sent again up to
+ * I2C_RETRIES times, then given back to its owner as failed
+ * */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c){
+    i2c_block_t *blk = i2c_queue.active;
+
+    if(blk == NULL){
+        return;
+    }
+
+    if(blk->retries < I2C_RETRIES){
+        blk->retries++;
+        if(HAL_I2C_Master_Transmit_DMA(&hi2c2, blk->address << 1, blk->data, blk->size) == HAL_OK){
+            return;
         }
     }
-#else
-    if(lcd_busy == 0){
-        lcd_busy = 1;
-        HAL_I2C_Master_Transmit_IT(&hi2c2, address << 1, data, size);
+
+    blk->state = I2C_BLOCK_FAILED;
+    i2c_queue.active = NULL;
+    I2C_StartNext();
+}
+
+/**
+ * @brief Queue block for transfer, data must be kept until its state
+ * leaves I2C_BLOCK_QUEUED and I2C_BLOCK_ACTIVE
+ * 
+ * @return : 0 if queue is full
+ * */
+uint8_t I2C_Queue(i2c_block_t *blk){
+    uint32_t primask = __get_PRIMASK();
+    uint8_t res = 0;
+
+    __disable_irq();
+    if((uint8_t)(i2c_queue.head - i2c_queue.tail) < I2C_QUEUE_SIZE){
+        blk->state = I2C_BLOCK_QUEUED;
+        blk->retries = 0;
+        i2c_queue.blk[i2c_queue.head++ & (I2C_QUEUE_SIZE - 1)] = blk;
+        I2C_StartNext();
+        res = 1;
     }
-#endif
+    __set_PRIMASK(primask);
+    return res;
 }
+
 /**
- * @brief request lcd update
- * @return : 0 if lcd is busy, otherwise success
+ * @brief Check for transfers in progress or waiting
  * */
-uint8_t requestLcdUpdate(void){
-    if(!lcd_busy){
-        LCD_Update();
-        return 1;
+uint8_t I2C_IsBusy(void){
+    return i2c_queue.active != NULL || i2c_queue.tail != i2c_queue.head;
+}
+
+/**
+ * @brief Single block transfer, dropped if previous one is not done
+ * */
+void I2C_WriteBlock(uint16_t address, uint8_t *data, uint16_t size){
+    static i2c_block_t blk;
+
+    if(blk.state == I2C_BLOCK_QUEUED || blk.state == I2C_BLOCK_ACTIVE){
+        return;
     }
-    return 0;
+    blk.address = address;
+    blk.data = data;
+    blk.size = size;
+    I2C_Queue(&blk);
 }
 
 #endif
@@ -278,11 +406,16 @@ static void timInit(void){
     TIMER_BASE->CR1 = 0;                               // Stop counter
     TIMER_BASE->PSC = (SystemCoreClock/2000000) - 1;	// 36-1;for 72 MHZ /0.5sec/(35+1)
     TIMER_BASE->ARR = 0xFFFF;							// Count until 0xFFFF
+#ifdef ENABLE_PPM_CAPTURE
+    TIMER_BASE->CCMR2 = (1<<4);	                    // Main scheduler, CH1 is used for PPM capture
+#else
     TIMER_BASE->CCMR1 = (1<<4);	                    // Main scheduler
-	TIMER_BASE->SR = 0x1E5F & ~TIM_SR_CC1IF;			// Clear Timer/Comp2 interrupt flag
+#endif
+	TIMER_BASE->SR = 0x1E5F & ~TIMER_BASE_CCIF;			// Clear Timer/Comp2 interrupt flag
     TIMER_BASE->DIER = 0;               				// Disable Timer/Comp2 interrupts
     TIMER_BASE->EGR |= TIM_EGR_UG;					    // Refresh the timer's count, prescale, and overflow
     TIMER_BASE->CR1 |= TIM_CR1_CEN;                    // Enable counter
+    NVIC_EnableIRQ(TIMER_BASE_IRQn);                    // Compare interrupt is only enabled by appIdle()
 }
 
 void delayMs(uint32_t ms){
@@ -294,6 +427,20 @@ uint32_t timeout = ticks + ms;
 uint32_t getTick(void){ return ticks; }
 uint32_t HAL_GetTick(void){ return getTick(); }
 
+/**
+ * @brief Enable DWT cycle counter, used by the profiler
+ * */
+static void cycleCounterInit(void){
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief Cpu cycles since power on, wraps every ~60s at 72MHz
+ * */
+uint32_t getCycleCount(void){ return DWT->CYCCNT; }
+
 /**
  * @brief Flash write functions for EEPROM emulation
  */
@@ -698,6 +845,57 @@ void ppmOutInit(void){
     PPM_TIM->DIER |= TIM_DIER_UDE; 
 }
 
+#ifdef ENABLE_PPM_CAPTURE
+static uint16_t ppm_capture_len;
+/**
+ * @brief Start PPM input capture on PB5.
+ * Falling edges on TI2 are latched by TIMER_BASE CH1 and each captured
+ * value is copied by DMA to a circular buffer, no interrupts are used.
+ * 
+ * @param buf : capture buffer
+ * @param len : number of entries on buffer
+ * */
+void ppmCaptureStart(volatile uint16_t *buf, uint16_t len){
+    gpioInit(HW_PPM_INPUT_PORT, HW_PPM_INPUT_PIN, GPI_PU);
+    AFIO->MAPR = (AFIO->MAPR & ~(3 << 10)) | (2 << 10);     // Partial remap for TIM3; PB5 -> CH2
+
+    ppm_capture_len = len;
+
+    RCC->AHBENR |= RCC_AHBENR_DMA1EN;                       // Enable DMA1
+    PPM_CAPTURE_DMA->CCR = 0;
+    PPM_CAPTURE_DMA->CPAR = (uint32_t)&TIMER_BASE->CCR1;    // Source peripheral
+    PPM_CAPTURE_DMA->CMAR = (uint32_t)buf;
+    PPM_CAPTURE_DMA->CNDTR = len;
+    PPM_CAPTURE_DMA->CCR =
+            DMA_CCR_PL_0 |                                  // Medium priority
+            DMA_CCR_MSIZE_0 |                               // 16bit Dst size
+            DMA_CCR_PSIZE_0 |                               // 16bit src size
+            DMA_CCR_MINC |                                  // increment memory pointer after transference
+            DMA_CCR_CIRC |                                  // Circular buffer
+            DMA_CCR_EN;
+
+    TIMER_BASE->CCER &= ~(TIM_CCER_CC1E | TIM_CCER_CC2E);
+    TIMER_BASE->CCMR1 = (3 << 12)                           // TI2 filter, N = 8
+                    | TIM_CCMR1_CC2S_0                      // TI2 as input, required for the filter
+                    | TIM_CCMR1_CC1S_1;                     // IC1 mapped on TI2
+    TIMER_BASE->CCER |= TIM_CCER_CC1P | TIM_CCER_CC1E;      // Capture falling edges
+    TIMER_BASE->DIER |= TIM_DIER_CC1DE;                     // DMA request on capture
+}
+
+void ppmCaptureStop(void){
+    TIMER_BASE->DIER &= ~TIM_DIER_CC1DE;
+    TIMER_BASE->CCER &= ~TIM_CCER_CC1E;
+    PPM_CAPTURE_DMA->CCR = 0;
+}
+
+/**
+ * @brief Get capture buffer write position
+ * */
+uint16_t ppmCaptureIndex(void){
+    return ppm_capture_len - PPM_CAPTURE_DMA->CNDTR;
+}
+#endif
+
 /**
  * @brief Basic tone generation on pin PA8 using TIM1_CH1
  * and DMA 
@@ -829,66 +1027,28 @@ void crcInit(void){
 }
 
 /**
- * @brief Start a software timer
- * 
- * @param time : Timer duration
- * @param flags : Extra flags for continuous mode, 0 for single time
- * @param cb : callback function when timer expires
+ * @brief meh close enougth
  * 
- * @return : Assigned timer index
- * */
-uint32_t startTimer(uint32_t time, uint32_t flags, void (*cb)(void)){
-
-    for(uint32_t i = 0; i < SWTIM_NUM; i++){
-        if((timers[i].status & SWTIM_RUNNING) == 0){
-            timers[i].time = time;
-            timers[i].count = 0;
-            timers[i].action = cb;
-            timers[i].status = flags | SWTIM_RUNNING;
-            return i;
-        }
-    }
-    return SWTIM_NUM;
-}
-
-/**
+ * @return : CRC'd number with timer
  * */
-void stopTimer(uint32_t tim){
-    timers[tim].status = 0;
+uint32_t xrand(void){
+    CRC->DR = TIMER_BASE->CNT;
+    return CRC->DR;
 }
 
 /**
- * @brief Check if timers have expired and execute correspondent action
- * 
+ * @brief CRC-32 of a word buffer using CRC unit,
+ * polynomial 0x04C11DB7 starting from 0xFFFFFFFF
+ *
+ * @param data : words to compute
+ * @param len : number of words
+ * @return : CRC
  * */
-void processTimers(void){
-static uint32_t last_tick = 0;
-uint32_t diff = ticks - last_tick;
-swtimer_t *tim = timers;
-    for(uint32_t i = 0; i < SWTIM_NUM; i++, tim++){
-        if(tim->status & SWTIM_RUNNING){
-            tim->count += diff;
-            if(tim->count >= tim->time){
-                tim->action();
-                if(tim->status & SWTIM_AUTO_RELOAD){
-                    tim->count = 0;
-                }else{
-                    tim->status &= ~(SWTIM_RUNNING);
-                }
-            }
-        }
+uint32_t crcCalc(const uint32_t *data, uint32_t len){
+    CRC->CR = 1;
+    while(len--){
+        CRC->DR = *data++;
     }
-
-    last_tick = ticks;
-}
-
-/**
- * @brief meh close enougth
- * 
- * @return : CRC'd number with timer
- * */
-uint32_t xrand(void){
-    CRC->DR = TIMER_BASE->CNT;
     return CRC->DR;
 }
 
@@ -901,30 +1061,49 @@ uint32_t xrand(void){
   * @retval None
   */
 void USB_LP_CAN1_RX0_IRQHandler(void){
+    PROF_START(start);
     HAL_PCD_IRQHandler(&hpcd_USB_FS);
+    PROF_END(PROF_USB, start);
 }
 
 void EXTI9_5_IRQHandler(void){
 uint32_t pr = EXTI->PR;
+    PROF_START(start);
     if((pr & EXTI_PR_PR5) != 0){        
         pinIntCB();
     }
     EXTI->PR = pr;
+    PROF_END(PROF_EXTI, start);
+}
+
+/**
+ * @brief Scheduler compare, only wakes the cpu from appIdle().
+ * The flag is polled by multiprotocol_loop, so it is not cleared here
+ * */
+void TIMER_BASE_IRQHandler(void){
+    PROF_START(start);
+    TIMER_BASE->DIER &= ~TIMER_BASE_CCIE;
+    PROF_END(PROF_TIMER_BASE, start);
 }
 
 #ifdef NO_SYS_TICK
 void TIM4_IRQHandler(void){
+    PROF_START(start);
     TIM4->SR = ~TIM4->SR;
     ticks++;
     //DBG_PIN_TOGGLE;
+    PROF_END(PROF_SYSTICK, start);
 }
 #else
 void SysTick_Handler(void){
+    PROF_START(start);
     ticks++;
+    PROF_END(PROF_SYSTICK, start);
 }
 #endif
 // ADC1 DMA request
 void DMA1_Channel1_IRQHandler(void){
+    PROF_START(start);
     //if(DMA1->ISR & DMA_ISR_TCIF1){
         DMA1_Channel1->CCR &= ~DMA_CCR_EN;
         hadc.battery_voltage = (float)(hadc.result[0] * hadc.resolution) / hadc.vdiv_racio;   
@@ -932,10 +1111,12 @@ void DMA1_Channel1_IRQHandler(void){
         hadc.status |= ADC_RDY;
     //}
     DMA1->IFCR |= DMA_IFCR_CGIF1;
+    PROF_END(PROF_DMA_ADC, start);
 }
 
 // TIM1 DMA request
 void DMA1_Channel5_IRQHandler(void){
+    PROF_START(start);
     if(DMA1->ISR & DMA_ISR_TCIF5){
         DMA1_Channel5->CCR &= ~DMA_CCR_EN;
         if(hbuz.ptone->t != 0){
@@ -953,9 +1134,11 @@ void DMA1_Channel5_IRQHandler(void){
         }
     }
     DMA1->IFCR |= DMA_IFCR_CGIF5;
+    PROF_END(PROF_DMA_BUZ, start);
 }
 // TIM4 DMA request
 void DMA1_Channel7_IRQHandler(void){
+    PROF_START(start);
     if(DMA1->ISR & DMA_ISR_TCIF7){
         DMA1_Channel7->CCR &= ~DMA_CCR_EN;
         // As two extra channels were send,
@@ -966,4 +1149,5 @@ void DMA1_Channel7_IRQHandler(void){
         //DBG_PIN_LOW;        
     }
     DMA1->IFCR |= DMA_IFCR_CGIF7;  // Clear DMA Flags TODO: ADD DMA Error handling ?
+    PROF_END(PROF_DMA_PPM, start);
 }
@@ -0,0 +1,310 @@
+/**
+ * ==============================================
+ * @file livepanel.cpp
+ * @brief Live screen, drawn on its own frame buffer
+ * ==============================================
+ * */
+
+#include <string.h>
+#include "app.h"
+#include "multiprotocol.h"
+#include "mpanel.h"
+#include "livepanel.h"
+#ifdef ENABLE_TELEMETRY
+#include "telemetry.h"
+#endif
+#ifdef ENABLE_RF_STATS
+#include "rf_stats.h"
+#endif
+
+#ifdef ENABLE_DISPLAY
+#define LIVE_NA                 INT32_MIN           // value not available
+#define LIVE_UNDRAWN            INT32_MAX           // forces a redraw
+
+/**
+ * One step per channel bar, then one per text field
+ * */
+enum live_field{
+    LIVE_ENC = 0,
+    LIVE_TX,
+    LIVE_RX,
+    LIVE_LQ,
+    LIVE_RSSI,
+    LIVE_CRC,
+    LIVE_FIELDS
+};
+
+#define LIVE_STEPS              (MAX_CHN_NUM + LIVE_FIELDS)
+
+typedef struct {
+    uint8_t x;
+    uint8_t y;
+    const char *fmt;
+    const char *na;                     // same width as fmt output
+}live_text_t;
+
+static const live_text_t live_text[LIVE_FIELDS] = {
+    {0,           0,               "ENC%5d",  "ENC   --"},
+    {LIVE_TEXT_X, 0,               "TX%7u",   "TX     --"},
+    {LIVE_TEXT_X, LIVE_LINE_H,     "RX%7u",   "RX     --"},
+    {LIVE_TEXT_X, LIVE_LINE_H * 2, "LQ%7u",   "LQ     --"},
+    {LIVE_TEXT_X, LIVE_LINE_H * 3, "RSSI%4d", "RSSI  --"},
+    {LIVE_TEXT_X, LIVE_LINE_H * 4, "CRC%6u",  "CRC    --"},
+};
+
+static struct {
+    uint8_t  step;                      // next step, frames start where last one stopped
+    uint8_t  done;                      // steps run on current frame
+    uint8_t  busy;                      // frame started
+    uint8_t  changed;                   // something drawn on current frame
+    uint32_t frame_start;               // ms
+    uint32_t frame_us;                  // drawing time on current frame
+    uint32_t step_us;                   // longest step over last window, gates steps
+    uint32_t step_peak_us;              // longest step on current window
+    uint8_t  window_frames;
+    uint8_t  bar[MAX_CHN_NUM];          // drawn bar heights
+    int32_t  value[LIVE_FIELDS];        // drawn text values
+#ifdef ENABLE_RF_STATS
+    uint32_t lq_start;                  // ms
+    uint32_t lq_slots;                  // counters at window start
+    uint32_t lq_packets;
+    int32_t  lq;
+#endif
+}live;
+
+static live_stats_t live_stats;
+
+/**
+ * @brief Received share of telemetry slots on last LIVE_LQ_WINDOW
+ * */
+static int32_t LIVE_linkQuality(void){
+#ifdef ENABLE_RF_STATS
+    rf_stats_t *st = rf_getStats();
+    uint32_t now = getTick();
+
+    if(st->rx_slots < live.lq_slots){
+        // counters cleared by protocol start
+        live.lq_start = now;
+        live.lq_slots = st->rx_slots;
+        live.lq_packets = st->rx_packets;
+        live.lq = LIVE_NA;
+    }else if(now - live.lq_start >= LIVE_LQ_WINDOW){
+        uint32_t slots = st->rx_slots - live.lq_slots;
+        live.lq = slots ? (int32_t)((st->rx_packets - live.lq_packets) * 100 / slots) : LIVE_NA;
+        live.lq_start = now;
+        live.lq_slots = st->rx_slots;
+        live.lq_packets = st->rx_packets;
+    }
+    return live.lq;
+#else
+    return LIVE_NA;
+#endif
+}
+
+static int32_t LIVE_fieldValue(uint8_t field){
+    switch(field){
+        case LIVE_ENC:
+            return (int16_t)radio.enc_count;
+#ifdef ENABLE_RF_STATS
+        case LIVE_TX:
+            return rf_getStats()->tx_packets;
+        case LIVE_RX:
+            return rf_getStats()->rx_packets;
+        case LIVE_CRC:
+            return rf_getStats()->rx_bad_crc;
+#endif
+        case LIVE_LQ:
+            return LIVE_linkQuality();
+#ifdef ENABLE_TELEMETRY
+        case LIVE_RSSI:{
+            telemetry_t *tlm = telemetry_getData();
+            return tlm->link ? tlm->tx_rssi : LIVE_NA;
+        }
+#endif
+        default:
+            break;
+    }
+    return LIVE_NA;
+}
+
+/**
+ * @brief Grow or shrink channel bar, only the difference is drawn
+ * */
+static uint8_t LIVE_drawBar(uint8_t ch){
+    uint32_t val = radio.channel_data[ch];
+    uint8_t h, old = live.bar[ch];
+    uint16_t x = ch * LIVE_BAR_PITCH;
+
+    if(val > CHANNEL_MAX_125){
+        val = CHANNEL_MAX_125;
+    }
+    // one row is always on, so channels at minimum are still seen
+    h = 1 + ((val * (LIVE_BAR_H - 1)) >> 11);
+
+    if(h == old){
+        return 0;
+    }
+
+    if(h > old){
+        MPANEL_fillRect(x, MPANEL_H - h, LIVE_BAR_W, h - old, WHITE);
+    }else{
+        MPANEL_fillRect(x, MPANEL_H - old, LIVE_BAR_W, old - h, BLACK);
+    }
+    live.bar[ch] = h;
+    return 1;
+}
+
+static uint8_t LIVE_drawText(uint8_t field){
+    const live_text_t *t = &live_text[field];
+    int32_t val = LIVE_fieldValue(field);
+
+    if(val == live.value[field]){
+        return 0;
+    }
+
+    if(val == LIVE_NA){
+        MPANEL_print(t->x, t->y, &pixelDustFont, t->na);
+    }else{
+        MPANEL_print(t->x, t->y, &pixelDustFont, t->fmt, val);
+    }
+    live.value[field] = val;
+    return 1;
+}
+
+/**
+ * @brief Clear live screen and draw everything on next frame
+ * */
+void LIVE_start(void){
+    MPANEL_setTarget(MPANEL_SCREEN_LIVE);
+    MPANEL_fillRect(0, 0, MPANEL_W, MPANEL_H, BLACK);
+    MPANEL_setTarget(MPANEL_SCREEN_MAIN);
+
+    memset(live.bar, 0, sizeof(live.bar));
+    for(uint8_t i = 0; i < LIVE_FIELDS; i++){
+        live.value[i] = LIVE_UNDRAWN;
+    }
+#ifdef ENABLE_RF_STATS
+    live.lq_start = getTick();
+    live.lq_slots = rf_getStats()->rx_slots;
+    live.lq_packets = rf_getStats()->rx_packets;
+    live.lq = LIVE_NA;
+#endif
+    live.step = 0;
+    live.busy = 0;
+    live.step_us = 0;
+    live.step_peak_us = 0;
+    live.window_frames = 0;
+    live.frame_start = getTick() - LIVE_FRAME_TIME;
+    memset(&live_stats, 0, sizeof(live_stats));
+}
+
+void LIVE_stop(void){
+    live.busy = 0;
+}
+
+/**
+ * @brief Close current frame, complete or cut by its budget
+ * */
+static void LIVE_endFrame(uint8_t cut){
+    if(cut){
+        live_stats.overruns++;
+    }else{
+        live_stats.frames++;
+        if(getTick() - live.frame_start > LIVE_FRAME_TIME){
+            live_stats.late++;
+        }
+    }
+
+    live_stats.last_us = live.frame_us;
+    if(live.frame_us > live_stats.max_us){
+        live_stats.max_us = live.frame_us;
+    }
+
+    if(++live.window_frames == LIVE_STEP_WINDOW){
+        // steps that got faster are no longer held by an old peak
+        live.step_us = live.step_peak_us;
+        live.step_peak_us = 0;
+        live.window_frames = 0;
+    }
+
+    if(live.changed){
+        SET_LCD_UPDATE;
+    }
+    live.busy = 0;
+}
+
+/**
+ * @brief Run live screen steps, called on idle windows.
+ * A new frame starts every LIVE_FRAME_TIME, a step only runs if the
+ * window still fits the longest step of the last LIVE_STEP_WINDOW frames. Steps that do not fit the
+ * frame budget are left for next frame.
+ *
+ * @param budget_us : time that can be spent drawing on this call
+ * */
+void LIVE_process(uint32_t budget_us){
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+    if(MPANEL_getShown() != MPANEL_SCREEN_LIVE){
+        return;
+    }
+
+    if(!live.busy){
+        if(getTick() - live.frame_start < LIVE_FRAME_TIME){
+            return;
+        }
+        live.frame_start = getTick();
+        live.frame_us = 0;
+        live.done = 0;
+        live.changed = 0;
+        live.busy = 1;
+    }
+
+    MPANEL_setTarget(MPANEL_SCREEN_LIVE);
+
+    while(live.done < LIVE_STEPS){
+        uint32_t start, elapsed;
+
+        if(live.frame_us >= LIVE_FRAME_BUDGET_US){
+            LIVE_endFrame(1);
+            break;
+        }
+
+        if(budget_us < live.step_us){
+            live_stats.waits++;
+            break;
+        }
+
+        start = getCycleCount();
+        if(live.step < MAX_CHN_NUM){
+            live.changed |= LIVE_drawBar(live.step);
+        }else{
+            live.changed |= LIVE_drawText(live.step - MAX_CHN_NUM);
+        }
+        elapsed = (getCycleCount() - start) / cycles_per_us;
+
+        live_stats.steps++;
+        if(elapsed > live_stats.max_step_us){
+            live_stats.max_step_us = elapsed;
+        }
+        if(elapsed > live.step_peak_us){
+            live.step_peak_us = elapsed;
+        }
+        if(elapsed > live.step_us){
+            live.step_us = elapsed;
+        }
+        live.frame_us += elapsed;
+        budget_us -= (elapsed < budget_us) ? elapsed : budget_us;
+
+        live.step = (live.step + 1 < LIVE_STEPS) ? live.step + 1 : 0;
+        if(++live.done == LIVE_STEPS){
+            LIVE_endFrame(0);
+        }
+    }
+
+    MPANEL_setTarget(MPANEL_SCREEN_MAIN);
+}
+
+live_stats_t *LIVE_getStats(void){
+    return &live_stats;
+}
+#endif /* ENABLE_DISPLAY */
@@ -0,0 +1,54 @@
+#ifndef _livepanel_h_
+#define _livepanel_h_
+
+#include <stdint.h>
+
+/**
+ * Live screen, channel bars, encoder count, RF counters and link quality.
+ *
+ * A frame redraws each item whose value changed, one item per step, at
+ * most once every LIVE_FRAME_TIME. Steps only run while the caller
+ * window has room for the longest step seen over the last
+ * LIVE_STEP_WINDOW frames, so drawing never delays a protocol callback
+ * and one slow step does not hold drawing for good. A frame stops once
+ * it has taken LIVE_FRAME_BUDGET_US. Items left out go first on the
+ * next frame.
+ * */
+#define LIVE_FRAME_TIME         50                  // ms, 20 frames per second at most
+#define LIVE_FRAME_BUDGET_US    1000                // drawing time allowed per frame
+#define LIVE_LQ_WINDOW          1000                // ms, link quality window
+#define LIVE_STEP_WINDOW        20                  // frames the longest step is kept for
+#define LIVE_NO_LIMIT           0xFFFFFFFFUL
+
+#define LIVE_BAR_W              4
+#define LIVE_BAR_PITCH          5
+#define LIVE_BAR_TOP            8                   // bars grow up from the bottom row
+#define LIVE_BAR_H              (MPANEL_H - LIVE_BAR_TOP)
+#define LIVE_TEXT_X             82
+#define LIVE_LINE_H             6
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct live_stats{
+    uint32_t frames;                    // completed frames
+    uint32_t overruns;                  // frames cut by budget
+    uint32_t late;                      // frames done after their period
+    uint32_t steps;
+    uint32_t waits;                     // steps held for a longer window
+    uint32_t last_us;                   // drawing time of last frame
+    uint32_t max_us;
+    uint32_t max_step_us;               // since screen was shown
+}live_stats_t;
+
+void LIVE_start(void);
+void LIVE_stop(void);
+void LIVE_process(uint32_t budget_us);
+live_stats_t *LIVE_getStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _livepanel_h_ */
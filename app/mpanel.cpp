@@ -9,10 +9,12 @@
 #include <font.h>
 #include "mpanel.h"
 #include <stdarg.h>
+#include <string.h>
 #include <strfunc.h>
 
 #ifdef ENABLE_DISPLAY
-const uint8_t font_seven_seg_data[] = {
+/* 12x20 rows, '0' to '9' and a blank */
+static constexpr uint8_t font_seven_seg_rows[] = {
 0x7f,0xe0,0xff,0xf0,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xff,0xf0,0x7f,0xe0,
 0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,
 0xff,0xe0,0xff,0xf0,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0xff,0xf0,0xff,0xf0,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xff,0xf0,0x7f,0xf0,
@@ -26,101 +28,451 @@ const uint8_t font_seven_seg_data[] = {
 0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
 };
 
-font_t font_seven_seg = {
+static constexpr auto font_seven_seg_cols = MPANEL_toColumns<12, 20, 11, 0>(font_seven_seg_rows);
+
+const mpanel_font_t font_seven_seg = {
     .w = 12,
     .h = 20,
-    .data = font_seven_seg_data,
-    .data_len = sizeof(font_seven_seg_data),
-    .bpl = 2,
     .offset = '0',
-    .spacing = 1
+    .count = 11,
+    .spacing = 1,
+    .data = font_seven_seg_cols.data
 };
 
-static uint16_t seven_seg_dp(uint16_t x, uint16_t y){
-    LCD_FillRect(x-1, y, 4, 20, BLACK);
-    LCD_FillRect(x, y + 20 - 2, 2, 2, WHITE);
-    return x + 3; 
+/**
+ * Frame buffer in display memory layout, one byte holds 8 rows of a
+ * column. Each page keeps the column range changed since it was last
+ * sent, only those columns go over I2C. Every page has its own transfer
+ * block, so all changed pages are queued at once and sent by DMA.
+ * Each screen has its own frame buffer, drawing on a screen not shown
+ * only changes its buffer and showing it sends the whole buffer.
+ * */
+typedef struct {
+    uint8_t x0;
+    uint8_t x1;                         // last column, empty when x0 > x1
+}lcd_range_t;
+
+static uint8_t lcd_fb[MPANEL_SCREENS][MPANEL_PAGES][MPANEL_W];
+static uint8_t lcd_target;              // screen drawn on
+static uint8_t lcd_shown;               // screen sent to display
+static uint8_t lcd_pkt[MPANEL_PAGES][MPANEL_CMD_SIZE + MPANEL_W];
+static i2c_block_t lcd_blk[MPANEL_PAGES];
+static lcd_range_t lcd_dirty[MPANEL_PAGES];
+static lcd_range_t lcd_queued[MPANEL_PAGES];    // range held by page block
+static uint32_t lcd_retry_at;           // tick failed pages are sent again
+static mpanel_stats_t mpanel_stats;
+
+static inline void MPANEL_rangeAdd(lcd_range_t *range, uint8_t x0, uint8_t x1){
+    if(x0 < range->x0){
+        range->x0 = x0;
+    }
+    if(x1 > range->x1){
+        range->x1 = x1;
+    }
+}
+
+static inline void MPANEL_rangeClear(lcd_range_t *range){
+    range->x0 = MPANEL_W;
+    range->x1 = 0;
 }
 
 /**
- * data format: w,h,data...
- * 
- */
-void MPANEL_drawIcon(uint16_t x, uint16_t y, idata_t *data){
-    uint8_t *p = data->data;
-
-    for(uint8_t h = y; h < y + data->hight; h++, p++){
-        uint8_t line = *p;
-        uint8_t mask = (data->width-1) % 8;
-        mask = (1 << mask);
-        for(uint8_t w = x; w < x + data->width; w++, mask >>= 1){
-            if(mask == 0){
-                mask = 0x80;
-                line = *(++p);
+ * @brief Merge column bytes into one page, shifted down (shift > 0) or
+ * up (shift < 0). Only rows set on mask are changed and the page range
+ * grows only over bytes that actually change
+ * */
+static void MPANEL_blitPage(uint8_t page, uint8_t x, const uint8_t *cols, uint8_t n, uint8_t mask, int8_t shift){
+    uint8_t *dst = &lcd_fb[lcd_target][page][x];
+    uint8_t m = (shift >= 0) ? mask << shift : mask >> -shift;
+    uint8_t first = MPANEL_W, last = 0;
+
+    if(m == 0){
+        return;
+    }
+
+    for(uint8_t i = 0; i < n; i++){
+        uint8_t v = (shift >= 0) ? cols[i] << shift : cols[i] >> -shift;
+
+        v = (dst[i] & ~m) | (v & m);
+        if(v != dst[i]){
+            dst[i] = v;
+            if(first == MPANEL_W){
+                first = i;
+            }
+            last = i;
+        }
+    }
+
+    if(first != MPANEL_W && lcd_target == lcd_shown){
+        MPANEL_rangeAdd(&lcd_dirty[page], x + first, x + last);
+    }
+}
+
+/**
+ * @brief Write column bytes at any row, bit 0 of each byte goes to row y.
+ * A byte not aligned to a page is split over two pages
+ *
+ * @param cols : column bytes, 8 rows each
+ * @param n : number of columns
+ * @param mask : rows to write, unset rows are left as they are
+ * */
+static void MPANEL_blit(uint16_t x, uint16_t y, const uint8_t *cols, uint8_t n, uint8_t mask){
+    uint8_t page = y >> 3;
+    uint8_t shift = y & 7;
+
+    if(x >= MPANEL_W || y >= MPANEL_H){
+        return;
+    }
+
+    if(x + n > MPANEL_W){
+        n = MPANEL_W - x;
+    }
+
+    MPANEL_blitPage(page, x, cols, n, mask, shift);
+
+    if(shift && page + 1 < MPANEL_PAGES){
+        MPANEL_blitPage(page + 1, x, cols, n, mask, shift - 8);
+    }
+}
+
+/**
+ * @brief Transpose 8x8 bit block, from row bytes with msb on the left to
+ * column bytes with top row on bit 0. Hacker's Delight, transpose8
+ * */
+static void MPANEL_transpose8(const uint8_t *rows, uint8_t *cols){
+    uint32_t x, y, t;
+
+    // Last row first, so it ends on msb of each column
+    x = (rows[7] << 24) | (rows[6] << 16) | (rows[5] << 8) | rows[4];
+    y = (rows[3] << 24) | (rows[2] << 16) | (rows[1] << 8) | rows[0];
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA;  x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;  y = y ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC; x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC; y = y ^ t ^ (t << 14);
+
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = t;
+
+    cols[0] = x >> 24; cols[1] = x >> 16; cols[2] = x >> 8; cols[3] = x;
+    cols[4] = y >> 24; cols[5] = y >> 16; cols[6] = y >> 8; cols[7] = y;
+}
+
+/**
+ * @brief Draw bitmap already in page columns, one blit per page
+ * */
+static void MPANEL_drawColumns(uint16_t x, uint16_t y, uint8_t w, uint8_t h, const uint8_t *cols){
+    for(uint8_t row = 0; row < h; row += 8, cols += w){
+        uint8_t mask = (h - row < 8) ? 0xFF >> (8 - (h - row)) : 0xFF;
+        MPANEL_blit(x, y + row, cols, w, mask);
+    }
+}
+
+/**
+ * @brief Draw 1bpp bitmap stored by rows, msb is the leftmost pixel.
+ * Each band of 8 rows is turned into column bytes 8 columns at a time
+ * and blitted, instead of going pixel by pixel
+ *
+ * @param stride : bytes per row
+ * @param skip : unused leading bits on each row
+ * */
+static void MPANEL_drawRows(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *src, uint8_t stride, uint8_t skip){
+    uint8_t rows[8], cols[8];
+
+    for(uint16_t band = 0; band < h; band += 8){
+        uint8_t nrows = (h - band < 8) ? h - band : 8;
+        uint8_t mask = 0xFF >> (8 - nrows);
+        const uint8_t *line = src + band * stride;
+
+        for(uint16_t col = 0; col < w; col += 8){
+            uint8_t idx = (skip + col) >> 3;
+            uint8_t sh = (skip + col) & 7;
+
+            for(uint8_t i = 0; i < 8; i++){
+                uint16_t v = 0;
+                if(i < nrows){
+                    v = line[i * stride + idx] << 8;
+                    if(idx + 1 < stride){
+                        v |= line[i * stride + idx + 1];
+                    }
+                }
+                rows[i] = (v << sh) >> 8;
             }
-            if(line & mask)
-                LCD_Pixel(w, h, WHITE);
-            else
-                LCD_Pixel(w, h, BLACK);
-            
+
+            MPANEL_transpose8(rows, cols);
+            MPANEL_blit(x + col, y + band, cols, (w - col < 8) ? w - col : 8, mask);
+        }
+    }
+}
+
+/**
+ * @brief Clear frame buffer and mark whole display dirty. Display is set
+ * to horizontal addressing, so each page write only needs its window
+ * */
+void MPANEL_init(void){
+    uint8_t cmd[] = {0x00, 0x20, 0x00};
+
+    I2C_Write(MPANEL_I2C_ADDRESS, cmd, sizeof(cmd));
+    memset(lcd_fb, 0, sizeof(lcd_fb));
+    lcd_target = MPANEL_SCREEN_MAIN;
+    lcd_shown = MPANEL_SCREEN_MAIN;
+
+    for(uint8_t i = 0; i < MPANEL_PAGES; i++){
+        lcd_dirty[i].x0 = 0;
+        lcd_dirty[i].x1 = MPANEL_W - 1;
+        MPANEL_rangeClear(&lcd_queued[i]);
+    }
+}
+
+/**
+ * @brief Select screen drawing functions write to
+ * */
+void MPANEL_setTarget(uint8_t screen){
+    if(screen < MPANEL_SCREENS){
+        lcd_target = screen;
+    }
+}
+
+/**
+ * @brief Send screen to display, whole display is marked dirty and
+ * goes on next requestLcdUpdate()
+ * */
+void MPANEL_show(uint8_t screen){
+    if(screen >= MPANEL_SCREENS || screen == lcd_shown){
+        return;
+    }
+
+    lcd_shown = screen;
+
+    for(uint8_t i = 0; i < MPANEL_PAGES; i++){
+        lcd_dirty[i].x0 = 0;
+        lcd_dirty[i].x1 = MPANEL_W - 1;
+    }
+}
+
+uint8_t MPANEL_getShown(void){
+    return lcd_shown;
+}
+
+void MPANEL_fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color){
+    uint8_t cols[8];
+
+    memset(cols, (color != BLACK) ? 0xFF : 0x00, sizeof(cols));
+
+    for(uint16_t band = 0; band < h; band += 8){
+        uint8_t mask = (h - band < 8) ? 0xFF >> (8 - (h - band)) : 0xFF;
+        for(uint16_t col = 0; col < w; col += 8){
+            MPANEL_blit(x + col, y + band, cols, (w - col < 8) ? w - col : 8, mask);
         }
     }
 }
 
+/**
+ * @brief Build page transfer, the address window and data go on the
+ * same transfer, commands are sent with continuation bit set (0x80)
+ * and the data control byte (0x40) ends them.
+ * */
+static uint16_t MPANEL_buildPage(uint8_t page, uint8_t x0, uint8_t x1){
+    uint8_t *p = lcd_pkt[page];
+
+    *p++ = 0x80; *p++ = 0x21;           // column window
+    *p++ = 0x80; *p++ = x0;
+    *p++ = 0x80; *p++ = x1;
+    *p++ = 0x80; *p++ = 0x22;           // page window
+    *p++ = 0x80; *p++ = page;
+    *p++ = 0x80; *p++ = page;
+    *p++ = 0x40;                        // data follows
+    memcpy(p, &lcd_fb[lcd_shown][page][x0], x1 - x0 + 1);
+
+    return MPANEL_CMD_SIZE + x1 - x0 + 1;
+}
+
+/**
+ * @brief Queue all changed page ranges for transfer.
+ *
+ * A page still waiting on the queue is taken back and merged with its
+ * new changes, so the display gets one write with the latest data. A
+ * page being sent keeps its changes for the next call. Pages that could
+ * not be queued or failed after retries are marked dirty again, nothing
+ * drawn is lost. After a failure nothing is queued for MPANEL_RETRY_TIME,
+ * so a missing display does not keep the bus and cpu busy.
+ *
+ * @return : 1 when display is up to date, 0 while transfers are pending
+ * */
+uint8_t requestLcdUpdate(void){
+    uint8_t pending = 0;
+
+    for(uint8_t page = 0; page < MPANEL_PAGES; page++){
+        i2c_block_t *blk = &lcd_blk[page];
+        lcd_range_t *dirty = &lcd_dirty[page];
+        lcd_range_t *queued = &lcd_queued[page];
+
+        if(blk->state == I2C_BLOCK_FAILED){
+            MPANEL_rangeAdd(dirty, queued->x0, queued->x1);
+            MPANEL_rangeClear(queued);
+            blk->state = I2C_BLOCK_IDLE;
+            lcd_retry_at = getTick() + MPANEL_RETRY_TIME;
+            mpanel_stats.failed++;
+        }
+
+        if(dirty->x0 > dirty->x1){
+            continue;
+        }
+
+        if((int32_t)(getTick() - lcd_retry_at) < 0){
+            pending = 1;
+            continue;
+        }
+
+        cli();
+        if(blk->state == I2C_BLOCK_ACTIVE){
+            sei();
+            pending = 1;
+            continue;
+        }
+        if(blk->state == I2C_BLOCK_QUEUED){
+            // Not started yet, its queue entry is skipped
+            blk->state = I2C_BLOCK_IDLE;
+            sei();
+            MPANEL_rangeAdd(dirty, queued->x0, queued->x1);
+            mpanel_stats.coalesced++;
+            mpanel_stats.writes--;
+            mpanel_stats.bytes -= blk->size;
+            mpanel_stats.last_bytes -= blk->size;
+        }else{
+            sei();
+        }
+
+        blk->address = MPANEL_I2C_ADDRESS;
+        blk->data = lcd_pkt[page];
+        blk->size = MPANEL_buildPage(page, dirty->x0, dirty->x1);
+
+        if(!I2C_Queue(blk)){
+            // Queue full, try on next call
+            MPANEL_rangeClear(queued);
+            pending = 1;
+            continue;
+        }
+
+        *queued = *dirty;
+        MPANEL_rangeClear(dirty);
+        mpanel_stats.writes++;
+        mpanel_stats.bytes += blk->size;
+        mpanel_stats.last_bytes += blk->size;
+    }
+
+    if(pending || I2C_IsBusy()){
+        return 0;
+    }
+
+    for(uint8_t page = 0; page < MPANEL_PAGES; page++){
+        if(lcd_blk[page].state == I2C_BLOCK_FAILED){
+            return 0;
+        }
+    }
+
+    // All sent, close this update
+    if(mpanel_stats.last_bytes){
+        mpanel_stats.updates++;
+        if(mpanel_stats.last_bytes > mpanel_stats.max_bytes){
+            mpanel_stats.max_bytes = mpanel_stats.last_bytes;
+        }
+        mpanel_stats.last_bytes = 0;
+    }
+    return 1;
+}
+
+mpanel_stats_t *MPANEL_getStats(void){
+    return &mpanel_stats;
+}
+
+static uint16_t seven_seg_dp(uint16_t x, uint16_t y){
+    MPANEL_fillRect(x-1, y, 4, 20, BLACK);
+    MPANEL_fillRect(x, y + 20 - 2, 2, 2, WHITE);
+    return x + 3; 
+}
+
+void MPANEL_drawIcon(uint16_t x, uint16_t y, const idata_t *data){
+    MPANEL_drawColumns(x, y, data->width, data->hight, data->data);
+}
+
 /**
  * @brief draws a character using a font table.
  * the font table must be 1bpp
  */
-static uint8_t MPANEL_drawChar(uint16_t x, uint16_t y, uint8_t c, font_t *font){
+static uint16_t MPANEL_drawChar(uint16_t x, uint16_t y, uint8_t c, font_t *font){
     const uint8_t *p;
 
+    c -= font->offset;
+    p = font->data + (c * font->h * font->bpl);
+
+    if(p + font->h * font->bpl > font->data + font->data_len)
+        return x;
+
+    MPANEL_drawRows(x, y, font->w, font->h, p, font->bpl, 0);
+    return x + font->w + font->spacing;
+}
+
+/**
+ * @brief draws a character from a font in page columns
+ */
+static uint16_t MPANEL_drawChar(uint16_t x, uint16_t y, uint8_t c, const mpanel_font_t *font){
     if(c == '.' && font == &font_seven_seg){
         return seven_seg_dp(x,y);
     }
-    
+
     c -= font->offset;
-    p = font->data + (c * font->h * font->bpl);
 
-    if(p > font->data + font->data_len)
+    if(c >= font->count)
         return x;
 
-    for(uint16_t h = y; h < y +font->h; h++, p++){
-        uint8_t line = *p;
-        for(uint16_t w = x, bc = 0; w < x + font->w; w++, bc++){
-            if(bc == 8){
-                bc = 0;
-                line = *(++p);
-            }
-            if(line & (0x80>>bc))
-                LCD_Pixel(w, h,WHITE);
-            else
-                LCD_Pixel(w, h,BLACK);
-        }
-    }
+    MPANEL_drawColumns(x, y, font->w, font->h, font->data + c * ((font->h + 7) / 8) * font->w);
     return x + font->w + font->spacing;
 }
 
-void MPANEL_print(uint16_t x, uint16_t y, font_t *font, const char *fmt, ...){
+template<typename F>
+static void MPANEL_vprint(uint16_t x, uint16_t y, F *font, const char *fmt, va_list arp){
     char buf[PANEL_MAX_LEN];
     uint8_t i = 0;
-	va_list arp;
-	va_start(arp, fmt);
-	strformater(buf, fmt, arp);
-	va_end(arp);
+
+    strformater(buf, fmt, arp);
 
     while(buf[i] != '\0'){
         x = MPANEL_drawChar(x, y, buf[i++], font);
     }
 }
 
+void MPANEL_print(uint16_t x, uint16_t y, font_t *font, const char *fmt, ...){
+	va_list arp;
+	va_start(arp, fmt);
+	MPANEL_vprint(x, y, font, fmt, arp);
+	va_end(arp);
+}
+
+void MPANEL_print(uint16_t x, uint16_t y, const mpanel_font_t *font, const char *fmt, ...){
+	va_list arp;
+	va_start(arp, fmt);
+	MPANEL_vprint(x, y, font, fmt, arp);
+	va_end(arp);
+}
+
 void MpanelDro::update(float value){
     this->value = value;
-    MPANEL_print(this->posx, this->posy, this->font, this->fmt, value);
+    if(this->cfont != NULL){
+        MPANEL_print(this->posx, this->posy, this->cfont, this->fmt, value);
+    }else{
+        MPANEL_print(this->posx, this->posy, this->font, this->fmt, value);
+    }
 }
 
 void MpanelDro::update(uint32_t value){
     this->value = value;
-    MPANEL_print(this->posx, this->posy, this->font, this->fmt, value);
+    if(this->cfont != NULL){
+        MPANEL_print(this->posx, this->posy, this->cfont, this->fmt, value);
+    }else{
+        MPANEL_print(this->posx, this->posy, this->font, this->fmt, value);
+    }
 }
 
 void MpanelDro::draw(void){
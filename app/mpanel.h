@@ -2,25 +2,117 @@
 #define _mpanel_h_
 
 #include <stdint.h>
+#include <stddef.h>
 #include <font.h>
 
 #define PANEL_MAX_LEN   (128/8)
 
+#define MPANEL_W                128
+#define MPANEL_H                32
+#define MPANEL_PAGES            (MPANEL_H / 8)      // SSD1306 pages, 8 rows each
+#define MPANEL_I2C_ADDRESS      0x3C
+#define MPANEL_CMD_SIZE         13                  // address window and data control byte
+#define MPANEL_RETRY_TIME       100                 // ms, hold after a failed page write
+#define MPANEL_SCREENS          2                   // frame buffers
+
+enum mpanel_screen{
+    MPANEL_SCREEN_MAIN = 0,                         // battery and status icons
+    MPANEL_SCREEN_LIVE,                             // channels and link, see livepanel.h
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mpanel_stats{
+    uint32_t updates;                   // dirty frames sent
+    uint32_t writes;                    // page transfers
+    uint32_t bytes;                     // sent over I2C, commands included
+    uint32_t coalesced;                 // queued pages merged with new changes
+    uint32_t failed;                    // page writes given up by I2C, sent again
+    uint16_t max_bytes;                 // largest update
+    uint16_t last_bytes;
+}mpanel_stats_t;
+
+mpanel_stats_t *MPANEL_getStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 typedef struct mpanleitemdata{
     uint8_t width;
     uint8_t hight;
-    uint8_t data[];
+    const uint8_t *data;                // page columns, see MPANEL_BITMAP
 }idata_t;
 
 typedef struct mpanelicon{
     uint16_t posx;
     uint16_t posy;
-    struct mpanleitemdata *data;
+    const struct mpanleitemdata *data;
 }mpanelicon_t;
 
+typedef struct mpanelfont{
+    uint8_t w;
+    uint8_t h;
+    uint8_t offset;                     // first character
+    uint8_t count;                      // characters on data
+    uint8_t spacing;
+    const uint8_t *data;                // page columns, (h + 7) / 8 * w bytes per character
+}mpanel_font_t;
+
+#ifdef __cplusplus
+
+/**
+ * Bitmaps converted at compile time to display memory layout, so they
+ * are drawn without decoding. Sources are rows with msb on the left
+ * and skip unused bits at the start of each row, as exported by bitmap
+ * and font tools. Result has, for each 8 row page, one byte per column
+ * with the top row on bit 0. N bitmaps of the same size, as font
+ * characters, are stored one after the other.
+ * */
+template<uint8_t W, uint8_t H, uint8_t N = 1>
+struct mpanel_columns{
+    static constexpr uint8_t pages = (H + 7) / 8;
+    uint8_t data[N * pages * W];
+};
+
+template<uint8_t W, uint8_t H, uint8_t N, uint8_t SKIP, size_t S>
+constexpr mpanel_columns<W, H, N> MPANEL_toColumns(const uint8_t (&rows)[S]){
+    constexpr uint8_t stride = (SKIP + W + 7) / 8;
+    constexpr uint8_t pages = mpanel_columns<W, H, N>::pages;
+    mpanel_columns<W, H, N> out{};
+
+    static_assert(S == N * H * stride, "bitmap size does not match width and height");
+
+    for(uint16_t n = 0; n < N; n++){
+        for(uint8_t page = 0; page < pages; page++){
+            for(uint8_t x = 0; x < W; x++){
+                uint8_t col = 0;
+                for(uint8_t b = 0; b < 8 && page * 8 + b < H; b++){
+                    uint16_t row = n * H + page * 8 + b;
+                    if(rows[row * stride + (SKIP + x) / 8] & (0x80 >> ((SKIP + x) & 7))){
+                        col |= 1 << b;
+                    }
+                }
+                out.data[(n * pages + page) * W + x] = col;
+            }
+        }
+    }
+    return out;
+}
+
+/**
+ * Icon from rows right aligned, unused bits on the first byte
+ * */
+#define MPANEL_BITMAP(_NAME, _W, _H, ...) \
+    static constexpr uint8_t _NAME##_rows[] = {__VA_ARGS__}; \
+    static constexpr auto _NAME##_cols = MPANEL_toColumns<_W, _H, 1, ((_W) + 7) / 8 * 8 - (_W)>(_NAME##_rows); \
+    static const idata_t _NAME = {_W, _H, _NAME##_cols.data}
+
 class MpanelItem{
 protected:
-    idata_t *idata;
+    const idata_t *idata;
     uint16_t posx;
     uint16_t posy;
 public:
@@ -29,6 +121,7 @@ public:
 
 class MpanelDro : MpanelItem{
     font_t *font;
+    const mpanel_font_t *cfont;         // used instead of font when set
     float value;
     mpanelicon_t *icon;
     const char *fmt;
@@ -41,15 +134,32 @@ public:
         this->posx = posx;
         this->posy = posy;
         this->font = font;
+        this->cfont = NULL;
         this->value = 0.0f;
         this->fmt = fmt;
         this->icon = NULL;
     }    
+    MpanelDro(uint16_t posx, uint16_t posy, const char *fmt, const mpanel_font_t *font){
+        this->posx = posx;
+        this->posy = posy;
+        this->font = NULL;
+        this->cfont = font;
+        this->value = 0.0f;
+        this->fmt = fmt;
+        this->icon = NULL;
+    }
 };
 
-extern font_t font_seven_seg;
+extern const mpanel_font_t font_seven_seg;
 
-void MPANEL_drawIcon(uint16_t x, uint16_t y, idata_t *data);
+void MPANEL_init(void);
+void MPANEL_setTarget(uint8_t screen);
+void MPANEL_show(uint8_t screen);
+uint8_t MPANEL_getShown(void);
+void MPANEL_drawIcon(uint16_t x, uint16_t y, const idata_t *data);
+void MPANEL_fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
 void MPANEL_print(uint16_t x, uint16_t y, font_t *font, const char *fmt, ...);
+void MPANEL_print(uint16_t x, uint16_t y, const mpanel_font_t *font, const char *fmt, ...);
+#endif
 
 #endif /* _mpanel_h_ */
\ No newline at end of file
@@ -0,0 +1,499 @@
+#include <string.h>
+#include "board.h"
+#include "nvjournal.h"
+
+#define NVJ_RECORDS_START       sizeof(nvj_header_t)
+#define NVJ_WORDS(_T)           ((sizeof(_T) - sizeof(uint32_t)) / 4)
+#define NVJ_BIT(_K)             ((uint64_t)1 << (_K))
+
+_Static_assert(NVJ_SIZE % NVJ_CHUNK == 0, "eeprom size must be multiple of chunk");
+_Static_assert(NVJ_RECORDS_START + NVJ_CHUNKS * sizeof(nvj_record_t) <= NVJ_PAGE_SIZE, "compacted journal does not fit on page");
+_Static_assert(NVJ_CHUNKS <= 64, "dirty mask too small");
+
+enum nvj_state{
+    NVJ_STATE_IDLE = 0,
+    NVJ_STATE_APPEND,                   // changed chunks to active page
+    NVJ_STATE_ERASE,                    // compaction waits for spare page erase
+    NVJ_STATE_COMPACT,                  // all chunks to spare page
+    NVJ_STATE_HEADER                    // spare page header, ends compaction
+};
+
+typedef struct nvjournal{
+    uint8_t  image[NVJ_SIZE];           // written by nvj_write
+    uint8_t  snap[NVJ_SIZE];            // content of the commit in progress
+    uint64_t dirty;                     // chunks changed since last commit started
+    uint64_t commit;                    // chunks of the commit in progress
+    uint64_t left;                      // chunks still to append
+    uint16_t free;                      // first free record offset on active page
+    uint8_t  *base;                     // first flash page
+    uint8_t  state;
+    uint8_t  queued;                    // commit requested
+    uint8_t  spare;                     // page used for next compaction
+    uint16_t key;                       // chunk being programmed
+    uint16_t offset;                    // where buffer goes on flash
+    uint16_t end;                       // records end on compacted page
+    uint16_t done;                      // buffer bytes already programmed
+    uint16_t len;
+    union{
+        nvj_record_t record;
+        nvj_header_t header;
+    }buf;
+    nvj_stats_t stats;
+}nvjournal_t;
+
+static nvjournal_t nvj;
+
+static uint8_t *nvj_page(uint8_t page){
+    return nvj.base + page * NVJ_PAGE_SIZE;
+}
+
+static uint8_t nvj_erased(const uint8_t *data, uint16_t len){
+    while(len--){
+        if(*data++ != 0xFF){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint8_t nvj_count(uint64_t mask){
+    uint8_t count = 0;
+
+    while(mask){
+        mask &= mask - 1;
+        count++;
+    }
+    return count;
+}
+
+static uint16_t nvj_first(uint64_t mask){
+    uint16_t key = 0;
+
+    while(!(mask & 1)){
+        mask >>= 1;
+        key++;
+    }
+    return key;
+}
+
+static uint8_t nvj_headerValid(uint8_t page, uint32_t *seq){
+    const nvj_header_t *header = (const nvj_header_t*)nvj_page(page);
+
+    if(header->magic != NVJ_MAGIC || header->crc != crcCalc((const uint32_t*)header, NVJ_WORDS(nvj_header_t))){
+        return 0;
+    }
+    *seq = header->seq;
+    return 1;
+}
+
+static uint8_t nvj_recordValid(const nvj_record_t *record){
+    return record->key < NVJ_CHUNKS && record->crc == crcCalc((const uint32_t*)record, NVJ_WORDS(nvj_record_t));
+}
+
+/**
+ * @brief Pick spare page, must be other than the active one
+ * */
+static void nvj_spareSelect(void){
+    if(nvj.stats.page != NVJ_NO_PAGE){
+        nvj.spare = nvj.stats.page ^ 1;
+    }else{
+        nvj.spare = nvj_erased(nvj_page(0), NVJ_PAGE_SIZE) ? 0 : 1;
+    }
+    nvj.stats.spare_dirty = !nvj_erased(nvj_page(nvj.spare), NVJ_PAGE_SIZE);
+}
+
+/**
+ * @brief Prepare buffer with record for chunk from commit snapshot
+ * */
+static void nvj_loadRecord(uint16_t key, uint16_t flags){
+    nvj_record_t *record = &nvj.buf.record;
+
+    record->key = key;
+    record->flags = flags;
+    memcpy(record->data, &nvj.snap[key * NVJ_CHUNK], NVJ_CHUNK);
+    record->crc = crcCalc((const uint32_t*)record, NVJ_WORDS(nvj_record_t));
+    nvj.key = key;
+    nvj.len = sizeof(nvj_record_t);
+    nvj.done = 0;
+    nvj.stats.appends++;
+}
+
+static void nvj_loadHeader(void){
+    nvj_header_t *header = &nvj.buf.header;
+
+    header->magic = NVJ_MAGIC;
+    header->seq = nvj.stats.seq + 1;
+    header->crc = crcCalc((const uint32_t*)header, NVJ_WORDS(nvj_header_t));
+    nvj.len = sizeof(nvj_header_t);
+    nvj.done = 0;
+}
+
+/**
+ * @brief Next chunk holding data on snapshot, NVJ_CHUNKS if none
+ * */
+static uint16_t nvj_nextLive(uint16_t key){
+    while(key < NVJ_CHUNKS && nvj_erased(&nvj.snap[key * NVJ_CHUNK], NVJ_CHUNK)){
+        key++;
+    }
+    return key;
+}
+
+/**
+ * @brief Program buffer half-words that fit in budget
+ *
+ * @return : 1 buffer complete, 0 out of time, -1 flash error
+ * */
+static int8_t nvj_burst(uint8_t page, uint32_t *budget_us){
+    uint32_t count = (nvj.len - nvj.done) / 2;
+
+    if(count > *budget_us / NVJ_HALFWORD_US){
+        count = *budget_us / NVJ_HALFWORD_US;
+    }
+
+    if(count == 0){
+        return 0;
+    }
+
+    if(NVDATA_SECTOR_WRITE(nvj_page(page) + nvj.offset + nvj.done, (uint8_t*)&nvj.buf + nvj.done, count * 2) != HAL_OK){
+        return -1;
+    }
+
+    *budget_us -= count * NVJ_HALFWORD_US;
+    nvj.done += count * 2;
+    return nvj.done == nvj.len;
+}
+
+static uint8_t nvj_spareErase(uint32_t *budget_us){
+    nvj.stats.erases++;
+    *budget_us -= (*budget_us < NVJ_ERASE_US) ? *budget_us : NVJ_ERASE_US;
+
+    if(NVDATA_SECTOR_ERASE((uint32_t)(uintptr_t)nvj_page(nvj.spare)) == 0){
+        return 0;
+    }
+    nvj.stats.spare_dirty = 0;
+    return 1;
+}
+
+/**
+ * @brief Start commit from a snapshot of the ram image, writes
+ * done from now on go to the next commit
+ * */
+static void nvj_start(void){
+    memcpy(nvj.snap, nvj.image, NVJ_SIZE);
+    nvj.commit = nvj.left = nvj.dirty;
+    nvj.dirty = 0;
+
+    if(nvj.stats.page == NVJ_NO_PAGE || nvj.stats.dirty_tail ||
+       nvj.free + nvj_count(nvj.commit) * sizeof(nvj_record_t) > NVJ_PAGE_SIZE){
+        nvj.stats.compactions++;
+        nvj.state = NVJ_STATE_ERASE;
+        return;
+    }
+
+    nvj.state = NVJ_STATE_APPEND;
+    nvj.offset = nvj.free;
+    nvj_loadRecord(nvj_first(nvj.left), (nvj_count(nvj.left) == 1) ? NVJ_COMMIT : 0);
+}
+
+static uint8_t nvj_fail(void){
+    if(nvj.state == NVJ_STATE_APPEND){
+        nvj.stats.dirty_tail = 1;       // whatever got there is not committed
+    }else{
+        nvj.stats.spare_dirty = 1;
+    }
+    nvj.dirty |= nvj.commit;
+    nvj.state = NVJ_STATE_IDLE;
+    return NVJ_STEP_FAIL;
+}
+
+/**
+ * @brief Mount journal, rebuild ram image from the newest valid page
+ * */
+void nvj_init(void){
+    uint32_t seq[NVJ_PAGES];
+    uint8_t valid[NVJ_PAGES];
+    uint16_t offset, committed;
+    uint8_t *base;
+
+    memset(&nvj, 0, sizeof(nvjournal_t));
+    memset(nvj.image, 0xFF, NVJ_SIZE);
+    nvj.stats.page = NVJ_NO_PAGE;
+    nvj.base = (uint8_t*)NVDATA_SECTOR_START;
+
+    for(uint8_t i = 0; i < NVJ_PAGES; i++){
+        valid[i] = nvj_headerValid(i, &seq[i]);
+    }
+
+    if(valid[0] && valid[1]){
+        nvj.stats.page = ((int32_t)(seq[1] - seq[0]) > 0) ? 1 : 0;
+    }else if(valid[0] || valid[1]){
+        nvj.stats.page = valid[0] ? 0 : 1;
+    }else{
+        nvj_spareSelect();
+        return;                         // blank or both damaged, first commit compacts
+    }
+
+    nvj.stats.seq = seq[nvj.stats.page];
+    nvj_spareSelect();
+    base = nvj_page(nvj.stats.page);
+
+    // Find end of records and last commit
+    committed = offset = NVJ_RECORDS_START;
+    while(offset + sizeof(nvj_record_t) <= NVJ_PAGE_SIZE){
+        const nvj_record_t *record = (const nvj_record_t*)(base + offset);
+
+        if(nvj_erased((const uint8_t*)record, sizeof(nvj_record_t))){
+            break;
+        }
+        if(!nvj_recordValid(record)){
+            nvj.stats.dirty_tail = 1;
+            break;
+        }
+        offset += sizeof(nvj_record_t);
+        if(record->flags & NVJ_COMMIT){
+            committed = offset;
+        }
+    }
+
+    if(committed != offset){
+        nvj.stats.dirty_tail = 1;
+    }
+    nvj.free = offset;
+
+    for(offset = NVJ_RECORDS_START; offset < committed; offset += sizeof(nvj_record_t)){
+        const nvj_record_t *record = (const nvj_record_t*)(base + offset);
+        memcpy(&nvj.image[record->key * NVJ_CHUNK], record->data, NVJ_CHUNK);
+    }
+}
+
+/**
+ * @brief Flat eeprom image left on first page by the former
+ * eeprom emulation, only while no journal is mounted
+ *
+ * @return : page content, NULL if journal in use or page is blank or
+ * holds a damaged journal
+ * */
+const uint8_t *nvj_legacy(void){
+    const nvj_header_t *header = (const nvj_header_t*)nvj_page(0);
+
+    if(nvj.stats.page != NVJ_NO_PAGE || header->magic == NVJ_MAGIC ||
+       nvj_erased(nvj_page(0), NVJ_PAGE_SIZE)){
+        return NULL;
+    }
+    return nvj_page(0);
+}
+
+/**
+ * @brief Take a flat image as first journal content and commit it
+ * now. The first commit compacts on the spare page, which is never the
+ * first page while it holds data, so the image is safe on flash before
+ * any page it may come from is erased.
+ *
+ * @return : 0 on fail
+ * */
+uint32_t nvj_import(const uint8_t *data, uint16_t len){
+    if(nvj.stats.page != NVJ_NO_PAGE){
+        return 0;
+    }
+    nvj_write(0, data, len);
+    return nvj_sync();
+}
+
+uint16_t nvj_read(uint16_t address, uint8_t *data, uint16_t len){
+    if(address >= NVJ_SIZE){
+        return 0;
+    }
+    if(len > NVJ_SIZE - address){
+        len = NVJ_SIZE - address;
+    }
+    memcpy(data, &nvj.image[address], len);
+    return len;
+}
+
+/**
+ * @brief Update ram image, chunks are marked for commit only if content changes
+ *
+ * @return : number of bytes written
+ * */
+uint16_t nvj_write(uint16_t address, const uint8_t *data, uint16_t len){
+    if(address >= NVJ_SIZE){
+        return 0;
+    }
+    if(len > NVJ_SIZE - address){
+        len = NVJ_SIZE - address;
+    }
+
+    for(uint16_t i = 0; i < len; i++){
+        if(nvj.image[address + i] != data[i]){
+            nvj.image[address + i] = data[i];
+            nvj.dirty |= NVJ_BIT((address + i) / NVJ_CHUNK);
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief Queue changed chunks for commit, if a commit is in
+ * progress they go on the next one
+ * */
+void nvj_commit(void){
+    nvj.queued = 1;
+}
+
+/**
+ * @brief Run queued commit for at most the given time.
+ * With nothing queued and erase allowed, a used spare page is erased
+ *
+ * @param budget_us : time available for flash programming
+ * @param allow_erase : page erase can stall for NVJ_ERASE_US
+ * @return : nvj_step_res
+ * */
+uint8_t nvj_step(uint32_t budget_us, uint8_t allow_erase){
+    int8_t res;
+
+    while(1){
+        switch(nvj.state){
+            case NVJ_STATE_IDLE:
+                if(!nvj.queued || nvj.dirty == 0){
+                    nvj.queued = 0;
+                    if(allow_erase && nvj.stats.spare_dirty){
+                        nvj_spareErase(&budget_us);
+                    }
+                    return NVJ_STEP_IDLE;
+                }
+                nvj.queued = 0;
+                nvj_start();
+                break;
+
+            case NVJ_STATE_APPEND:
+                res = nvj_burst(nvj.stats.page, &budget_us);
+                if(res < 0){
+                    return nvj_fail();
+                }
+                if(res == 0){
+                    return NVJ_STEP_BUSY;
+                }
+                nvj.free += sizeof(nvj_record_t);
+                nvj.offset = nvj.free;
+                nvj.left &= ~NVJ_BIT(nvj.key);
+                if(nvj.left == 0){
+                    nvj.state = NVJ_STATE_IDLE;
+                    return NVJ_STEP_DONE;
+                }
+                nvj_loadRecord(nvj_first(nvj.left), (nvj_count(nvj.left) == 1) ? NVJ_COMMIT : 0);
+                break;
+
+            case NVJ_STATE_ERASE:
+                if(nvj.stats.spare_dirty){
+                    if(!allow_erase){
+                        return NVJ_STEP_BUSY;
+                    }
+                    if(!nvj_spareErase(&budget_us)){
+                        return nvj_fail();
+                    }
+                }
+                nvj.offset = NVJ_RECORDS_START;
+                nvj.key = nvj_nextLive(0);
+                if(nvj.key < NVJ_CHUNKS){
+                    nvj_loadRecord(nvj.key, NVJ_COMMIT);
+                    nvj.state = NVJ_STATE_COMPACT;
+                }else{
+                    nvj.end = nvj.offset;
+                    nvj.offset = 0;
+                    nvj_loadHeader();
+                    nvj.state = NVJ_STATE_HEADER;
+                }
+                nvj.stats.spare_dirty = 1;  // in use from now on
+                break;
+
+            case NVJ_STATE_COMPACT:
+                res = nvj_burst(nvj.spare, &budget_us);
+                if(res < 0){
+                    return nvj_fail();
+                }
+                if(res == 0){
+                    return NVJ_STEP_BUSY;
+                }
+                nvj.offset += sizeof(nvj_record_t);
+                nvj.key = nvj_nextLive(nvj.key + 1);
+                if(nvj.key < NVJ_CHUNKS){
+                    nvj_loadRecord(nvj.key, NVJ_COMMIT);
+                }else{
+                    nvj.end = nvj.offset;
+                    nvj.offset = 0;
+                    nvj_loadHeader();
+                    nvj.state = NVJ_STATE_HEADER;
+                }
+                break;
+
+            case NVJ_STATE_HEADER:
+                res = nvj_burst(nvj.spare, &budget_us);
+                if(res < 0){
+                    return nvj_fail();
+                }
+                if(res == 0){
+                    return NVJ_STEP_BUSY;
+                }
+                nvj.stats.seq = nvj.buf.header.seq;
+                nvj.stats.page = nvj.spare;
+                nvj.stats.dirty_tail = 0;
+                nvj.free = nvj.end;
+                nvj_spareSelect();
+                nvj.state = NVJ_STATE_IDLE;
+                return NVJ_STEP_DONE;
+
+            default:
+                nvj.state = NVJ_STATE_IDLE;
+                return NVJ_STEP_FAIL;
+        }
+    }
+}
+
+/**
+ * @brief Commit all changes now, blocking until done.
+ * Use only when the radio is not running
+ *
+ * @return : 0 on fail
+ * */
+uint32_t nvj_sync(void){
+    uint8_t res;
+
+    nvj_commit();
+
+    while((res = nvj_step(NVJ_NO_LIMIT, 1)) != NVJ_STEP_IDLE){
+        if(res == NVJ_STEP_FAIL){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Erase both pages and clear ram image
+ * */
+uint32_t nvj_erase(void){
+    uint32_t res = 1;
+
+    for(uint8_t i = 0; i < NVJ_PAGES; i++){
+        if(NVDATA_SECTOR_ERASE((uint32_t)(uintptr_t)nvj_page(i)) == 0){
+            res = 0;
+        }
+        nvj.stats.erases++;
+    }
+
+    memset(nvj.image, 0xFF, NVJ_SIZE);
+    nvj.dirty = 0;
+    nvj.queued = 0;
+    nvj.state = NVJ_STATE_IDLE;
+    nvj.free = NVJ_RECORDS_START;
+    nvj.stats.page = NVJ_NO_PAGE;
+    nvj.stats.dirty_tail = 0;
+    nvj_spareSelect();
+    return res;
+}
+
+nvj_stats_t *nvj_getStats(void){
+    nvj.stats.used = (nvj.stats.page == NVJ_NO_PAGE) ? 0 : nvj.free;
+    nvj.stats.pending = nvj_count(nvj.dirty | ((nvj.state == NVJ_STATE_IDLE) ? 0 : nvj.commit));
+    return &nvj.stats;
+}
@@ -0,0 +1,91 @@
+#ifndef _NVJOURNAL_H_
+#define _NVJOURNAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Emulated eeprom as a journal over two flash pages.
+ *
+ * The eeprom space is split in chunks and kept in ram. A sync appends
+ * one record per chunk that changed since the last sync, the last record
+ * of a sync is flagged as commit and only committed records are replayed
+ * at start, so a sync cut by power loss is either fully there or not at all.
+ * Records and page headers are checked with the CRC unit.
+ *
+ * When the active page is full, or its tail holds a torn or uncommitted
+ * record, live chunks are compacted on the spare page and its header is
+ * written last, making it active. The old page becomes the spare.
+ *
+ * Commits are done in steps so the radio is never stalled: nvj_commit()
+ * queues the changes and each nvj_step() programs as many half-words as
+ * fit in the time it is given. A page erase can not be split, it is only
+ * done when the caller allows it, the spare page is erased ahead of time
+ * so a compaction can still run while erases are not allowed.
+ *
+ * Flash left by the former eeprom emulation, a flat image on the first
+ * page, is taken with nvj_legacy() and nvj_import() on first start.
+ * */
+#define NVJ_PAGE_SIZE           1024
+#define NVJ_PAGES               2
+#define NVJ_CHUNK               16          // bytes per record
+#define NVJ_SIZE                640         // settings block and model slots
+#define NVJ_CHUNKS              (NVJ_SIZE / NVJ_CHUNK)
+#define NVJ_MAGIC               0x314A564E  // "NVJ1"
+#define NVJ_COMMIT              (1 << 0)
+#define NVJ_NO_PAGE             0xFF
+#define NVJ_HALFWORD_US         70          // worst case half-word program time
+#define NVJ_ERASE_US            40000       // worst case page erase time
+#define NVJ_NO_LIMIT            0xFFFFFFFFUL
+
+enum nvj_step_res{
+    NVJ_STEP_IDLE = 0,                  // nothing queued
+    NVJ_STEP_BUSY,                      // commit in progress
+    NVJ_STEP_DONE,                      // commit completed on this step
+    NVJ_STEP_FAIL                       // flash error, changes are kept in ram
+};
+
+typedef struct nvj_header{
+    uint32_t magic;
+    uint32_t seq;                       // compaction count, newest page wins
+    uint32_t crc;
+}nvj_header_t;
+
+typedef struct nvj_record{
+    uint16_t key;                       // chunk index
+    uint16_t flags;
+    uint8_t  data[NVJ_CHUNK];
+    uint32_t crc;                       // over key, flags and data
+}nvj_record_t;
+
+typedef struct nvj_stats{
+    uint32_t seq;
+    uint8_t  page;                      // active page, NVJ_NO_PAGE if none
+    uint8_t  dirty_tail;                // torn or uncommitted records found
+    uint16_t used;                      // bytes used on active page
+    uint8_t  pending;                   // chunks not yet on flash
+    uint8_t  spare_dirty;               // spare page needs erase before compaction
+    uint32_t appends;                   // records written since start
+    uint32_t compactions;
+    uint32_t erases;
+}nvj_stats_t;
+
+void nvj_init(void);
+const uint8_t *nvj_legacy(void);
+uint32_t nvj_import(const uint8_t *data, uint16_t len);
+uint16_t nvj_read(uint16_t address, uint8_t *data, uint16_t len);
+uint16_t nvj_write(uint16_t address, const uint8_t *data, uint16_t len);
+uint32_t nvj_sync(void);
+void nvj_commit(void);
+uint8_t nvj_step(uint32_t budget_us, uint8_t allow_erase);
+uint32_t nvj_erase(void);
+nvj_stats_t *nvj_getStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NVJOURNAL_H_ */
@@ -0,0 +1,64 @@
+#include <string.h>
+#include "board.h"
+#include "profiler.h"
+
+static prof_acc_t prof_acc[PROF_NUM];
+static uint32_t prof_start_tick;
+
+static const char *const prof_names[PROF_NUM] = {
+    "exti",
+    "dma_adc",
+    "dma_buz",
+    "dma_ppm",
+    "usb",
+    "i2c",
+    "systick",
+    "sched",
+    "mp_loop",
+    "cli",
+    "timers",
+    "lcd",
+    "idle",
+};
+
+/**
+ * @brief Clear all sections and start a new measuring window
+ * */
+void prof_reset(void){
+    cli();
+    memset(prof_acc, 0, sizeof(prof_acc));
+    prof_start_tick = getTick();
+    sei();
+}
+
+/**
+ * @brief Account one run of a section, called from interrupt
+ * handlers as well, each section is only updated from one context
+ *
+ * @param id : section
+ * @param cycles : cycles spent on this run
+ * */
+void prof_add(uint8_t id, uint32_t cycles){
+    prof_acc_t *acc = &prof_acc[id];
+
+    acc->count++;
+    acc->total += cycles;
+    if(cycles > acc->max){
+        acc->max = cycles;
+    }
+}
+
+prof_acc_t *prof_get(uint8_t id){
+    return &prof_acc[id];
+}
+
+const char *prof_name(uint8_t id){
+    return (id < PROF_NUM) ? prof_names[id] : "";
+}
+
+/**
+ * @brief Tick of last reset, measuring window starts here
+ * */
+uint32_t prof_start(void){
+    return prof_start_tick;
+}
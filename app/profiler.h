@@ -0,0 +1,59 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Cycle profiler for interrupt handlers and main loop phases.
+ *
+ * Each section keeps its number of runs, total and worst case cycles
+ * counted by getCycleCount(), DWT CYCCNT on target. Loop phases also
+ * hold the interrupts taken while they run, multiprotocol_loop holds
+ * the idle section as well.
+ * */
+enum prof_section{
+    PROF_EXTI = 0,                      // PPM pin, ppm_decode
+    PROF_DMA_ADC,                       // DMA1_Channel1, battery sampling
+    PROF_DMA_BUZ,                       // DMA1_Channel5, buzzer tones
+    PROF_DMA_PPM,                       // DMA1_Channel7, PPM output
+    PROF_USB,                           // USB_LP_CAN1_RX0
+    PROF_I2C,                           // I2C2_EV and its TX DMA, display
+    PROF_SYSTICK,
+    PROF_TIMER_BASE,                    // scheduler compare wake up
+    PROF_MP_LOOP,                       // multiprotocol_loop
+    PROF_CLI,                           // con.process
+    PROF_TIMERS,                        // processTimers
+    PROF_LCD,                           // requestLcdUpdate
+    PROF_IDLE,                          // sleeping on appIdle
+    PROF_NUM
+};
+
+typedef struct prof_acc{
+    uint32_t count;
+    uint32_t max;
+    uint64_t total;
+}prof_acc_t;
+
+#ifdef ENABLE_PROFILER
+#define PROF_START(_V)          uint32_t _V = getCycleCount()
+#define PROF_END(_ID, _V)       prof_add(_ID, getCycleCount() - (_V))
+#else
+#define PROF_START(_V)
+#define PROF_END(_ID, _V)
+#endif
+
+void prof_reset(void);
+void prof_add(uint8_t id, uint32_t cycles);
+prof_acc_t *prof_get(uint8_t id);
+const char *prof_name(uint8_t id);
+uint32_t prof_start(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PROFILER_H_ */
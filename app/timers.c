@@ -0,0 +1,248 @@
+#include "board.h"
+
+/**
+ * Software timers on a hashed wheel with one slot per tick.
+ *
+ * A timer sits on the slot of its expiry tick, timers that expire more
+ * than SWTIM_SLOTS ticks ahead share the slot and are skipped until
+ * their round comes. Start and stop only link or unlink a list node.
+ * Handles carry a generation count, so a stale handle never stops a
+ * timer that reused its entry.
+ * */
+#define SWTIM_NIL               0xFF
+#define SWTIM_INDEX(_H)         ((_H) & 0xFF)
+#define SWTIM_GEN(_H)           ((_H) >> 8)
+#define SWTIM_GEN_MASK          0x00FFFFFF
+
+_Static_assert(SWTIM_NUM < SWTIM_NIL, "too many timers for 8 bit index");
+_Static_assert((SWTIM_SLOTS & (SWTIM_SLOTS - 1)) == 0, "wheel slots must be power of 2");
+
+typedef struct swtimer{
+    uint32_t expire;                    // tick of next expiry
+    uint32_t time;                      // duration in ticks
+    void (*action)(void);
+    uint32_t gen;                       // bumped on every release, never 0
+    uint8_t next;                       // slot list, or free list
+    uint8_t prev;
+    uint8_t status;
+}swtimer_t;
+
+static struct {
+    swtimer_t timer[SWTIM_NUM];
+    uint8_t slot[SWTIM_SLOTS];          // first timer on each slot
+    uint8_t free;
+    uint8_t ready;
+    uint8_t next_valid;
+    uint32_t tick;                      // last processed tick
+    uint32_t next;                      // cached nearest expiry
+}wheel;
+
+static void timerInit(void){
+    for(uint32_t i = 0; i < SWTIM_SLOTS; i++){
+        wheel.slot[i] = SWTIM_NIL;
+    }
+    for(uint32_t i = 0; i < SWTIM_NUM; i++){
+        wheel.timer[i].next = (i + 1 < SWTIM_NUM) ? i + 1 : SWTIM_NIL;
+        wheel.timer[i].gen = 1;
+    }
+    wheel.free = 0;
+    wheel.tick = getTick();
+    wheel.ready = 1;
+}
+
+static void timerLink(uint8_t idx){
+    swtimer_t *tim = &wheel.timer[idx];
+    uint8_t *head = &wheel.slot[tim->expire & (SWTIM_SLOTS - 1)];
+
+    tim->prev = SWTIM_NIL;
+    tim->next = *head;
+    if(*head != SWTIM_NIL){
+        wheel.timer[*head].prev = idx;
+    }
+    *head = idx;
+
+    if(wheel.next_valid && (int32_t)(tim->expire - wheel.next) < 0){
+        wheel.next = tim->expire;
+    }
+}
+
+static void timerUnlink(uint8_t idx){
+    swtimer_t *tim = &wheel.timer[idx];
+
+    if(tim->prev != SWTIM_NIL){
+        wheel.timer[tim->prev].next = tim->next;
+    }else{
+        wheel.slot[tim->expire & (SWTIM_SLOTS - 1)] = tim->next;
+    }
+    if(tim->next != SWTIM_NIL){
+        wheel.timer[tim->next].prev = tim->prev;
+    }
+    wheel.next_valid = 0;
+}
+
+static void timerRelease(uint8_t idx){
+    swtimer_t *tim = &wheel.timer[idx];
+
+    tim->status = 0;
+    tim->gen = (tim->gen + 1) & SWTIM_GEN_MASK;
+    if(tim->gen == 0){
+        tim->gen = 1;
+    }
+    tim->next = wheel.free;
+    wheel.free = idx;
+}
+
+/**
+ * @brief Start a software timer
+ *
+ * @param time : Timer duration in ticks
+ * @param flags : Extra flags for continuous mode, 0 for single time
+ * @param cb : callback function when timer expires
+ *
+ * @return : Timer handle, SWTIM_NONE if all timers are in use
+ * */
+uint32_t startTimer(uint32_t time, uint32_t flags, void (*cb)(void)){
+    uint8_t idx;
+    swtimer_t *tim;
+
+    if(!wheel.ready){
+        timerInit();
+    }
+
+    if(wheel.free == SWTIM_NIL || cb == NULL){
+        return SWTIM_NONE;
+    }
+
+    idx = wheel.free;
+    tim = &wheel.timer[idx];
+    wheel.free = tim->next;
+
+    tim->time = (time > 0) ? time : 1;
+    tim->expire = getTick() + tim->time;
+    tim->action = cb;
+    tim->status = flags | SWTIM_RUNNING;
+    timerLink(idx);
+
+    return (tim->gen << 8) | idx;
+}
+
+/**
+ * @brief Stop timer, stale handles and SWTIM_NONE are ignored
+ * */
+void stopTimer(uint32_t handle){
+    uint8_t idx = SWTIM_INDEX(handle);
+    swtimer_t *tim;
+
+    if(idx >= SWTIM_NUM){
+        return;
+    }
+
+    tim = &wheel.timer[idx];
+
+    if(tim->gen != SWTIM_GEN(handle) || !(tim->status & SWTIM_RUNNING)){
+        return;
+    }
+
+    if(!(tim->status & SWTIM_FIRING)){
+        timerUnlink(idx);
+    }
+    timerRelease(idx);
+}
+
+/**
+ * @brief Ticks until the nearest timer expires, 0 if one is already due
+ *
+ * @return : ticks, SWTIM_NO_EXPIRY if no timer is running
+ * */
+uint32_t nextTimerExpiry(void){
+    uint32_t now = getTick();
+
+    if(!wheel.ready){
+        return SWTIM_NO_EXPIRY;
+    }
+
+    if(!wheel.next_valid){
+        uint8_t found = 0;
+
+        for(uint32_t i = 0; i < SWTIM_NUM; i++){
+            swtimer_t *tim = &wheel.timer[i];
+            if((tim->status & SWTIM_RUNNING) && !(tim->status & SWTIM_FIRING) &&
+               (!found || (int32_t)(tim->expire - wheel.next) < 0)){
+                wheel.next = tim->expire;
+                found = 1;
+            }
+        }
+
+        if(!found){
+            return SWTIM_NO_EXPIRY;
+        }
+        wheel.next_valid = 1;
+    }
+
+    return ((int32_t)(wheel.next - now) > 0) ? wheel.next - now : 0;
+}
+
+/**
+ * @brief Run due timers on one slot. The slot is scanned again
+ * after each action, since the action may start or stop timers
+ * */
+static void timerSlot(uint32_t slot, uint32_t now){
+    uint8_t idx = wheel.slot[slot];
+
+    while(idx != SWTIM_NIL){
+        swtimer_t *tim = &wheel.timer[idx];
+        uint32_t gen;
+
+        if((int32_t)(now - tim->expire) < 0){
+            idx = tim->next;
+            continue;
+        }
+
+        timerUnlink(idx);
+        tim->status |= SWTIM_FIRING;
+        gen = tim->gen;
+
+        tim->action();
+
+        // Stopped from its own action, entry may be in use again
+        if(tim->gen == gen){
+            tim->status &= ~SWTIM_FIRING;
+            if(tim->status & SWTIM_AUTO_RELOAD){
+                tim->expire = now + tim->time;
+                timerLink(idx);
+            }else{
+                timerRelease(idx);
+            }
+        }
+
+        idx = wheel.slot[slot];
+    }
+}
+
+/**
+ * @brief Check if timers have expired and execute correspondent action.
+ * Only the wheel slots of the ticks elapsed since last call are visited
+ * */
+void processTimers(void){
+    uint32_t now = getTick();
+    uint32_t elapsed;
+
+    if(!wheel.ready){
+        return;
+    }
+
+    elapsed = now - wheel.tick;
+    if(elapsed == 0){
+        return;
+    }
+
+    if(elapsed > SWTIM_SLOTS){
+        elapsed = SWTIM_SLOTS;
+    }
+
+    for(uint32_t i = elapsed; i > 0; i--){
+        timerSlot((now - i + 1) & (SWTIM_SLOTS - 1), now);
+    }
+
+    wheel.tick = now;
+}
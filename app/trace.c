@@ -0,0 +1,140 @@
+#include <string.h>
+#include "board.h"
+#include "trace.h"
+#include "bytering.h"
+
+_Static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "trace ring size must be power of 2");
+
+static uint8_t trace_buf[TRACE_RING_SIZE];
+static bytering_t ring = BYTERING_INIT(trace_buf);
+static uint8_t trace_enabled;
+
+static trace_stats_t trace_stats;
+
+static uint8_t *put16(uint8_t *dst, uint16_t value){
+    *dst++ = value;
+    *dst++ = value >> 8;
+    return dst;
+}
+
+static uint8_t *put32(uint8_t *dst, uint32_t value){
+    dst = put16(dst, value);
+    return put16(dst, value >> 16);
+}
+
+/**
+ * @brief Frame payload as a record and queue it, dropped if it does not fit
+ * */
+static void trace_record(uint8_t type, const uint8_t *payload, uint8_t len){
+    uint8_t rec[TRACE_HEADER + TRACE_MAX_PAYLOAD + 1];
+    uint16_t size = TRACE_HEADER + len + 1;
+    uint8_t sum;
+
+    if(!trace_enabled){
+        return;
+    }
+
+    rec[0] = TRACE_SYNC;
+    rec[1] = type;
+    rec[2] = len;
+    put16(&rec[3], getTick());
+    memcpy(&rec[TRACE_HEADER], payload, len);
+
+    sum = 0;
+    for(uint16_t i = 1; i < size - 1; i++){
+        sum ^= rec[i];
+    }
+    rec[size - 1] = sum;
+
+    if(!bytering_put(&ring, rec, size)){
+        trace_stats.dropped++;
+        return;
+    }
+    trace_stats.records++;
+}
+
+/**
+ * @brief Start or stop tracing, queued records are kept
+ * */
+void trace_enable(uint8_t enable){
+    trace_enabled = enable;
+}
+
+uint8_t trace_isEnabled(void){
+    return trace_enabled;
+}
+
+/**
+ * @brief Channel values as sent on air
+ * */
+void trace_channels(const uint16_t *data, uint8_t count){
+    uint8_t payload[TRACE_MAX_PAYLOAD];
+    uint8_t *p = payload;
+
+    if(count > TRACE_MAX_PAYLOAD / 2){
+        count = TRACE_MAX_PAYLOAD / 2;
+    }
+    for(uint8_t i = 0; i < count; i++){
+        p = put16(p, data[i]);
+    }
+    trace_record(TRACE_CHANNELS, payload, count * 2);
+}
+
+/**
+ * @brief Protocol callback run
+ *
+ * @param start : TIMER_BASE count at callback start
+ * @param late : ticks after its deadline
+ * @param next : ticks to next callback
+ * */
+void trace_callback(uint16_t start, uint16_t late, uint16_t next){
+    uint8_t payload[6];
+    uint8_t *p = payload;
+
+    p = put16(p, start);
+    p = put16(p, late);
+    put16(p, next);
+    trace_record(TRACE_CALLBACK, payload, sizeof(payload));
+}
+
+void trace_rf(uint32_t tx, uint32_t rx, uint32_t bad_crc, uint32_t missed, int16_t tx_rssi, uint8_t rx_rssi){
+    uint8_t payload[19];
+    uint8_t *p = payload;
+
+    p = put32(p, tx);
+    p = put32(p, rx);
+    p = put32(p, bad_crc);
+    p = put32(p, missed);
+    p = put16(p, tx_rssi);
+    *p = rx_rssi;
+    trace_record(TRACE_RF, payload, sizeof(payload));
+}
+
+void trace_battery(uint16_t mv, uint16_t ma){
+    uint8_t payload[4];
+
+    put16(put16(payload, mv), ma);
+    trace_record(TRACE_BATTERY, payload, sizeof(payload));
+}
+
+/**
+ * @brief Oldest queued bytes, without removing them
+ *
+ * @param data : set to first byte
+ * @return : contiguous bytes available, up to TRACE_PACKET
+ * */
+uint16_t trace_peek(uint8_t **data){
+    return bytering_peek(&ring, data, TRACE_PACKET);
+}
+
+/**
+ * @brief Release bytes once the output is done with them
+ * */
+void trace_consume(uint16_t len){
+    bytering_consume(&ring, len);
+    trace_stats.bytes += len;
+}
+
+trace_stats_t *trace_getStats(void){
+    return &trace_stats;
+}
@@ -0,0 +1,57 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Binary trace stream.
+ *
+ * Records are queued on a ring by the main loop and taken by the
+ * output, USB CDC IN transfers, in chunks of up to TRACE_PACKET bytes
+ * read straight from the ring. Each record is
+ *
+ *   sync, type, len, ms (16 bit), payload[len], xor of type to payload
+ *
+ * so a reader finds records again after lost bytes or console text on
+ * the same port. Values are little endian. Records that do not fit are
+ * dropped and counted, the main loop is never held.
+ * */
+#define TRACE_RING_SIZE         1024        // power of 2
+#define TRACE_PACKET            64          // CDC bulk max packet size
+#define TRACE_SYNC              0xA5
+#define TRACE_HEADER            5           // sync, type, len, ms
+#define TRACE_MAX_PAYLOAD       48
+#define TRACE_RF_PERIOD         100         // ms
+
+enum trace_type{
+    TRACE_CHANNELS = 1,                     // uint16 per channel, as sent
+    TRACE_CALLBACK,                         // start, late, next: uint16 TIMER_BASE ticks
+    TRACE_RF,                               // tx, rx, bad crc, missed: uint32, tx rssi: int16, rx rssi: uint8
+    TRACE_BATTERY,                          // mV, mA: uint16
+};
+
+typedef struct trace_stats{
+    uint32_t records;
+    uint32_t dropped;                       // ring full
+    uint32_t bytes;                         // taken by output
+}trace_stats_t;
+
+void trace_enable(uint8_t enable);
+uint8_t trace_isEnabled(void);
+void trace_channels(const uint16_t *data, uint8_t count);
+void trace_callback(uint16_t start, uint16_t late, uint16_t next);
+void trace_rf(uint32_t tx, uint32_t rx, uint32_t bad_crc, uint32_t missed, int16_t tx_rssi, uint8_t rx_rssi);
+void trace_battery(uint16_t mv, uint16_t ma);
+uint16_t trace_peek(uint8_t **data);
+void trace_consume(uint16_t len);
+trace_stats_t *trace_getStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TRACE_H_ */
@@ -18,6 +18,7 @@
 /******************************/
 
 #include "FrSkyDVX_Common.h"
+#include "chanmap.h"
 
 #if defined(CC2500_INSTALLED)
 #include "iface_cc2500.h"
@@ -65,11 +66,16 @@ void Frsky_SetPower(void){
 	}	
 }
 
-// Channel value for FrSky (PPM is multiplied by 1.5)
+// Channel value for FrSky (PPM is multiplied by 1.5), val * 15/16 + 1290
+static const chanmap_t frsky_chanmap = CHANMAP_RATIO(0, 1290, 15, 16);
+
 uint16_t convert_channel_frsky(uint8_t num)
 {
-	uint16_t val = radio.channel_data[num];
-	return ((val*15) >> 4) + 1290;
+#ifdef ENABLE_MIXER
+	return chanmap_apply(&frsky_chanmap, radio.channel_mix[num]);
+#else
+	return chanmap_apply(&frsky_chanmap, radio.channel_data[num]);
+#endif
 }
 
 #if defined(FRSKYD_CC2500_INO) || defined(FRSKYX_CC2500_INO)
@@ -109,153 +115,126 @@ void Frsky_init_hop(void)
 /**  FrSky V, D and X routines  **/
 /******************************/
 #if defined(FRSKYV_CC2500_INO) || defined(FRSKYD_CC2500_INO) || defined(FRSKYX_CC2500_INO)
-	const PROGMEM uint8_t FRSKY_common_startreg_cc2500_conf[]= {
-		 CC2500_02_IOCFG0 ,		
-		 CC2500_00_IOCFG2 ,
-		 CC2500_17_MCSM1 ,
-		 CC2500_18_MCSM0 ,
-		 CC2500_06_PKTLEN ,
-		 CC2500_07_PKTCTRL1 ,
-		 CC2500_08_PKTCTRL0 ,
-		 CC2500_3E_PATABLE ,
-		 CC2500_0B_FSCTRL1 ,
-		 CC2500_0C_FSCTRL0 ,	// replaced by option value
-		 CC2500_0D_FREQ2 ,	
-		 CC2500_0E_FREQ1 ,
-		 CC2500_0F_FREQ0 ,
-		 CC2500_10_MDMCFG4 ,		
-		 CC2500_11_MDMCFG3 ,
-		 CC2500_12_MDMCFG2 ,
-		 CC2500_13_MDMCFG1 ,
-		 CC2500_14_MDMCFG0 ,
-		 CC2500_15_DEVIATN  };
-
 	#if defined(FRSKYV_CC2500_INO)
-		const PROGMEM uint8_t FRSKYV_cc2500_conf[]= {
-		/*02_IOCFG0*/  	 0x06 ,		
-		/*00_IOCFG2*/  	 0x06 ,
-		/*17_MCSM1*/   	 0x0c ,
-		/*18_MCSM0*/   	 0x18 ,
-		/*06_PKTLEN*/  	 0xff ,
-		/*07_PKTCTRL1*/	 0x04 ,
-		/*08_PKTCTRL0*/	 0x05 ,
-		/*3E_PATABLE*/ 	 0xfe ,
-		/*0B_FSCTRL1*/ 	 0x08 ,
-		/*0C_FSCTRL0*/ 	 0x00 ,
-		/*0D_FREQ2*/   	 0x5c ,	
-		/*0E_FREQ1*/   	 0x58 ,
-		/*0F_FREQ0*/   	 0x9d ,
-		/*10_MDMCFG4*/ 	 0xAA ,		
-		/*11_MDMCFG3*/ 	 0x10 ,
-		/*12_MDMCFG2*/ 	 0x93 ,
-		/*13_MDMCFG1*/ 	 0x23 ,
-		/*14_MDMCFG0*/ 	 0x7a ,
-		/*15_DEVIATN*/ 	 0x41  };
+		const cc2500_reg_t FRSKYV_cc2500_conf[FRSKY_CONF_LEN]= {
+		CC2500_REG(CC2500_00_IOCFG2, 0x06),
+		CC2500_REG(CC2500_02_IOCFG0, 0x06),
+		CC2500_REG(CC2500_06_PKTLEN, 0xff),
+		CC2500_REG(CC2500_07_PKTCTRL1, 0x04),
+		CC2500_REG(CC2500_08_PKTCTRL0, 0x05),
+		CC2500_REG(CC2500_0B_FSCTRL1, 0x08),
+		CC2500_REG_ARG(CC2500_0C_FSCTRL0, 0),		// option value
+		CC2500_REG(CC2500_0D_FREQ2, 0x5c),
+		CC2500_REG(CC2500_0E_FREQ1, 0x58),
+		CC2500_REG(CC2500_0F_FREQ0, 0x9d),
+		CC2500_REG(CC2500_10_MDMCFG4, 0xAA),
+		CC2500_REG(CC2500_11_MDMCFG3, 0x10),
+		CC2500_REG(CC2500_12_MDMCFG2, 0x93),
+		CC2500_REG(CC2500_13_MDMCFG1, 0x23),
+		CC2500_REG(CC2500_14_MDMCFG0, 0x7a),
+		CC2500_REG(CC2500_15_DEVIATN, 0x41),
+		CC2500_REG(CC2500_17_MCSM1, 0x0c),
+		CC2500_REG(CC2500_18_MCSM0, 0x18),
+		CC2500_REG(CC2500_3E_PATABLE, 0xfe) };
 	#endif
 
 	#if defined(FRSKYD_CC2500_INO)
-		const PROGMEM uint8_t FRSKYD_cc2500_conf[]= {
-		/*02_IOCFG0*/  	 0x06 ,		
-		/*00_IOCFG2*/  	 0x06 ,
-		/*17_MCSM1*/   	 0x0c ,
-		/*18_MCSM0*/   	 0x18 ,
-		/*06_PKTLEN*/  	 0x19 ,
-		/*07_PKTCTRL1*/	 0x04 ,
-		/*08_PKTCTRL0*/	 0x05 ,
-		/*3E_PATABLE*/ 	 0xff ,
-		/*0B_FSCTRL1*/ 	 0x08 ,
-		/*0C_FSCTRL0*/ 	 0x00 ,
-		/*0D_FREQ2*/   	 0x5c ,	
-		/*0E_FREQ1*/   	 0x76 ,
-		/*0F_FREQ0*/   	 0x27 ,
-		/*10_MDMCFG4*/ 	 0xAA ,		
-		/*11_MDMCFG3*/ 	 0x39 ,
-		/*12_MDMCFG2*/ 	 0x11 ,
-		/*13_MDMCFG1*/ 	 0x23 ,
-		/*14_MDMCFG0*/ 	 0x7a ,
-		/*15_DEVIATN*/ 	 0x42  };
+		const cc2500_reg_t FRSKYD_cc2500_conf[FRSKY_CONF_LEN]= {
+		CC2500_REG(CC2500_00_IOCFG2, 0x06),
+		CC2500_REG(CC2500_02_IOCFG0, 0x06),
+		CC2500_REG(CC2500_06_PKTLEN, 0x19),
+		CC2500_REG(CC2500_07_PKTCTRL1, 0x04),
+		CC2500_REG(CC2500_08_PKTCTRL0, 0x05),
+		CC2500_REG(CC2500_0B_FSCTRL1, 0x08),
+		CC2500_REG_ARG(CC2500_0C_FSCTRL0, 0),		// option value
+		CC2500_REG(CC2500_0D_FREQ2, 0x5c),
+		CC2500_REG(CC2500_0E_FREQ1, 0x76),
+		CC2500_REG(CC2500_0F_FREQ0, 0x27),
+		CC2500_REG(CC2500_10_MDMCFG4, 0xAA),
+		CC2500_REG(CC2500_11_MDMCFG3, 0x39),
+		CC2500_REG(CC2500_12_MDMCFG2, 0x11),
+		CC2500_REG(CC2500_13_MDMCFG1, 0x23),
+		CC2500_REG(CC2500_14_MDMCFG0, 0x7a),
+		CC2500_REG(CC2500_15_DEVIATN, 0x42),
+		CC2500_REG(CC2500_17_MCSM1, 0x0c),
+		CC2500_REG(CC2500_18_MCSM0, 0x18),
+		CC2500_REG(CC2500_3E_PATABLE, 0xff) };
 	#endif
 
 	#if defined(FRSKYX_CC2500_INO)
-		const PROGMEM uint8_t FRSKYX_cc2500_conf[]= {
 	//FRSKYX
-		/*02_IOCFG0*/  	 0x06 ,		
-		/*00_IOCFG2*/  	 0x06 ,
-		/*17_MCSM1*/   	 0x0c ,
-		/*18_MCSM0*/   	 0x18 ,
-		/*06_PKTLEN*/  	 0x1E ,
-		/*07_PKTCTRL1*/	 0x04 ,
-		/*08_PKTCTRL0*/	 0x01 ,
-		/*3E_PATABLE*/ 	 0xff ,
-		/*0B_FSCTRL1*/ 	 0x0A ,
-		/*0C_FSCTRL0*/ 	 0x00 ,
-		/*0D_FREQ2*/   	 0x5c ,	
-		/*0E_FREQ1*/   	 0x76 ,
-		/*0F_FREQ0*/   	 0x27 ,
-		/*10_MDMCFG4*/ 	 0x7B ,		
-		/*11_MDMCFG3*/ 	 0x61 ,
-		/*12_MDMCFG2*/ 	 0x13 ,
-		/*13_MDMCFG1*/ 	 0x23 ,
-		/*14_MDMCFG0*/ 	 0x7a ,
-		/*15_DEVIATN*/ 	 0x51  };
-		const PROGMEM uint8_t FRSKYXEU_cc2500_conf[]= {
-		/*02_IOCFG0*/  	 0x06 ,		
-		/*00_IOCFG2*/  	 0x06 ,
-		/*17_MCSM1*/   	 0x0E ,
-		/*18_MCSM0*/   	 0x18 ,
-		/*06_PKTLEN*/  	 0x23 ,
-		/*07_PKTCTRL1*/	 0x04 ,
-		/*08_PKTCTRL0*/	 0x01 ,
-		/*3E_PATABLE*/ 	 0xff ,
-		/*0B_FSCTRL1*/ 	 0x08 ,
-		/*0C_FSCTRL0*/ 	 0x00 ,
-		/*0D_FREQ2*/   	 0x5c ,	
-		/*0E_FREQ1*/   	 0x80 ,
-		/*0F_FREQ0*/   	 0x00 ,
-		/*10_MDMCFG4*/ 	 0x7B ,		
-		/*11_MDMCFG3*/ 	 0xF8 ,
-		/*12_MDMCFG2*/ 	 0x03 ,
-		/*13_MDMCFG1*/ 	 0x23 ,
-		/*14_MDMCFG0*/ 	 0x7a ,
-		/*15_DEVIATN*/ 	 0x53  };
+		const cc2500_reg_t FRSKYX_cc2500_conf[FRSKY_CONF_LEN]= {
+		CC2500_REG(CC2500_00_IOCFG2, 0x06),
+		CC2500_REG(CC2500_02_IOCFG0, 0x06),
+		CC2500_REG(CC2500_06_PKTLEN, 0x1E),
+		CC2500_REG(CC2500_07_PKTCTRL1, 0x04),
+		CC2500_REG(CC2500_08_PKTCTRL0, 0x01),
+		CC2500_REG(CC2500_0B_FSCTRL1, 0x0A),
+		CC2500_REG_ARG(CC2500_0C_FSCTRL0, 0),		// option value
+		CC2500_REG(CC2500_0D_FREQ2, 0x5c),
+		CC2500_REG(CC2500_0E_FREQ1, 0x76),
+		CC2500_REG(CC2500_0F_FREQ0, 0x27),
+		CC2500_REG(CC2500_10_MDMCFG4, 0x7B),
+		CC2500_REG(CC2500_11_MDMCFG3, 0x61),
+		CC2500_REG(CC2500_12_MDMCFG2, 0x13),
+		CC2500_REG(CC2500_13_MDMCFG1, 0x23),
+		CC2500_REG(CC2500_14_MDMCFG0, 0x7a),
+		CC2500_REG(CC2500_15_DEVIATN, 0x51),
+		CC2500_REG(CC2500_17_MCSM1, 0x0c),
+		CC2500_REG(CC2500_18_MCSM0, 0x18),
+		CC2500_REG(CC2500_3E_PATABLE, 0xff) };
+		const cc2500_reg_t FRSKYXEU_cc2500_conf[FRSKY_CONF_LEN]= {
+		CC2500_REG(CC2500_00_IOCFG2, 0x06),
+		CC2500_REG(CC2500_02_IOCFG0, 0x06),
+		CC2500_REG(CC2500_06_PKTLEN, 0x23),
+		CC2500_REG(CC2500_07_PKTCTRL1, 0x04),
+		CC2500_REG(CC2500_08_PKTCTRL0, 0x01),
+		CC2500_REG(CC2500_0B_FSCTRL1, 0x08),
+		CC2500_REG_ARG(CC2500_0C_FSCTRL0, 0),		// option value
+		CC2500_REG(CC2500_0D_FREQ2, 0x5c),
+		CC2500_REG(CC2500_0E_FREQ1, 0x80),
+		CC2500_REG(CC2500_0F_FREQ0, 0x00),
+		CC2500_REG(CC2500_10_MDMCFG4, 0x7B),
+		CC2500_REG(CC2500_11_MDMCFG3, 0xF8),
+		CC2500_REG(CC2500_12_MDMCFG2, 0x03),
+		CC2500_REG(CC2500_13_MDMCFG1, 0x23),
+		CC2500_REG(CC2500_14_MDMCFG0, 0x7a),
+		CC2500_REG(CC2500_15_DEVIATN, 0x53),
+		CC2500_REG(CC2500_17_MCSM1, 0x0E),
+		CC2500_REG(CC2500_18_MCSM0, 0x18),
+		CC2500_REG(CC2500_3E_PATABLE, 0xff) };
 	#endif
 
-	const PROGMEM uint8_t FRSKY_common_end_cc2500_conf[][2]= {
-		{ CC2500_19_FOCCFG,   0x16 },
-		{ CC2500_1A_BSCFG,    0x6c },	
-		{ CC2500_1B_AGCCTRL2, 0x43 },
-		{ CC2500_1C_AGCCTRL1, 0x40 },
-		{ CC2500_1D_AGCCTRL0, 0x91 },
-		{ CC2500_21_FREND1,   0x56 },
-		{ CC2500_22_FREND0,   0x10 },
-		{ CC2500_23_FSCAL3,   0xa9 },
-		{ CC2500_24_FSCAL2,   0x0A },
-		{ CC2500_25_FSCAL1,   0x00 },
-		{ CC2500_26_FSCAL0,   0x11 },
-		{ CC2500_29_FSTEST,   0x59 },
-		{ CC2500_2C_TEST2,    0x88 },
-		{ CC2500_2D_TEST1,    0x31 },
-		{ CC2500_2E_TEST0,    0x0B },
-		{ CC2500_03_FIFOTHR,  0x07 },
-		{ CC2500_09_ADDR,     0x00 } };
-
-	void FRSKY_init_cc2500(const uint8_t *ptr)
+	static const cc2500_reg_t FRSKY_common_end_cc2500_conf[]= {
+		CC2500_REG(CC2500_03_FIFOTHR,  0x07),
+		CC2500_REG(CC2500_09_ADDR,     0x00),
+		CC2500_REG(CC2500_19_FOCCFG,   0x16),
+		CC2500_REG(CC2500_1A_BSCFG,    0x6c),
+		CC2500_REG(CC2500_1B_AGCCTRL2, 0x43),
+		CC2500_REG(CC2500_1C_AGCCTRL1, 0x40),
+		CC2500_REG(CC2500_1D_AGCCTRL0, 0x91),
+		CC2500_REG(CC2500_21_FREND1,   0x56),
+		CC2500_REG(CC2500_22_FREND0,   0x10),
+		CC2500_REG(CC2500_23_FSCAL3,   0xa9),
+		CC2500_REG(CC2500_24_FSCAL2,   0x0A),
+		CC2500_REG(CC2500_25_FSCAL1,   0x00),
+		CC2500_REG(CC2500_26_FSCAL0,   0x11),
+		CC2500_REG(CC2500_29_FSTEST,   0x59),
+		CC2500_REG(CC2500_2C_TEST2,    0x88),
+		CC2500_REG(CC2500_2D_TEST1,    0x31),
+		CC2500_REG(CC2500_2E_TEST0,    0x0B) };
+
+	/**
+	 * Tables are sorted by register address so consecutive
+	 * registers are written in bursts
+	 * */
+	void FRSKY_init_cc2500(const cc2500_reg_t *conf)
 	{
-		for(uint8_t i=0;i<19;i++)
-		{
-			uint8_t reg=pgm_read_byte_near(&FRSKY_common_startreg_cc2500_conf[i]);
-			uint8_t val=pgm_read_byte_near(&ptr[i]);
-			if(reg==CC2500_0C_FSCTRL0)
-				val = radio.option;
-			CC2500_WriteReg(reg,val);
-		}
+		uint8_t option = radio.option;
+
+		CC2500_WriteProgram(conf, FRSKY_CONF_LEN, &option);
 		radio.prev_option = radio.option ;		// Save option to monitor FSCTRL0 change
-		for(uint8_t i=0;i<17;i++)
-		{
-			uint8_t reg=pgm_read_byte_near(&FRSKY_common_end_cc2500_conf[i][0]);
-			uint8_t val=pgm_read_byte_near(&FRSKY_common_end_cc2500_conf[i][1]);
-			CC2500_WriteReg(reg,val);
-		}
+		CC2500_PROGRAM(FRSKY_common_end_cc2500_conf, NULL);
 		CC2500_SetTxRxMode(TX_EN);
 		Frsky_SetPower();
 		CC2500_Strobe(CC2500_SIDLE);    // Go to idle...
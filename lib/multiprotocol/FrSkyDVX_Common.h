@@ -9,6 +9,7 @@ extern "C" {
 #include <stdint.h>
 #include "multiprotocol.h"
 #include "app.h"
+#include "iface_cc2500.h"
 
 #ifdef STM32_BOARD
 #define PROGMEM
@@ -28,10 +29,12 @@ enum {
 
 #endif
 
-extern const PROGMEM uint8_t FRSKYD_cc2500_conf[];
+#define FRSKY_CONF_LEN	19
+
+extern const cc2500_reg_t FRSKYD_cc2500_conf[FRSKY_CONF_LEN];
 
 void Frsky_init_hop(void);
-void FRSKY_init_cc2500(const uint8_t *ptr);
+void FRSKY_init_cc2500(const cc2500_reg_t *conf);
 void Frsky_SetPower(void);
 uint16_t convert_channel_frsky(uint8_t num);
 
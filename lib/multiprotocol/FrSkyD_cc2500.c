@@ -17,18 +17,130 @@
 
 #include "FrSkyDVX_Common.h"
 #include "iface_cc2500.h"
+#ifdef ENABLE_LATENCY
+#include "latency.h"
+#endif
+#ifdef ENABLE_TELEMETRY
+#include "telemetry.h"
+#endif
+#ifdef ENABLE_RF_STATS
+#include "rf_stats.h"
+#endif
+
+#define FRSKY2WAY_HOP_NUM		47
+#define FRSKY2WAY_CAL_ALL		((1ULL << FRSKY2WAY_HOP_NUM) - 1)
+#define FRSKY2WAY_CAL_NONE		0xFF
+
+// FSCAL3, FSCAL2 and FSCAL1 for each hop, recorded on first use
+static uint8_t frsky2way_fscal[FRSKY2WAY_HOP_NUM][3];
+// Bit set for each hop with recorded calibration
+static uint64_t frsky2way_cal_valid;
+// Hop calibrated by last TX or RX, its result is recorded on next hop
+static uint8_t frsky2way_cal_idx;
+// Hop index of the current telemetry receive window
+static uint8_t frsky2way_rx_idx;
+
+// arg 0: address
+static const cc2500_reg_t frsky2way_init_prog[] = {
+	CC2500_REG_ARG(CC2500_09_ADDR, 0),
+	CC2500_REG(CC2500_07_PKTCTRL1, 0x05),
+	CC2500_STROBE(CC2500_SIDLE),	// Go to idle...
+	CC2500_REG(CC2500_0A_CHANNR, 0x00),
+	CC2500_REG(CC2500_23_FSCAL3, 0x89),
+	CC2500_STROBE(CC2500_SFRX)
+};
+
+// Bind channel, or hop not yet recorded, calibrated on STX or SRX. arg 0: channel
+static const cc2500_reg_t frsky2way_cal_hop_prog[] = {
+	CC2500_STROBE(CC2500_SIDLE),
+	CC2500_REG_ARG(CC2500_0A_CHANNR, 0),
+	CC2500_REG(CC2500_23_FSCAL3, 0x89),
+	CC2500_STROBE(CC2500_SFRX)
+};
+
+// Hop before transmit, args: channel, FSCAL3, FSCAL2, FSCAL1
+static const cc2500_reg_t frsky2way_tx_hop_prog[] = {
+	CC2500_STROBE(CC2500_SIDLE),
+	CC2500_REG_ARG(CC2500_0A_CHANNR, 0),
+	CC2500_STROBE(CC2500_SFRX),
+	CC2500_REG_ARG(CC2500_23_FSCAL3, 1),
+	CC2500_REG_ARG(CC2500_24_FSCAL2, 2),
+	CC2500_REG_ARG(CC2500_25_FSCAL1, 3)
+};
+
+// Hop before telemetry receive, args: channel, FSCAL3, FSCAL2, FSCAL1
+static const cc2500_reg_t frsky2way_rx_hop_prog[] = {
+	CC2500_STROBE(CC2500_SIDLE),
+	CC2500_REG_ARG(CC2500_0A_CHANNR, 0),
+	CC2500_REG_ARG(CC2500_23_FSCAL3, 1),
+	CC2500_REG_ARG(CC2500_24_FSCAL2, 2),
+	CC2500_REG_ARG(CC2500_25_FSCAL1, 3)
+};
+
+/**
+ * @brief Until every hop has its synthesizer calibration recorded, hops
+ * leave calibration to the chip on going to TX or RX and the result is
+ * read back on the next hop. One hop is recorded per slot, so no callback
+ * waits on a calibration. Then automatic calibration is turned off and
+ * hops restore the recorded values.
+ *
+ * @return : 1 while hops are still calibrated by the chip
+ * */
+static uint8_t __attribute__((unused)) frsky2way_record(uint8_t idx)
+{
+	if(frsky2way_cal_valid == FRSKY2WAY_CAL_ALL)
+		return 0;
+
+	if(frsky2way_cal_idx != FRSKY2WAY_CAL_NONE)
+	{
+		frsky2way_fscal[frsky2way_cal_idx][0] = CC2500_ReadReg(CC2500_23_FSCAL3);
+		frsky2way_fscal[frsky2way_cal_idx][1] = CC2500_ReadReg(CC2500_24_FSCAL2);
+		frsky2way_fscal[frsky2way_cal_idx][2] = CC2500_ReadReg(CC2500_25_FSCAL1);
+		frsky2way_cal_valid |= 1ULL << frsky2way_cal_idx;
+	}
+
+	if(frsky2way_cal_valid == FRSKY2WAY_CAL_ALL)
+	{
+		CC2500_WriteReg(CC2500_18_MCSM0, 0x08);	// Calibration is done by hops
+		return 0;
+	}
+
+	frsky2way_cal_idx = idx;
+	return 1;
+}
+
+static uint8_t __attribute__((unused)) frsky2way_hop(uint8_t rx)
+{
+	uint8_t idx = radio.counter % FRSKY2WAY_HOP_NUM;
+
+	if(frsky2way_record(idx))
+	{
+		CC2500_PROGRAM(frsky2way_cal_hop_prog, &radio.hopping_frequency[idx]);
+		return idx;
+	}
+
+	uint8_t args[4] = {
+		radio.hopping_frequency[idx],
+		frsky2way_fscal[idx][0],
+		frsky2way_fscal[idx][1],
+		frsky2way_fscal[idx][2]
+	};
+
+	if(rx)
+		CC2500_PROGRAM(frsky2way_rx_hop_prog, args);
+	else
+		CC2500_PROGRAM(frsky2way_tx_hop_prog, args);
+	return idx;
+}
 
 static void __attribute__((unused)) frsky2way_init(uint8_t bind)
 {
-	FRSKY_init_cc2500(FRSKYD_cc2500_conf);	
+	uint8_t addr = bind ? 0x03 : radio.rx_tx_addr[3];
 
-	CC2500_WriteReg(CC2500_09_ADDR, bind ? 0x03 : radio.rx_tx_addr[3]);
-	CC2500_WriteReg(CC2500_07_PKTCTRL1, 0x05);
-	CC2500_Strobe(CC2500_SIDLE);	// Go to idle...
-	//
-	CC2500_WriteReg(CC2500_0A_CHANNR, 0x00);
-	CC2500_WriteReg(CC2500_23_FSCAL3, 0x89);
-	CC2500_Strobe(CC2500_SFRX);
+	FRSKY_init_cc2500(FRSKYD_cc2500_conf);	
+	CC2500_PROGRAM(frsky2way_init_prog, &addr);
+	frsky2way_cal_valid = 0;
+	frsky2way_cal_idx = FRSKY2WAY_CAL_NONE;
 	//#######END INIT########		
 }
 	
@@ -65,8 +177,8 @@ static void __attribute__((unused)) frsky2way_data_frame(void)
 	radio.packet[1] = radio.rx_tx_addr[3];
 	radio.packet[2] = radio.rx_tx_addr[2];
 	radio.packet[3] = radio.counter;//	
-	#if defined TELEMETRY
-		packet[4] = telemetry_counter;
+	#ifdef ENABLE_TELEMETRY
+		radio.packet[4] = telemetry_getCounter();
 	#else
 		radio.packet[4] = 0x00;
 	#endif
@@ -92,12 +204,18 @@ static void __attribute__((unused)) frsky2way_data_frame(void)
 			radio.packet[16+((i-4)>>1)] |= ((value >> 8) & 0x0f) << (4 * ((i-4) & 0x01));
 		}
 	}
+	#ifdef ENABLE_LATENCY
+		latency_txPrepare();
+	#endif
 } 
 
 uint16_t initFrSky_2way(void)
 {
 	Frsky_init_hop();
 	radio.packet_count = 0;
+	#ifdef ENABLE_TELEMETRY
+		telemetry_reset();
+	#endif
 	if(IS_BIND_IN_PROGRESS)
 	{
 		frsky2way_init(1);
@@ -114,11 +232,9 @@ uint16_t ReadFrSky_2way(void)
 { 
 	if (radio.state < FRSKY_BIND_DONE)
 	{
+		uint8_t chan = 0;
 		frsky2way_build_bind_packet();
-		CC2500_Strobe(CC2500_SIDLE);
-		CC2500_WriteReg(CC2500_0A_CHANNR, 0x00);
-		CC2500_WriteReg(CC2500_23_FSCAL3, 0x89);		
-		CC2500_Strobe(CC2500_SFRX);//0x3A
+		CC2500_PROGRAM(frsky2way_cal_hop_prog, &chan);
 		CC2500_WriteData(radio.packet, radio.packet[0]+1);
 		if(IS_BIND_DONE)
 			radio.state = FRSKY_BIND_DONE;
@@ -149,9 +265,7 @@ uint16_t ReadFrSky_2way(void)
 	if (radio.state == FRSKY_DATA4)
 	{	//telemetry receive
 		CC2500_SetTxRxMode(RX_EN);
-		CC2500_Strobe(CC2500_SIDLE);
-		CC2500_WriteReg(CC2500_0A_CHANNR, radio.hopping_frequency[radio.counter % 47]);
-		CC2500_WriteReg(CC2500_23_FSCAL3, 0x89);
+		frsky2way_rx_idx = frsky2way_hop(1);
 		radio.state++;
 		return 1300;
 	}
@@ -162,37 +276,36 @@ uint16_t ReadFrSky_2way(void)
 			#ifdef MULTI_SYNC
 				telemetry_set_input_sync(9000);
 			#endif
-			radio.len = CC2500_ReadReg(CC2500_3B_RXBYTES | CC2500_READ_BURST) & 0x7F;
-			if (radio.len && radio.len <= (0x11+3))// 20bytes
+			uint8_t rxbytes = CC2500_ReadReg(CC2500_3B_RXBYTES | CC2500_READ_BURST);
+			radio.len = rxbytes & 0x7F;
+			if (!(rxbytes & 0x80) && radio.len && radio.len <= (0x11+3))// 20bytes
 			{		
 				CC2500_ReadData(radio.packet_in, radio.len);				//received telemetry packets
-				#if defined(TELEMETRY)
-					if(radio.packet_in[len-1] & 0x80)
-					{//with valid crc
-						packet_count=0;
-						frsky_check_telemetry(packet_in,len);	//check if valid telemetry packets and buffer them.
-					}
+				#ifdef ENABLE_RF_STATS
+					rf_statsRx(frsky2way_rx_idx, (radio.packet_in[radio.len - 1] & 0x80) ? RF_RX_OK : RF_RX_BAD_CRC);
+				#endif
+				#ifdef ENABLE_TELEMETRY
+					if(telemetry_frskyPush(radio.packet_in, radio.len))	// valid packets are parsed from main loop
+						radio.packet_count = 0;
 				#endif
 			}
 			else
-			{
+			{	// FIFO is flushed on next hop
+				#ifdef ENABLE_RF_STATS
+					rf_statsRx(frsky2way_rx_idx, (rxbytes & 0x80) ? RF_RX_OVERFLOW : RF_RX_MISSED);
+				#endif
 				radio.packet_count++;
 				// restart sequence on missed packet - might need count or timeout instead of one missed
 				if(radio.packet_count > 100)
 				{//~1sec
 					radio.packet_count = 0;
-					#if defined TELEMETRY
-						telemetry_link=0;//no link frames
-						packet_in[6]=0;//no user frames.
-					#endif
 				}
 			}
 			CC2500_SetTxRxMode(TX_EN);
 			Frsky_SetPower();	// Set tx_power
 		}
 
-		CC2500_Strobe(CC2500_SIDLE);
-		CC2500_WriteReg(CC2500_0A_CHANNR, radio.hopping_frequency[radio.counter % 47]);
+		frsky2way_hop(0);
 		
 		if ( radio.prev_option != radio.option )
 		{
@@ -200,10 +313,11 @@ uint16_t ReadFrSky_2way(void)
 			radio.prev_option = radio.option ;
 		}
 		
-		CC2500_WriteReg(CC2500_23_FSCAL3, 0x89);
-		CC2500_Strobe(CC2500_SFRX);        
 		frsky2way_data_frame();
 		CC2500_WriteData(radio.packet, radio.packet[0]+1);
+		#ifdef ENABLE_RF_STATS
+			rf_statsTx();
+		#endif
 		radio.state++;
 	}				
 	return radio.state == FRSKY_DATA4 ? 7500 : 9000;		
@@ -22,38 +22,28 @@
 
 #include "board.h"
 #include "iface_cc2500.h"
-
-#define NOP()
+#ifdef ENABLE_LATENCY
+#include "latency.h"
+#endif
 
 //----------------------
 static void CC2500_ReadRegisterMulti(uint8_t address, uint8_t data[], uint8_t length)
 {
-	CC25_CS_TRUE;
-	SPI_Write(CC2500_READ_BURST | address);
-	for(uint8_t i = 0; i < length; i++)
-		data[i] = SPI_Read();
-	CC25_CS_FALSE;
+	SPI_Burst(CC2500_READ_BURST | address, NULL, data, length);
 }
 
 //--------------------------------------------
 uint8_t CC2500_ReadReg(uint8_t address)
 { 
 	uint8_t result;
-	CC25_CS_TRUE;
-	SPI_Write(CC2500_READ_SINGLE | address);
-	result = SPI_Read();  
-	CC25_CS_FALSE;
+	SPI_Burst(CC2500_READ_SINGLE | address, NULL, &result, 1);
 	return(result); 
 } 
 
 //------------------------
 static void CC2500_WriteRegisterMulti(uint8_t address, const uint8_t data[], uint8_t length)
 {
-	CC25_CS_TRUE;
-	SPI_Write(CC2500_WRITE_BURST | address);
-	for(uint8_t i = 0; i < length; i++)
-		SPI_Write(data[i]);
-	CC25_CS_FALSE;
+	SPI_Burst(CC2500_WRITE_BURST | address, data, NULL, length);
 }
 
 //*********************************************
@@ -65,9 +55,7 @@ void CC2500_ReadData(uint8_t *dpbuffer, uint8_t len)
 //------------------------
 void CC2500_Strobe(uint8_t state)
 {
-	CC25_CS_TRUE;
-	SPI_Write(state);
-	CC25_CS_FALSE;
+	SPI_Burst(state, NULL, NULL, 0);
 }
 
 //------------------------
@@ -76,16 +64,72 @@ void CC2500_WriteData(uint8_t *dpbuffer, uint8_t len)
 	CC2500_Strobe(CC2500_SFTX);
 	CC2500_WriteRegisterMulti(CC2500_3F_TXFIFO, dpbuffer, len);
 	CC2500_Strobe(CC2500_STX);
+#ifdef ENABLE_LATENCY
+	latency_txDone();
+#endif
+}
+
+//----------------------------
+static uint8_t CC2500_ProgramFlush(uint8_t *buf, uint8_t len)
+{
+	if(len)
+		SPI_Burst(buf[0], buf + 1, NULL, len - 1);
+	return 0;
+}
+
+/**
+ * @brief Execute register program.
+ * Single writes and strobes are chained on the same chip select window,
+ * writes to consecutive configuration registers are merged into one burst.
+ * A burst or a PATABLE access ends the window.
+ * 
+ * @param prog : program table
+ * @param len : number of entries
+ * @param args : values for CC2500_REG_ARG entries, can be NULL if not used
+ * */
+void CC2500_WriteProgram(const cc2500_reg_t *prog, uint8_t len, const uint8_t *args)
+{
+	uint8_t buf[CC2500_PROG_BUF_SIZE];
+	uint8_t n = 0, i = 0;
+
+	while(i < len)
+	{
+		uint8_t addr = prog[i].addr & ~CC2500_PROG_ARG;
+		uint8_t run = 1;
+
+		if(addr >= CC2500_SRES && addr <= CC2500_SNOP)
+		{	// strobe
+			if(n + 1 > CC2500_PROG_BUF_SIZE)
+				n = CC2500_ProgramFlush(buf, n);
+			buf[n++] = addr;
+			i++;
+			continue;
+		}
+
+		while(i + run < len && run < CC2500_PROG_BUF_SIZE - 1 &&
+			addr + run <= CC2500_2E_TEST0 &&
+			(prog[i + run].addr & ~CC2500_PROG_ARG) == addr + run)
+			run++;
+
+		if(n + run + 1 > CC2500_PROG_BUF_SIZE)
+			n = CC2500_ProgramFlush(buf, n);
+
+		buf[n++] = (run > 1) ? (CC2500_WRITE_BURST | addr) : addr;
+
+		for(uint8_t end = i + run; i < end; i++)
+			buf[n++] = (prog[i].addr & CC2500_PROG_ARG) ? args[prog[i].value] : prog[i].value;
+
+		if(run > 1 || addr == CC2500_3E_PATABLE)
+			n = CC2500_ProgramFlush(buf, n);
+	}
+
+	CC2500_ProgramFlush(buf, n);
 }
 
 //----------------------------
 void CC2500_WriteReg(uint8_t address, uint8_t data)
 {
-	CC25_CS_TRUE;
-	SPI_Write(address); 
-	NOP();
-	SPI_Write(data);
-	CC25_CS_FALSE;
+	SPI_Burst(address, &data, NULL, 1);
 }
 
 //------------------------
@@ -156,10 +200,7 @@ void CC2500_SetPower(uint8_t power)
 
 uint8_t CC2500_ReadStatus(uint8_t sreg){
 uint8_t data;
-	CC25_CS_TRUE;
-	SPI_Write(CC2500_READ_BURST | sreg);
-	data = SPI_Read();  
-	CC25_CS_FALSE;
+	SPI_Burst(CC2500_READ_BURST | sreg, NULL, &data, 1);
 	return data;
 }
 
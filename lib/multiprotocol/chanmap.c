@@ -0,0 +1,39 @@
+#include "chanmap.h"
+
+/**
+ * @brief Compile transform from ranges
+ * 
+ * @param map : transform to be filled
+ * @param in_min, in_max : input range
+ * @param out_min, out_max : output range
+ * @param lo : value for results with bit 15 set
+ * @param hi : upper clamp
+ * */
+void chanmap_compile(chanmap_t *map, int16_t in_min, int16_t in_max, int16_t out_min, int16_t out_max, uint16_t lo, uint16_t hi){
+    int32_t num = out_max - out_min;
+    int32_t den = in_max - in_min;
+
+    map->in_min = in_min;
+    map->out_min = out_min;
+    map->lo = lo;
+    map->hi = hi;
+    map->neg = ((num < 0) != (den < 0)) ? 0xFFFFFFFF : 0;
+
+    if(num < 0){
+        num = -num;
+    }
+
+    if(den < 0){
+        den = -den;
+    }
+
+    if(den == 0){
+        // Cortex-M divide by zero gives zero
+        map->whole = 0;
+        map->frac = 0;
+        return;
+    }
+
+    map->whole = num / den;
+    map->frac = (uint32_t)((((uint64_t)(num % den) << 32) + den - 1) / den);
+}
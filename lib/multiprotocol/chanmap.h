@@ -0,0 +1,70 @@
+#ifndef _CHANMAP_H_
+#define _CHANMAP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Linear channel transform compiled from calibration ranges.
+ * Gives the same result as the integer map
+ *  (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min
+ * with 16 bit wrap on (x - in_min) and on the result, but replaces the
+ * division by an integer multiply plus a 0.32 fractional multiply.
+ *
+ * The fraction is rounded up, for |x - in_min| <= 32768 the error it
+ * adds stays below one step of (in_max - in_min), so rounding never changes.
+ * */
+typedef struct chanmap{
+    uint32_t whole;                     // integer part of |out range / in range|
+    uint32_t frac;                      // fractional part, 0.32 fixed point
+    uint16_t in_min;
+    uint16_t out_min;
+    uint16_t lo;                        // output for negative results
+    uint16_t hi;                        // upper clamp
+    uint32_t neg;                       // all ones if ranges have opposite directions
+}chanmap_t;
+
+/* Constant transform for positive ratio num/den, without clamping */
+#define CHANMAP_RATIO(_in_min, _out_min, _num, _den) { \
+    .whole = (_num) / (_den), \
+    .frac = (uint32_t)((((uint64_t)((_num) % (_den)) << 32) + (_den) - 1) / (_den)), \
+    .in_min = (_in_min), \
+    .out_min = (_out_min), \
+    .lo = 0, \
+    .hi = 0xFFFF, \
+    .neg = 0 }
+
+void chanmap_compile(chanmap_t *map, int16_t in_min, int16_t in_max, int16_t out_min, int16_t out_max, uint16_t lo, uint16_t hi);
+
+/**
+ * @brief Apply transform, multiply-shift-clamp
+ * 
+ * @param map : compiled transform
+ * @param x : input value
+ * @return : mapped value, lo if negative, hi if above it
+ * */
+static inline uint16_t chanmap_apply(const chanmap_t *map, uint16_t x){
+    int32_t d = (int16_t)(x - map->in_min);
+    uint32_t s = (uint32_t)(d >> 31);                   // all ones if negative
+    uint32_t a = ((uint32_t)d ^ s) - s;
+    uint32_t q = a * map->whole + (uint32_t)(((uint64_t)a * map->frac) >> 32);
+    uint16_t v;
+
+    s ^= map->neg;                                      // sign of the result
+    q = (q ^ s) - s;
+    v = (uint16_t)(q + map->out_min);
+
+    if(v & 0x8000){
+        return map->lo;
+    }
+    return (v > map->hi) ? map->hi : v;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHANMAP_H_ */
@@ -141,12 +141,40 @@ enum {
 #define CC2500_STATE_RX_OVERFLOW               0x60
 #define CC2500_STATE_TX_UNDERFLOW              0x70
 
+// Main radio control state, MARCSTATE register
+#define CC2500_MARCSTATE_IDLE                  0x01
+
 //----------------------------------------------------------------------------------
 // Other register bit fields
 //----------------------------------------------------------------------------------
 #define CC2500_LQI_CRC_OK_BM                   0x80
 #define CC2500_LQI_EST_BM                      0x7F
 
+//----------------------------------------------------------------------------------
+// Register programs
+//----------------------------------------------------------------------------------
+
+/**
+ * Sequence of register writes and strobes declared as a constant table.
+ * Entries with CC2500_PROG_ARG on address take their value from the
+ * argument list given to CC2500_WriteProgram, value holds the argument index.
+ * SRES must not be used, the chip is not ready right after it.
+ * */
+typedef struct cc2500_reg{
+	uint8_t addr;
+	uint8_t value;
+}cc2500_reg_t;
+
+#define CC2500_PROG_ARG			0x80
+#define CC2500_PROG_BUF_SIZE	32			// bytes sent on a single chip select window
+
+#define CC2500_REG(_reg, _val)		{ (_reg), (_val) }
+#define CC2500_REG_ARG(_reg, _n)	{ (_reg) | CC2500_PROG_ARG, (_n) }
+#define CC2500_STROBE(_cmd)			{ (_cmd), 0 }
+
+#define CC2500_PROGRAM(_prog, _args)	CC2500_WriteProgram(_prog, sizeof(_prog) / sizeof(cc2500_reg_t), _args)
+
+void CC2500_WriteProgram(const cc2500_reg_t *prog, uint8_t len, const uint8_t *args);
 void CC2500_WriteReg(uint8_t address, uint8_t data);
 uint8_t CC2500_ReadReg(uint8_t addr);
 uint8_t CC2500_Reset(void);
@@ -0,0 +1,73 @@
+#include <string.h>
+#include "board.h"
+#include "latency.h"
+
+#define LATENCY_STAMP_VALID     (1 << 0)
+
+typedef struct latency_stamp{
+    volatile uint16_t ticks;
+    volatile uint8_t flags;
+}latency_stamp_t;
+
+static latency_stamp_t data_stamp;      // frame currently on channel_data
+static latency_stamp_t tx_stamp;        // frame on packet being sent
+static latency_stats_t latency;
+
+/**
+ * @brief Clear measurements
+ * */
+void latency_reset(void){
+    memset(&latency, 0, sizeof(latency_stats_t));
+    latency.min = 0xFFFF;
+}
+
+/**
+ * @brief Frame data was copied to channel_data
+ * 
+ * @param ticks : TIMER_BASE value when the frame was received
+ * */
+void latency_frameUsed(uint16_t ticks){
+    data_stamp.ticks = ticks;
+    data_stamp.flags = LATENCY_STAMP_VALID;
+}
+
+/**
+ * @brief channel_data was copied to the packet buffer,
+ * only the first packet after a new frame is measured
+ * */
+void latency_txPrepare(void){
+    tx_stamp.ticks = data_stamp.ticks;
+    tx_stamp.flags = data_stamp.flags;
+    data_stamp.flags = 0;
+}
+
+/**
+ * @brief Packet transmission started, called after STX strobe
+ * */
+void latency_txDone(void){
+    uint16_t ticks;
+
+    if(!(tx_stamp.flags & LATENCY_STAMP_VALID)){
+        return;
+    }
+
+    tx_stamp.flags = 0;
+    ticks = TIMER_BASE->CNT - tx_stamp.ticks;
+
+    latency.ring[latency.head] = ticks;
+    latency.head = (latency.head + 1) & (LATENCY_RING_SIZE - 1);
+    latency.count++;
+    latency.sum += ticks;
+
+    if(ticks < latency.min){
+        latency.min = ticks;
+    }
+
+    if(ticks > latency.max){
+        latency.max = ticks;
+    }
+}
+
+latency_stats_t *latency_getStats(void){
+    return &latency;
+}
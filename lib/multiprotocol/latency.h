@@ -0,0 +1,36 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Stick to air latency, measured from the PPM frame callback
+ * to the STX strobe of the first packet carrying that frame.
+ * Values are in TIMER_BASE ticks (0.5us)
+ * */
+#define LATENCY_RING_SIZE       64      // power of two
+
+typedef struct latency_stats{
+    uint32_t count;
+    uint64_t sum;
+    uint16_t min;
+    uint16_t max;
+    uint16_t ring[LATENCY_RING_SIZE];   // last measurements
+    uint16_t head;                      // next write position
+}latency_stats_t;
+
+void latency_reset(void);
+void latency_frameUsed(uint16_t ticks);
+void latency_txPrepare(void);
+void latency_txDone(void);
+latency_stats_t *latency_getStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LATENCY_H_ */
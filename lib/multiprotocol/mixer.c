@@ -0,0 +1,214 @@
+#include <string.h>
+#include "multiprotocol.h"
+#include "mixer.h"
+
+typedef struct mixer_state{
+    int16_t  lut[MIXER_CURVES][MIXER_RATES][MIXER_CURVE_POINTS + 1];   // last point repeated for interpolation
+    int16_t  trim[MIXER_CURVES];
+    uint8_t  rate_sw[MIXER_CURVES];
+    mixer_line_t line[MIXER_LINES];
+    int32_t  weight[MIXER_LINES];
+    uint8_t  lines;
+    uint16_t dst_mask;                  // channels replaced by mix lines
+    int32_t  center;
+    int32_t  lo;
+    int32_t  hi;
+}mixer_state_t;
+
+static mixer_model_t mixer_model;
+static mixer_state_t mixer;
+
+/**
+ * @brief Model without mixes, linear sticks and no trims
+ * */
+void mixer_default(mixer_model_t *model){
+    memset(model, 0, sizeof(mixer_model_t));
+
+    for(uint8_t i = 0; i < MIXER_CURVES; i++){
+        for(uint8_t r = 0; r < MIXER_RATES; r++){
+            model->curve[i].rate[r] = 100;
+        }
+        model->curve[i].sw = MIXER_NO_SWITCH;
+    }
+}
+
+/**
+ * @brief Append a mix line
+ *
+ * @return : 1 on success, 0 if table is full or channels are invalid
+ * */
+uint8_t mixer_addLine(mixer_model_t *model, uint8_t src, uint8_t dst, int8_t weight, uint8_t sw){
+    if(model->lines >= MIXER_LINES || src >= MAX_CHN_NUM || dst >= MAX_CHN_NUM){
+        return 0;
+    }
+
+    model->line[model->lines].src = src;
+    model->line[model->lines].dst = dst;
+    model->line[model->lines].weight = weight;
+    model->line[model->lines].sw = sw;
+    model->lines++;
+    return 1;
+}
+
+/**
+ * @brief Replace mix lines by one of the classic surface mixes,
+ * curves and trims are kept.
+ *  V-tail: elevator and rudder outputs drive the two tail surfaces
+ *  Elevon: aileron and elevator outputs drive the two wing surfaces
+ * */
+void mixer_preset(mixer_model_t *model, uint8_t preset){
+    model->lines = 0;
+    model->preset = preset;
+
+    switch(preset){
+        case MIXER_PRESET_VTAIL:
+            mixer_addLine(model, ELEVATOR, ELEVATOR, 50, MIXER_NO_SWITCH);
+            mixer_addLine(model, RUDDER, ELEVATOR, -50, MIXER_NO_SWITCH);
+            mixer_addLine(model, ELEVATOR, RUDDER, 50, MIXER_NO_SWITCH);
+            mixer_addLine(model, RUDDER, RUDDER, 50, MIXER_NO_SWITCH);
+            break;
+
+        case MIXER_PRESET_ELEVON:
+            mixer_addLine(model, ELEVATOR, AILERON, 50, MIXER_NO_SWITCH);
+            mixer_addLine(model, AILERON, AILERON, 50, MIXER_NO_SWITCH);
+            mixer_addLine(model, ELEVATOR, ELEVATOR, 50, MIXER_NO_SWITCH);
+            mixer_addLine(model, AILERON, ELEVATOR, -50, MIXER_NO_SWITCH);
+            break;
+
+        default:
+            model->preset = MIXER_PRESET_NONE;
+            break;
+    }
+}
+
+/**
+ * @brief Fill curve table, rate * ((1 - expo) * x + expo * x^3)
+ * with x normalized to the 100% span
+ * */
+static void mixer_curveCompile(int16_t *lut, int8_t expo, uint8_t rate, int32_t span){
+    int64_t den = (int64_t)100 * 100 * span * span;
+
+    for(uint32_t i = 0; i < MIXER_CURVE_POINTS; i++){
+        int64_t x = i << MIXER_CURVE_SHIFT;
+        int64_t num = rate * ((100 - expo) * x * span * span + expo * x * x * x);
+        int64_t y;
+
+        // rounded to nearest
+        y = (num >= 0) ? (num + den / 2) / den : (num - den / 2) / den;
+
+        if(y > INT16_MAX){
+            y = INT16_MAX;
+        }else if(y < INT16_MIN){
+            y = INT16_MIN;
+        }
+
+        lut[i] = y;
+    }
+    lut[MIXER_CURVE_POINTS] = lut[MIXER_CURVE_POINTS - 1];
+}
+
+/**
+ * @brief Build tables from model, must be called when model or calibration changes
+ *
+ * @param model : mixer configuration
+ * @param ch_min, ch_max : 100% channel range
+ * @param lo, hi : output limits
+ * */
+void mixer_compile(const mixer_model_t *model, uint16_t ch_min, uint16_t ch_max, uint16_t lo, uint16_t hi){
+    int32_t span = (ch_max - ch_min) / 2;
+
+    if(span <= 0){
+        span = 1;
+    }
+
+    mixer.center = (ch_max + ch_min) / 2;
+    mixer.lo = lo;
+    mixer.hi = hi;
+
+    for(uint8_t i = 0; i < MIXER_CURVES; i++){
+        const mixer_curve_t *curve = &model->curve[i];
+
+        for(uint8_t r = 0; r < MIXER_RATES; r++){
+            mixer_curveCompile(mixer.lut[i][r], curve->expo[r], curve->rate[r], span);
+        }
+
+        mixer.rate_sw[i] = curve->sw;
+        mixer.trim[i] = model->trim[i];
+    }
+
+    mixer.dst_mask = 0;
+    mixer.lines = (model->lines > MIXER_LINES) ? MIXER_LINES : model->lines;
+
+    for(uint8_t i = 0; i < mixer.lines; i++){
+        mixer.line[i] = model->line[i];
+        mixer.weight[i] = (model->line[i].weight * (1 << MIXER_WEIGHT_SHIFT)) / 100;
+        mixer.dst_mask |= 1 << model->line[i].dst;
+    }
+}
+
+static inline uint8_t mixer_switchOn(uint8_t sw, uint8_t aux){
+    return sw != MIXER_NO_SWITCH && (aux & (1 << sw));
+}
+
+static inline int32_t mixer_curve(const int16_t *lut, int32_t x){
+    uint32_t a = (x < 0) ? -x : x;
+    uint32_t i, f;
+    int32_t y;
+
+    if(a > 1024){
+        a = 1024;
+    }
+
+    i = a >> MIXER_CURVE_SHIFT;
+    f = a & ((1 << MIXER_CURVE_SHIFT) - 1);
+    y = lut[i] + (((lut[i + 1] - lut[i]) * (int32_t)f) >> MIXER_CURVE_SHIFT);
+
+    return (x < 0) ? -y : y;
+}
+
+/**
+ * @brief Mix one set of channels
+ *
+ * @param in : channel values from inputs
+ * @param out : mixed channels for packet builders, MAX_CHN_NUM values
+ * @param aux : aux switch states, bit per switch
+ * */
+void mixer_process(const uint16_t *in, uint16_t *out, uint8_t aux){
+    int32_t x[MAX_CHN_NUM];
+    int32_t acc[MAX_CHN_NUM];
+
+    for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+        x[i] = in[i] - mixer.center;
+    }
+
+    for(uint8_t i = 0; i < MIXER_CURVES; i++){
+        uint8_t r = mixer_switchOn(mixer.rate_sw[i], aux);
+        x[i] = mixer_curve(mixer.lut[i][r], x[i]) + mixer.trim[i];
+    }
+
+    for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+        acc[i] = (mixer.dst_mask & (1 << i)) ? 0 : x[i] * (1 << MIXER_WEIGHT_SHIFT);
+    }
+
+    for(uint8_t i = 0; i < mixer.lines; i++){
+        const mixer_line_t *line = &mixer.line[i];
+        if(line->sw == MIXER_NO_SWITCH || mixer_switchOn(line->sw, aux)){
+            acc[line->dst] += x[line->src] * mixer.weight[i];
+        }
+    }
+
+    for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+        int32_t v = mixer.center + ((acc[i] + (1 << (MIXER_WEIGHT_SHIFT - 1))) >> MIXER_WEIGHT_SHIFT);
+
+        if(v < mixer.lo){
+            v = mixer.lo;
+        }else if(v > mixer.hi){
+            v = mixer.hi;
+        }
+        out[i] = v;
+    }
+}
+
+mixer_model_t *mixer_getModel(void){
+    return &mixer_model;
+}
@@ -0,0 +1,70 @@
+#ifndef _MIXER_H_
+#define _MIXER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Mixer stage between Update_All() and the packet builders.
+ *
+ * Inputs are channel values centered on the middle of the 100% range.
+ * The first MIXER_CURVES inputs (sticks) go through an expo/rate curve,
+ * selected by an aux switch for dual rate, and get the model trim added.
+ * Channels that are destination of a mix line are replaced by the
+ * weighted sum of their lines, all others are passed through.
+ *
+ * Curves and weights are compiled to lookup tables and fixed point
+ * factors, so processing is a fixed number of table reads, multiplies
+ * and shifts: at most MIXER_CURVES + MIXER_LINES + MAX_CHN_NUM steps.
+ * */
+#define MIXER_LINES             16
+#define MIXER_CURVES            4       // AETR sticks
+#define MIXER_CURVE_SHIFT       4       // 16 input steps per table point
+#define MIXER_CURVE_POINTS      ((1024 >> MIXER_CURVE_SHIFT) + 1)
+#define MIXER_WEIGHT_SHIFT      10      // weights in 1/1024
+#define MIXER_RATES             2       // dual rate
+#define MIXER_NO_SWITCH         0xFF
+#define MIXER_TRIM_MAX          200
+
+enum mixer_preset{
+    MIXER_PRESET_NONE = 0,
+    MIXER_PRESET_VTAIL,
+    MIXER_PRESET_ELEVON
+};
+
+typedef struct mixer_curve{
+    int8_t  expo[MIXER_RATES];          // percent, -100 to 100
+    uint8_t rate[MIXER_RATES];          // percent, 0 to 125
+    uint8_t sw;                         // aux switch selecting second rate
+}mixer_curve_t;
+
+typedef struct mixer_line{
+    uint8_t src;                        // input channel
+    uint8_t dst;                        // output channel
+    int8_t  weight;                     // percent, -125 to 125
+    uint8_t sw;                         // aux switch enabling the line, MIXER_NO_SWITCH for always
+}mixer_line_t;
+
+typedef struct mixer_model{
+    uint8_t preset;
+    uint8_t lines;
+    mixer_line_t line[MIXER_LINES];
+    mixer_curve_t curve[MIXER_CURVES];
+    int16_t trim[MIXER_CURVES];         // channel units
+}mixer_model_t;
+
+void mixer_default(mixer_model_t *model);
+void mixer_preset(mixer_model_t *model, uint8_t preset);
+uint8_t mixer_addLine(mixer_model_t *model, uint8_t src, uint8_t dst, int8_t weight, uint8_t sw);
+void mixer_compile(const mixer_model_t *model, uint16_t ch_min, uint16_t ch_max, uint16_t lo, uint16_t hi);
+void mixer_process(const uint16_t *in, uint16_t *out, uint8_t aux);
+mixer_model_t *mixer_getModel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MIXER_H_ */
@@ -0,0 +1,110 @@
+#include <string.h>
+#include "board.h"
+#include "nvjournal.h"
+#include "multiprotocol.h"
+#include "model.h"
+
+_Static_assert((sizeof(model_record_t) & 3) == 0, "model record must be word aligned");
+_Static_assert(MODEL_STORE_OFFSET + MODEL_NUM * sizeof(model_record_t) <= NVJ_SIZE, "models do not fit on eeprom");
+
+static uint16_t model_address(uint8_t slot){
+    return MODEL_STORE_OFFSET + slot * sizeof(model_record_t);
+}
+
+static uint32_t model_crc(const model_record_t *record){
+    return crcCalc((const uint32_t*)record, (sizeof(model_record_t) - sizeof(uint32_t)) / 4);
+}
+
+/**
+ * @brief Reject values that would stall channel transforms or index
+ * out of tables, even if CRC matches.
+ * */
+static uint8_t model_valid(const model_t *model){
+    const mixer_model_t *mixer = &model->mixer;
+
+    if(model->calib[MODEL_CH_MIN_100] >= model->calib[MODEL_CH_MAX_100] ||
+       model->calib[MODEL_CH_MIN_125] >= model->calib[MODEL_CH_MAX_125] ||
+       model->calib[MODEL_PPM_MIN_100] >= model->calib[MODEL_PPM_MAX_100]){
+        return 0;
+    }
+
+    if(mixer->preset > MIXER_PRESET_ELEVON || mixer->lines > MIXER_LINES){
+        return 0;
+    }
+
+    for(uint8_t i = 0; i < mixer->lines; i++){
+        if(mixer->line[i].src >= MAX_CHN_NUM || mixer->line[i].dst >= MAX_CHN_NUM){
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Read model from slot
+ *
+ * @param slot : 0 to MODEL_NUM - 1
+ * @param model : destination, only written if record is good
+ * @return : 1 on success, 0 if slot is empty or record is damaged
+ * */
+uint8_t model_load(uint8_t slot, model_t *model){
+    model_record_t record;
+
+    if(slot >= MODEL_NUM){
+        return 0;
+    }
+
+    if(EEPROM_Read(model_address(slot), (uint8_t*)&record, sizeof(model_record_t)) != sizeof(model_record_t)){
+        return 0;
+    }
+
+    if(record.magic != MODEL_MAGIC || record.version != MODEL_VERSION ||
+       record.slot != slot || record.size != sizeof(model_t)){
+        return 0;
+    }
+
+    if(record.crc != model_crc(&record) || !model_valid(&record.model)){
+        return 0;
+    }
+
+    memcpy(model, &record.model, sizeof(model_t));
+    return 1;
+}
+
+/**
+ * @brief Write model to slot, it goes to flash on next eeprom sync
+ *
+ * @return : 1 on success
+ * */
+uint8_t model_save(uint8_t slot, const model_t *model){
+    model_record_t record;
+
+    if(slot >= MODEL_NUM || !model_valid(model)){
+        return 0;
+    }
+
+    memset(&record, 0, sizeof(model_record_t));
+    record.magic = MODEL_MAGIC;
+    record.version = MODEL_VERSION;
+    record.slot = slot;
+    record.size = sizeof(model_t);
+    memcpy(&record.model, model, sizeof(model_t));
+    record.crc = model_crc(&record);
+
+    return EEPROM_Write(model_address(slot), (uint8_t*)&record, sizeof(model_record_t)) == sizeof(model_record_t);
+}
+
+/**
+ * @brief Clear slot on next eeprom sync, an erased record never passes the checks
+ * */
+uint8_t model_erase(uint8_t slot){
+    model_record_t record;
+
+    if(slot >= MODEL_NUM){
+        return 0;
+    }
+
+    memset(&record, 0xFF, sizeof(model_record_t));
+    return EEPROM_Write(model_address(slot), (uint8_t*)&record, sizeof(model_record_t)) == sizeof(model_record_t);
+}
@@ -0,0 +1,72 @@
+#ifndef _MODEL_H_
+#define _MODEL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "mixer.h"
+
+/**
+ * Model memory, kept on the emulated eeprom after the settings block.
+ *
+ * Each slot holds one record with everything that differs between
+ * models: protocol line, calibration and mixer. Records carry a version,
+ * their own size and a CRC-32 computed by the CRC unit, a record that
+ * fails any check is reported as empty and the radio falls back
+ * to the protocol table selected by the switches.
+ * */
+#define MODEL_NUM               4
+#define MODEL_NONE              0xFF
+#define MODEL_VERSION           1
+#define MODEL_MAGIC             0x4D4C      // "LM"
+#define MODEL_NAME_LEN          8
+#define MODEL_STORE_OFFSET      64          // first record on eeprom
+
+/* Calibration words, same order as on eeprom from IDX_CHANNEL_MAX_100 */
+enum model_calib{
+    MODEL_CH_MAX_100 = 0,
+    MODEL_CH_MIN_100,
+    MODEL_CH_MAX_125,
+    MODEL_CH_MIN_125,
+    MODEL_PPM_MAX_100,
+    MODEL_PPM_MIN_100,
+    MODEL_CH_SWITCH,
+    MODEL_PPM_DEFAULT,
+    MODEL_CALIB_NUM
+};
+
+typedef struct model{
+    char     name[MODEL_NAME_LEN];      // not terminated when full
+    uint8_t  protocol;
+    uint8_t  sub_protocol;
+    uint8_t  rx_num;
+    int8_t   option;
+    uint8_t  power;
+    uint8_t  autobind;
+    uint8_t  reserved[2];
+    uint32_t chan_order;
+    uint16_t calib[MODEL_CALIB_NUM];
+    mixer_model_t mixer;
+}model_t;
+
+typedef struct model_record{
+    uint16_t magic;
+    uint8_t  version;
+    uint8_t  slot;
+    uint16_t size;                      // sizeof(model_t) when written
+    uint16_t reserved;
+    model_t  model;
+    uint32_t crc;                       // over all previous words
+}model_record_t;
+
+uint8_t model_load(uint8_t slot, model_t *model);
+uint8_t model_save(uint8_t slot, const model_t *model);
+uint8_t model_erase(uint8_t slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MODEL_H_ */
@@ -22,9 +22,34 @@
  along with Multiprotocol.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string.h>
 #include "app.h"
 #include "multiprotocol.h"
 #include "FrSkyDVX_Common.h"
+#include "chanmap.h"
+#ifdef ENABLE_SCHED_STATS
+#include "sched_stats.h"
+#endif
+#ifdef ENABLE_LATENCY
+#include "latency.h"
+#endif
+#ifdef ENABLE_TELEMETRY
+#include "telemetry.h"
+#endif
+#ifdef ENABLE_RF_STATS
+#include "rf_stats.h"
+#endif
+#include "mixer.h"
+#include "model.h"
+#ifdef ENABLE_TRACE
+#include "trace.h"
+#endif
+#ifdef ENABLE_DISPLAY
+#include "livepanel.h"
+#endif
+
+#define EEPROM_GUARD_US         400     // kept free before callback when saving eeprom
+#define DISPLAY_GUARD_US        200     // kept free before callback when drawing live screen
 
 //Personal config file
 #if defined(USE_MY_CONFIG)
@@ -32,14 +57,20 @@
 #endif
 
 radio_t radio;
+static chanmap_t ppm_map;
+#ifdef ENABLE_PPM
+static const PPM_Parameters *ppm_prot_line;
+#endif
 
 static uint8_t Update_All(void);
 static void modules_reset(void);
 //static void update_serial_data(void);
 static void protocol_init(void);
 static void update_led_status(void);
-int16_t map16b( int16_t x, int16_t in_min, int16_t in_max, int16_t out_min, int16_t out_max);
+static void ppm_mapCompile(void);
 static uint32_t random_id(uint8_t create_new);
+static void table_model(model_t *model, const PPM_Parameters *line);
+static void apply_model(const model_t *model);
 
 //Channel mapping for protocols
 uint8_t CH_AETR[]={AILERON, ELEVATOR, THROTTLE, RUDDER, CH5, CH6, CH7, CH8, CH9, CH10, CH11, CH12, CH13, CH14, CH15, CH16};
@@ -83,6 +114,18 @@ void multiprotocol_setup(void){
     radio.channel_data[THROTTLE] = eeprom_data[IDX_CHANNEL_MIN_125] ;
 
     modules_reset();
+    ppm_mapCompile();
+#ifdef ENABLE_MIXER
+    mixer_default(mixer_getModel());
+    update_mixer();
+#endif
+
+#ifdef ENABLE_SCHED_STATS
+    sched_statsReset();
+#endif
+#ifdef ENABLE_LATENCY
+    latency_reset();
+#endif
     
     radio.protocol_id_master = random_id(0);
     DBG_PRINT("Module Id: %lx\n", radio.protocol_id_master);
@@ -95,31 +138,26 @@ void multiprotocol_setup(void){
 
     if(radio.mode_select != MODE_SERIAL)
     { // PPM
+        model_t model;
+
         #ifdef MY_PPM_PROT
-			const PPM_Parameters *PPM_prot_line = &My_PPM_prot[ bank * 14 + radio.mode_select -1];
+			ppm_prot_line = &My_PPM_prot[ bank * 14 + radio.mode_select -1];
 		#else
-			const PPM_Parameters *PPM_prot_line = &PPM_prot[bank * 14 + radio.mode_select - 1];
+			ppm_prot_line = &PPM_prot[bank * 14 + radio.mode_select - 1];
 		#endif
 
-        radio.protocol          = PPM_prot_line->protocol;
-        radio.cur_protocol[1]   = radio.protocol;
-        radio.sub_protocol      = PPM_prot_line->sub_proto;
-        radio.rx_num            = PPM_prot_line->rx_num;
-        radio.chan_order        = PPM_prot_line->chan_order;
-
-        radio.option = (uint8_t)PPM_prot_line->option;	// Use radio-defined option value
-        
-        radio.prev_power = 0xFD; // unused power value
-		
-        if(PPM_prot_line->power){
-            POWER_FLAG_on;
-        }
+        table_model(&model, ppm_prot_line);
 
-        if(PPM_prot_line->autobind){
-			AUTOBIND_FLAG_on;
-			BIND_IN_PROGRESS;	// Force a bind at protocol startup
-		}       
+        #ifdef ENABLE_MODELS
+            uint8_t slot = *((uint8_t*)eeprom_data + IDX_MODEL);
+            if(slot != MODEL_NONE && !model_load(slot, &model)){
+                // Damaged or missing record, keep switch selection
+                DBG_PRINT("Model %u not valid\n", slot);
+                *((uint8_t*)eeprom_data + IDX_MODEL) = MODEL_NONE;
+            }
+        #endif
 
+        apply_model(&model);
         protocol_init();
     }
 #endif    
@@ -133,18 +171,33 @@ uint16_t next_callback, diff;
 uint8_t count=0;
             
     while(radio.remote_callback == NULL || IS_WAIT_BIND_on || IS_INPUT_SIGNAL_off){		
+        appIdle(0);                         // wait for input or next tick
+        appProcessEEPROM(NVJ_NO_LIMIT, 1);  // no packets are sent, flash can stall
+#ifdef ENABLE_DISPLAY
+        appProcessDisplay(LIVE_NO_LIMIT);
+#endif
         if(!Update_All())
         {
             cli();								// Disable global int due to RW of 16 bits registers
             #ifndef STM32_BOARD	
             OCR1A=TCNT1;						// Callback should already have been called... Use "now" as new sync point.
             #else
-            TIMER_BASE->CCR1 = TIMER_BASE->CNT;
+            TIMER_BASE->TIMER_BASE_CCR = TIMER_BASE->CNT;
             #endif
             sei();								// Enable global int
         }
         return;
     }
+
+#ifdef ENABLE_SCHED_STATS
+    sched_statsLate(TIMER_BASE->CNT - TIMER_BASE->TIMER_BASE_CCR);
+#endif
+#ifdef ENABLE_RF_STATS
+    rf_statsCallback(TIMER_BASE->CNT - TIMER_BASE->TIMER_BASE_CCR);
+#endif
+#ifdef ENABLE_TRACE
+    uint16_t cb_start = trace_isEnabled() ? TIMER_BASE->CNT : 0;
+#endif
     
     next_callback = radio.remote_callback() << 1;
  
@@ -152,43 +205,72 @@ uint8_t count=0;
     #ifndef STM32_BOARD			
     TIFR1=OCF1A_bm;							        // Clear compare A=callback flag
     #else
-    TIMER_BASE->CCR1 += next_callback;			    // Calc when next_callback should happen
-    TIMER_BASE->SR = 0x1E5F & ~TIM_SR_CC1IF;	    // Clear Timer2/Comp1 interrupt flag
-    diff = TIMER_BASE->CCR1 - TIMER_BASE->CNT;	    // Calc the time difference
+    TIMER_BASE->TIMER_BASE_CCR += next_callback;			    // Calc when next_callback should happen
+    TIMER_BASE->SR = 0x1E5F & ~TIMER_BASE_CCIF;	    // Clear Timer2/Comp1 interrupt flag
+    diff = TIMER_BASE->TIMER_BASE_CCR - TIMER_BASE->CNT;	    // Calc the time difference
     #endif		
     sei();										    // Enable global int
+#ifdef ENABLE_TRACE
+    if(trace_isEnabled()){
+        // deadline of this callback is next one minus its interval
+        trace_callback(cb_start, cb_start - (uint16_t)(TIMER_BASE->TIMER_BASE_CCR - next_callback), next_callback);
+    }
+#endif
     if((diff&0x8000) && !(next_callback&0x8000))
     { // Negative result=callback should already have been called... 
         DBG_PRINT("Short CB:%d\n", next_callback);
+#ifdef ENABLE_SCHED_STATS
+        sched_statsShortCB();
+#endif
     }
     else
     {
+#ifdef ENABLE_SCHED_STATS
+        sched_statsSlack(diff);
+#endif
         if(IS_RX_FLAG_on || IS_PPM_FLAG_on)
         { // Serial or PPM is waiting...
             if(++count>10)
             { //The protocol does not leave enough time for an update so forcing it
                 count=0;
                 DBG_PRINT("Force update\n");
+#ifdef ENABLE_SCHED_STATS
+                sched_statsForceUpdate();
+#endif
                 Update_All();
             }
         }
         #ifndef STM32_BOARD
             while((TIFR1 & OCF1A_bm) == 0)
         #else
-        while((TIMER_BASE->SR & TIM_SR_CC1IF ) == 0)
+        while((TIMER_BASE->SR & TIMER_BASE_CCIF ) == 0)
         #endif
         {
+            cli();								// Time left changed while idle, read it again
+            #ifndef STM32_BOARD
+            diff = OCR1A-TCNT1;
+            #else
+            diff = TIMER_BASE->TIMER_BASE_CCR - TIMER_BASE->CNT;
+            #endif
+            sei();
+            if(diff&0x8000)
+            {	// Compare passed after the flag was tested, callback is due
+                break;
+            }
             if(diff > (900*2))
             {	//If at least 1ms is available update values 
-                if((diff&0x8000) && !(next_callback&0x8000))
-                {//Should never get here...
-                    DBG_PRINT("!!!BUG!!!\n");
-                    break;
-                }
                 count=0;
+                #ifdef ENABLE_SCHED_STATS
+                uint16_t update_start = TIMER_BASE->CNT;
+                #endif
                 Update_All();
+                #ifdef ENABLE_SCHED_STATS
+                sched_statsUpdate(TIMER_BASE->CNT - update_start);
+                if(TIMER_BASE->SR & TIMER_BASE_CCIF )
+                    sched_statsLongUpdate();
+                #endif
                 #ifdef ENABLE_DEBUG
-                if(TIMER_BASE->SR & TIM_SR_CC1IF )
+                if(TIMER_BASE->SR & TIMER_BASE_CCIF )
                     DBG_PRINT("Long update\n");
                 #endif
                 if(radio.remote_callback == NULL)
@@ -197,10 +279,27 @@ uint8_t count=0;
                 #ifndef STM32_BOARD
                 diff = OCR1A-TCNT1;				// Calc the time difference
                 #else
-                diff = TIMER_BASE->CCR1 - TIMER_BASE->CNT;
+                diff = TIMER_BASE->TIMER_BASE_CCR - TIMER_BASE->CNT;
                 #endif
                 sei();							// Enable global int
+                if(!(diff & 0x8000) && diff > (900*2))
+                {	// Program queued eeprom data on what is left, erase only while binding
+                    appProcessEEPROM((diff >> 1) - EEPROM_GUARD_US, IS_BIND_IN_PROGRESS);
+                    cli();
+                    diff = TIMER_BASE->TIMER_BASE_CCR - TIMER_BASE->CNT;
+                    sei();
+                }
+#ifdef ENABLE_DISPLAY
+                if(!(diff & 0x8000) && diff > (DISPLAY_GUARD_US * 2 * 2))
+                {	// Live screen steps on what is still left
+                    appProcessDisplay((diff >> 1) - DISPLAY_GUARD_US);
+                    cli();
+                    diff = TIMER_BASE->TIMER_BASE_CCR - TIMER_BASE->CNT;
+                    sei();
+                }
+#endif
             }
+            appIdle(1);                         // until callback is due, input or next tick
         }
     }
 }
@@ -221,27 +320,29 @@ static uint8_t Update_All(void){
     #endif //ENABLE_SERIAL
 
     #ifdef ENABLE_PPM
+        #ifdef ENABLE_PPM_CAPTURE
+            ppm_process();
+        #endif
         if(radio.mode_select != MODE_SERIAL && IS_PPM_FLAG_on)		// PPM mode and a full frame has been received
         {
             uint32_t chan_or = radio.chan_order;
             uint8_t ch;
+            ppm_frame_t frame;
+            uint32_t count;
+
+            PPM_FLAG_off;									// frames received from now on set it again
+            count = ppm_getFrame(&frame);                   // consistent copy, no need to disable interrupts
+            if(radio.ppm_frame_count && count - radio.ppm_frame_count > 1){
+                radio.ppm_missed += count - radio.ppm_frame_count - 1;
+            }
+            radio.ppm_frame_count = count;
+            radio.ppm_chan_max = frame.chan;
+            #ifdef ENABLE_LATENCY
+                latency_frameUsed(frame.stamp);
+            #endif
             for(uint8_t i = 0; i < radio.ppm_chan_max; i++)
-            { // update servo data without interrupts to prevent bad read
-                uint16_t val;
-                cli();										// disable global int
-                val = radio.ppm_data[i];
-                sei();										// enable global int
-                val = map16b(val, 
-                            eeprom_data[IDX_PPM_MIN_100] * 2,
-                            eeprom_data[IDX_PPM_MAX_100] * 2,
-                            eeprom_data[IDX_CHANNEL_MIN_100],
-                            eeprom_data[IDX_CHANNEL_MAX_100]);
-                
-                if(val & 0x8000){
-                    val = eeprom_data[IDX_CHANNEL_MIN_125];
-                }else if(val > eeprom_data[IDX_CHANNEL_MAX_125]){
-                    val = eeprom_data[IDX_CHANNEL_MAX_125];
-                }
+            {
+                uint16_t val = chanmap_apply(&ppm_map, frame.data[i]);
 
                 if(chan_or)
                 {
@@ -255,15 +356,27 @@ static uint8_t Update_All(void){
                 else
                     radio.channel_data[i] = val;
             }
-            PPM_FLAG_off;									// wait for next frame before update
             #ifdef FAILSAFE_ENABLE
                 PPM_failsafe();
             #endif
             update_channels_aux();
+            #ifdef ENABLE_MIXER
+                mixer_process(radio.channel_data, radio.channel_mix, radio.channel_aux);
+            #endif
+            #ifdef ENABLE_TRACE
+            #ifdef ENABLE_MIXER
+                trace_channels(radio.channel_mix, radio.ppm_chan_max + MAX_AUX_CHANNELS);
+            #else
+                trace_channels(radio.channel_data, radio.ppm_chan_max + MAX_AUX_CHANNELS);
+            #endif
+            #endif
             INPUT_SIGNAL_on;								// valid signal received
             radio.last_signal = millis();
         }
     #endif //ENABLE_PPM
+    #ifdef ENABLE_TELEMETRY
+        telemetry_process();
+    #endif
     update_led_status();
     
     if(IS_CHANGE_PROTOCOL_FLAG_on)
@@ -339,6 +452,14 @@ static uint16_t next_callback;
         DATA_BUFFER_LOW_off;
         
         radio.blink = millis();
+        ppm_mapCompile();
+        #ifdef ENABLE_MIXER
+            update_mixer();
+        #endif
+
+        #ifdef ENABLE_RF_STATS
+            rf_statsReset();
+        #endif
 
         switch(radio.protocol)				// Init the requested protocol
         {			
@@ -386,8 +507,8 @@ static uint16_t next_callback;
         next_callback -= temp << 10;                        // between 2-3ms left at this stage
     }
     cli();											        // disable global int
-    TIMER_BASE->CCR1 = TIMER_BASE->CNT + next_callback * 2;	// set compare A for callback
-    TIMER_BASE->SR = 0x1E5F & ~TIM_SR_CC1IF;				// Clear Timer2/Comp1 interrupt flag
+    TIMER_BASE->TIMER_BASE_CCR = TIMER_BASE->CNT + next_callback * 2;	// set compare A for callback
+    TIMER_BASE->SR = 0x1E5F & ~TIMER_BASE_CCIF;				// Clear Timer2/Comp1 interrupt flag
     sei();										            // enable global int
 }
 
@@ -396,7 +517,11 @@ static uint16_t next_callback;
  * */
 void update_channels_aux(void){
    
+#ifdef ENABLE_DISPLAY
+    radio.channel_aux = appChannelSwitches(HW_SW_READ);    // push is also a screen key
+#else
     radio.channel_aux = HW_SW_READ;
+#endif
    
     for(uint8_t i = 0; i < MAX_AUX_CHANNELS - 1; i++){
         if((radio.channel_aux & (1<<i)) == 0){
@@ -421,10 +546,154 @@ void update_channels_aux(void){
     }
 }
 
+#ifdef ENABLE_MIXER
+/**
+ * @brief Compile mixer model against current calibration and
+ * refresh its outputs. Call after changing the model.
+ * */
+void update_mixer(void){
+    mixer_compile(mixer_getModel(),
+                  eeprom_data[IDX_CHANNEL_MIN_100],
+                  eeprom_data[IDX_CHANNEL_MAX_100],
+                  eeprom_data[IDX_CHANNEL_MIN_125],
+                  eeprom_data[IDX_CHANNEL_MAX_125]);
+    mixer_process(radio.channel_data, radio.channel_mix, radio.channel_aux);
+}
+#endif
+
+#if defined(ENABLE_MODELS) && defined(ENABLE_PPM)
+/**
+ * @brief Switch to stored model without reboot, only the protocol
+ * is restarted, from the main loop so the callback timing is kept.
+ * Selection is queued for saving and goes to flash on the idle
+ * windows of the new protocol.
+ *
+ * @param slot : model slot or MODEL_NONE for protocol switches
+ * @return : 1 on success, 0 if slot is empty or damaged
+ * */
+uint8_t multiprotocol_selectModel(uint8_t slot){
+    model_t model;
+
+    if(radio.mode_select == MODE_SERIAL || ppm_prot_line == NULL){
+        return 0;
+    }
+
+    if(slot == MODEL_NONE){
+        table_model(&model, ppm_prot_line);
+    }else if(!model_load(slot, &model)){
+        return 0;
+    }
+
+    *((uint8_t*)eeprom_data + IDX_MODEL) = slot;
+    apply_model(&model);
+    appSaveEEPROM();
+    CHANGE_PROTOCOL_FLAG_on;
+    return 1;
+}
+
+/**
+ * @brief Store current protocol, calibration and mixer on a model slot
+ * and make it the selected model.
+ *
+ * @return : 1 on success
+ * */
+uint8_t multiprotocol_saveModel(uint8_t slot, const char *name){
+    model_t model;
+
+    if(radio.mode_select == MODE_SERIAL || ppm_prot_line == NULL){
+        return 0;
+    }
+
+    memset(&model, 0, sizeof(model_t));
+    for(uint8_t i = 0; i < MODEL_NAME_LEN && name[i] != '\0'; i++){
+        model.name[i] = name[i];
+    }
+    model.protocol = radio.protocol;
+    model.sub_protocol = radio.sub_protocol;
+    model.rx_num = radio.rx_num;
+    model.option = (int8_t)radio.option;
+    model.power = IS_POWER_FLAG_on;
+    model.autobind = IS_AUTOBIND_FLAG_on;
+    model.chan_order = radio.chan_order;
+    memcpy(model.calib, &eeprom_data[IDX_CHANNEL_MAX_100], sizeof(model.calib));
+#ifdef ENABLE_MIXER
+    memcpy(&model.mixer, mixer_getModel(), sizeof(mixer_model_t));
+#else
+    mixer_default(&model.mixer);
+#endif
+
+    if(!model_save(slot, &model)){
+        return 0;
+    }
+
+    *((uint8_t*)eeprom_data + IDX_MODEL) = slot;
+    appSaveEEPROM();
+    return 1;
+}
+
+/**
+ * @brief Selected model slot, MODEL_NONE if protocol switches are in use
+ * */
+uint8_t multiprotocol_getModel(void){
+    return *((uint8_t*)eeprom_data + IDX_MODEL);
+}
+#endif
+
 /**
  *  Private Functions, maybe move them to own file?
  * */
 
+/**
+ * @brief Fill model from protocol table line, calibration is
+ * the one in use and mixer has no mixes
+ * */
+static void table_model(model_t *model, const PPM_Parameters *line){
+    memset(model, 0, sizeof(model_t));
+    model->protocol = line->protocol;
+    model->sub_protocol = line->sub_proto;
+    model->rx_num = line->rx_num;
+    model->option = line->option;
+    model->power = line->power;
+    model->autobind = line->autobind;
+    model->chan_order = line->chan_order;
+    memcpy(model->calib, &eeprom_data[IDX_CHANNEL_MAX_100], sizeof(model->calib));
+    mixer_default(&model->mixer);
+}
+
+/**
+ * @brief Load model into radio, calibration and mixer.
+ * protocol_init() must be called after.
+ * */
+static void apply_model(const model_t *model){
+    radio.protocol          = model->protocol;
+    radio.cur_protocol[1]   = radio.protocol;
+    radio.sub_protocol      = model->sub_protocol;
+    radio.rx_num            = model->rx_num;
+    radio.chan_order        = model->chan_order;
+
+    radio.option = (uint8_t)model->option;	// Use radio-defined option value
+
+    radio.prev_power = 0xFD; // unused power value
+
+    if(model->power){
+        POWER_FLAG_on;
+    }else{
+        POWER_FLAG_off;
+    }
+
+    if(model->autobind){
+        AUTOBIND_FLAG_on;
+        BIND_IN_PROGRESS;	// Force a bind at protocol startup
+    }else{
+        AUTOBIND_FLAG_off;
+    }
+
+    memcpy(&eeprom_data[IDX_CHANNEL_MAX_100], model->calib, sizeof(model->calib));
+#ifdef ENABLE_MIXER
+    memcpy(mixer_getModel(), &model->mixer, sizeof(mixer_model_t));
+#endif
+}
+
 /**
  * @brief Convert 32b id to rx_tx_addr
  * */
@@ -440,26 +709,24 @@ static void set_rx_tx_addr(uint8_t *dst, uint32_t id)
 /**
  * @brief Callback from ppm_decode
  * */
-void setPpmFlag(volatile uint16_t *buf, uint8_t chan){
+void setPpmFlag(void){
     PPM_FLAG_on;
-    radio.ppm_data = buf;
-    // Saving the number of channels received
-    //if(chan > radio.ppm_chan_max) 
-        radio.ppm_chan_max = chan;
 }
 
 /**
- * 
+ * @brief Compile PPM to channel transform from calibration values,
+ * must be called when they change.
+ * Channels below zero go to CHANNEL_MIN_125, above CHANNEL_MAX_125 are clamped
  * */
-int16_t map16b( int16_t x, int16_t in_min, int16_t in_max, int16_t out_min, int16_t out_max)
+static void ppm_mapCompile(void)
 {
-//  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
-    long y ;
-    x -= in_min ;
-    y = out_max - out_min ;
-    y *= x ;
-    x = y / (in_max - in_min) ;
-    return x  + out_min ;
+    chanmap_compile(&ppm_map,
+                    eeprom_data[IDX_PPM_MIN_100] * 2,
+                    eeprom_data[IDX_PPM_MAX_100] * 2,
+                    eeprom_data[IDX_CHANNEL_MIN_100],
+                    eeprom_data[IDX_CHANNEL_MAX_100],
+                    eeprom_data[IDX_CHANNEL_MIN_125],
+                    eeprom_data[IDX_CHANNEL_MAX_125]);
 }
 /**
  * 
@@ -486,7 +753,7 @@ static uint32_t random_id(uint8_t create_new)
     
     // Generate a random ID
 #if defined STM32_BOARD
-        #define STM32_UUID ((uint32_t *)0x1FFFF7E8)
+        #define STM32_UUID ((uint32_t *)UID_BASE)
         id = STM32_UUID[0] ^ STM32_UUID[1] ^ STM32_UUID[2];
         DBG_PRINT("Generated ID from STM32 UUID\n");
 #endif
@@ -241,7 +241,7 @@ struct PPM_Parameters
 	uint32_t chan_order;
 };
 
-#pragma pack (1)
+#pragma pack (push, 1)
 typedef struct radio{
     volatile uint32_t flags;       
     uint8_t mode_select;    
@@ -249,6 +249,9 @@ typedef struct radio{
     // Servo data 
     uint16_t channel_data[MAX_CHN_NUM];
     uint8_t  channel_aux;
+#ifdef ENABLE_MIXER
+    uint16_t channel_mix[MAX_CHN_NUM];  // mixer output, used by packet builders
+#endif
     // Encoder count
     uint16_t enc_count;
 #ifdef FAILSAFE_ENABLE
@@ -285,7 +288,8 @@ typedef struct radio{
 
 #ifdef ENABLE_PPM
     // PPM variable
-    volatile uint16_t *ppm_data;
+    uint32_t ppm_frame_count;       // last frame used
+    uint32_t ppm_missed;            // frames overwritten before being used
     volatile uint8_t  ppm_chan_max;
     uint8_t chan_order;
 #endif
@@ -305,6 +309,7 @@ typedef struct radio{
     //callback
     uint16_t (*remote_callback)(void);
 }radio_t;
+#pragma pack (pop)
 
 extern radio_t radio;
 extern uint8_t CH_AETR[];
@@ -314,11 +319,34 @@ extern uint8_t CH_EATR[];
 void multiprotocol_setup(void);
 void multiprotocol_loop(void);
 
-void ppm_setCallBack(void(*cb)(volatile uint16_t*, uint8_t));
+/**
+ * Complete PPM frame as published by the decoder
+ * */
+typedef struct ppm_frame{
+    uint32_t count;                 // frame number, 0 if no frame was received yet
+    uint16_t stamp;                 // TIMER_BASE value of the edge completing the frame
+    uint8_t  chan;
+    uint16_t data[MAX_CHN_NUM];
+}ppm_frame_t;
+
+void ppm_setCallBack(void(*cb)(void));
 void update_channels_aux(void);
-void setPpmFlag(volatile uint16_t *buf, uint8_t chan);
+#ifdef ENABLE_MIXER
+void update_mixer(void);
+#endif
+#ifdef ENABLE_MODELS
+uint8_t multiprotocol_selectModel(uint8_t slot);
+uint8_t multiprotocol_saveModel(uint8_t slot, const char *name);
+uint8_t multiprotocol_getModel(void);
+#endif
+void setPpmFlag(void);
 uint16_t ppm_tx(void);
 uint16_t *ppm_getData(void);
+uint32_t ppm_getFrame(ppm_frame_t *frame);
+void ppm_putFrame(const uint16_t *data, uint8_t chan);
+#ifdef ENABLE_PPM_CAPTURE
+void ppm_process(void);
+#endif
 
 #ifdef __cplusplus
 }
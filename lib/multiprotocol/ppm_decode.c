@@ -1,13 +1,34 @@
+#include <string.h>
 #include "multiprotocol.h"
 #include "board.h"
 
+#ifdef ENABLE_PPM_CAPTURE
+#define PPM_CAPTURE_SIZE    64      // ~4 frames of edges
+
+static volatile uint16_t ppm_capture[PPM_CAPTURE_SIZE];
+static uint16_t ppm_capture_tail;
+#endif
+
 static volatile uint16_t ppm_data[MAX_CHN_NUM];
-static void (*ppmFrameCB)(volatile uint16_t *, uint8_t);
+static void (*ppmFrameCB)(void);
+
+/**
+ * Last complete frame, guarded by a sequence counter that is odd
+ * while the frame is being written. Readers never mask interrupts,
+ * they retry the copy if the counter changed meanwhile.
+ * */
+static ppm_frame_t ppm_frame;
+static volatile uint32_t ppm_seq;
 
+static void ppm_edge(uint16_t stamp);
+#ifndef ENABLE_PPM_CAPTURE
 static void ppm_decode(void);
+#endif
 
 uint16_t ppm_tx(void){
-    ppmOut((uint16_t *)ppm_data);
+    ppm_frame_t frame;
+    ppm_getFrame(&frame);
+    ppmOut(frame.data);
     return 9000;
 }
 
@@ -18,38 +39,131 @@ uint16_t *ppm_getData(void){
     return (uint16_t*)ppm_data;
 }
 
+/**
+ * @brief Publish a complete frame, must not be preempted by another writer
+ * */
+RAM_CODE static void ppm_publish(volatile uint16_t *data, uint8_t chan, uint16_t stamp){
+    ppm_seq++;
+    __DMB();
+    ppm_frame.count = (ppm_seq >> 1) + 1;
+    ppm_frame.stamp = stamp;
+    ppm_frame.chan = chan;
+    for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+        ppm_frame.data[i] = data[i];
+    }
+    __DMB();
+    ppm_seq++;
+}
+
+/**
+ * @brief Get copy of the last complete frame
+ * 
+ * @param frame : destination
+ * @return : frame number, consumers can detect missed frames by
+ *           comparing it with the previous one
+ * */
+uint32_t ppm_getFrame(ppm_frame_t *frame){
+    uint32_t seq;
+
+    while(1){
+        seq = ppm_seq;
+        if(seq & 1){
+            continue;
+        }
+        __DMB();
+        memcpy(frame, &ppm_frame, sizeof(ppm_frame_t));
+        __DMB();
+        if(seq == ppm_seq){
+            break;
+        }
+    }
+    frame->count = seq >> 1;
+    return frame->count;
+}
+
+/**
+ * @brief Inject a frame as if received from PPM input
+ * */
+void ppm_putFrame(const uint16_t *data, uint8_t chan){
+    uint16_t buf[MAX_CHN_NUM] = {0};
+
+    memcpy(buf, data, chan * sizeof(uint16_t));
+    __disable_irq();
+    ppm_publish(buf, chan, TIMER_BASE->CNT);
+    __enable_irq();
+
+    if(ppmFrameCB != NULL){
+        ppmFrameCB();
+    }
+}
+
 /**
  * @brief Configure callback for PPM input pin interrupt
  * 
  * @param cb : callback function
  * 
  * */
-void ppm_setCallBack(void(*cb)(volatile uint16_t*, uint8_t)){
+void ppm_setCallBack(void(*cb)(void)){
      if(cb == NULL){
         return;
     }
+#ifdef ENABLE_PPM_CAPTURE
+    ppmCaptureStop();
+    ppmFrameCB = cb;
+    ppm_capture_tail = 0;
+    ppmCaptureStart(ppm_capture, PPM_CAPTURE_SIZE);
+#else
     gpioRemoveInterrupt(HW_PPM_INPUT_PORT, HW_PPM_INPUT_PIN);    
     ppmFrameCB = cb;
     gpioAttachInterrupt(HW_PPM_INPUT_PORT, HW_PPM_INPUT_PIN, 0, ppm_decode);        
+#endif
 }
 
+#ifdef ENABLE_PPM_CAPTURE
+/**
+ * @brief Decode edges captured since last call.
+ * Called from main loop, the capture buffer must not
+ * wrap between calls (~4 frames)
+ * */
+void ppm_process(void){
+    uint16_t head = ppmCaptureIndex();
+
+    while(ppm_capture_tail != head){
+        ppm_edge(ppm_capture[ppm_capture_tail]);
+        if(++ppm_capture_tail == PPM_CAPTURE_SIZE){
+            ppm_capture_tail = 0;
+        }
+    }
+}
+#else
+/**
+ * @brief PPM input pin interrupt handler
+ * */
+RAM_CODE static void ppm_decode(void){
+    ppm_edge(TIMER_BASE->CNT);
+}
+#endif
+
 /**
  * @brief PPM_decode from multiprotocol project.
- * This function is calledfrom PPM pin input interrupt handler
+ * Called for each falling edge on PPM input
+ * 
+ * @param stamp : TIMER_BASE value at the edge
  * */
-RAM_CODE static void ppm_decode(void){	
+RAM_CODE static void ppm_edge(uint16_t stamp){	
     static int8_t chan = 0, bad_frame = 1;
     static uint16_t Prev_TCNT1 = 0;
     uint16_t Cur_TCNT1;
-    // Capture current Timer value
-    Cur_TCNT1 = TIMER_BASE->CNT - Prev_TCNT1;
+    // Time since last edge
+    Cur_TCNT1 = stamp - Prev_TCNT1;
     if(Cur_TCNT1 < PPM_MIN_PERIOD){
         bad_frame = 1;					// bad frame
     }else if(Cur_TCNT1 > PPM_MAX_PERIOD){
         //start of frame
         if(chan >= MIN_PPM_CHANNELS){
             //DBG_PIN_TOGGLE;                
-            ppmFrameCB(ppm_data, chan);
+            ppm_publish(ppm_data, chan, stamp);
+            ppmFrameCB();
         }
         chan = 0;						// reset channel counter
         bad_frame = 0;
@@ -60,4 +174,4 @@ RAM_CODE static void ppm_decode(void){
             bad_frame = 1;		// don't accept any new channels
     }
     Prev_TCNT1 += Cur_TCNT1;
-}
\ No newline at end of file
+}
@@ -0,0 +1,65 @@
+#include <string.h>
+#include "rf_stats.h"
+
+static rf_stats_t rf_stats;
+
+/**
+ * @brief Clear all counters
+ * */
+void rf_statsReset(void){
+    memset(&rf_stats, 0, sizeof(rf_stats_t));
+}
+
+/**
+ * @brief Data packet was sent
+ * */
+void rf_statsTx(void){
+    rf_stats.tx_packets++;
+}
+
+/**
+ * @brief Record outcome of a telemetry receive window
+ * 
+ * @param hop : hop index the receiver was listening on
+ * @param result : rf_rx_result
+ * */
+void rf_statsRx(uint8_t hop, uint8_t result){
+    rf_stats.rx_slots++;
+
+    switch(result){
+        case RF_RX_OK:
+            rf_stats.rx_packets++;
+            return;
+
+        case RF_RX_BAD_CRC:
+            rf_stats.rx_bad_crc++;
+            break;
+
+        case RF_RX_OVERFLOW:
+            rf_stats.rx_overflows++;
+            break;
+
+        default:
+            rf_stats.rx_missed++;
+            break;
+    }
+
+    if(hop < RF_STATS_HOPS && rf_stats.hop_miss[hop] != 0xFFFF){
+        rf_stats.hop_miss[hop]++;
+    }
+}
+
+/**
+ * @brief Protocol callback is about to run
+ * 
+ * @param late : ticks elapsed since its deadline
+ * */
+void rf_statsCallback(uint16_t late){
+    if(late > RF_STATS_LATE_TICKS){
+        rf_stats.late_callbacks++;
+    }
+}
+
+rf_stats_t *rf_getStats(void){
+    return &rf_stats;
+}
@@ -0,0 +1,46 @@
+#ifndef _RF_STATS_H_
+#define _RF_STATS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * RF link counters, cleared when a protocol is started.
+ * Telemetry slots are counted by hop index so channels
+ * with interference show up on the miss histogram.
+ * */
+#define RF_STATS_HOPS           47      // FrSky D hop channels
+#define RF_STATS_LATE_TICKS     100     // 50us, callback start after its deadline
+
+enum rf_rx_result{
+    RF_RX_OK = 0,
+    RF_RX_MISSED,                       // nothing on RX FIFO
+    RF_RX_BAD_CRC,
+    RF_RX_OVERFLOW
+};
+
+typedef struct rf_stats{
+    uint32_t tx_packets;
+    uint32_t rx_slots;                  // telemetry receive windows
+    uint32_t rx_packets;                // received with valid CRC
+    uint32_t rx_bad_crc;
+    uint32_t rx_missed;
+    uint32_t rx_overflows;
+    uint32_t late_callbacks;
+    uint16_t hop_miss[RF_STATS_HOPS];   // RX slots without a valid packet per hop index
+}rf_stats_t;
+
+void rf_statsReset(void);
+void rf_statsTx(void);
+void rf_statsRx(uint8_t hop, uint8_t result);
+void rf_statsCallback(uint16_t late);
+rf_stats_t *rf_getStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RF_STATS_H_ */
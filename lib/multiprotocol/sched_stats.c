@@ -0,0 +1,90 @@
+#include <string.h>
+#include "sched_stats.h"
+
+static sched_stats_t sched_stats;
+
+static void sched_histAdd(sched_hist_t *hist, uint16_t ticks){
+    uint32_t bin = ticks >> hist->shift;
+
+    if(bin >= SCHED_HIST_BINS){
+        bin = SCHED_HIST_BINS - 1;
+    }
+
+    hist->bins[bin]++;
+    hist->count++;
+
+    if(ticks > hist->max){
+        hist->max = ticks;
+    }
+}
+
+/**
+ * @brief Clear all counters
+ * */
+void sched_statsReset(void){
+    memset(&sched_stats, 0, sizeof(sched_stats_t));
+    sched_stats.slack.shift = SCHED_SLACK_SHIFT;
+    sched_stats.late.shift = SCHED_LATE_SHIFT;
+    sched_stats.update.shift = SCHED_UPDATE_SHIFT;
+}
+
+void sched_statsSlack(uint16_t ticks){
+    sched_stats.callbacks++;
+    sched_histAdd(&sched_stats.slack, ticks);
+}
+
+void sched_statsLate(uint16_t ticks){
+    sched_histAdd(&sched_stats.late, ticks);
+}
+
+void sched_statsUpdate(uint16_t ticks){
+    sched_histAdd(&sched_stats.update, ticks);
+}
+
+void sched_statsShortCB(void){
+    sched_stats.callbacks++;
+    sched_stats.short_cb++;
+}
+
+void sched_statsLongUpdate(void){
+    sched_stats.long_update++;
+}
+
+void sched_statsForceUpdate(void){
+    sched_stats.force_update++;
+}
+
+sched_stats_t *sched_getStats(void){
+    return &sched_stats;
+}
+
+/**
+ * @brief Get percentile from histogram
+ *
+ * @param hist : histogram
+ * @param pct : percentile 0-100
+ * @return : upper bound of the bin holding the percentile, in ticks
+ * */
+uint32_t sched_histPercentile(sched_hist_t *hist, uint8_t pct){
+    uint32_t target, acc = 0;
+
+    if(hist->count == 0){
+        return 0;
+    }
+
+    target = ((uint64_t)hist->count * pct + 99) / 100;
+
+    if(target == 0){
+        target = 1;
+    }
+
+    for(uint32_t i = 0; i < SCHED_HIST_BINS; i++){
+        acc += hist->bins[i];
+        if(acc >= target){
+            uint32_t upper = ((i + 1) << hist->shift) - 1;
+            return (upper < hist->max) ? upper : hist->max;
+        }
+    }
+
+    return hist->max;
+}
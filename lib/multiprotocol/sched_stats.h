@@ -0,0 +1,50 @@
+#ifndef _SCHED_STATS_H_
+#define _SCHED_STATS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Scheduler statistics for multiprotocol_loop.
+ * All values are in TIMER_BASE ticks (0.5us)
+ * */
+#define SCHED_HIST_BINS         256
+#define SCHED_SLACK_SHIFT       7       // 64us per bin, up to 16.3ms
+#define SCHED_LATE_SHIFT        0       // 0.5us per bin, up to 128us
+#define SCHED_UPDATE_SHIFT      4       // 8us per bin, up to 2ms
+
+typedef struct sched_hist{
+    uint8_t  shift;
+    uint32_t count;
+    uint32_t max;
+    uint32_t bins[SCHED_HIST_BINS];     // last bin also holds out of range values
+}sched_hist_t;
+
+typedef struct sched_stats{
+    sched_hist_t slack;                 // time left to the callback deadline after running it
+    sched_hist_t late;                  // delay between the deadline and the next callback start
+    sched_hist_t update;                // time spent on Update_All() while waiting
+    uint32_t callbacks;
+    uint32_t short_cb;                  // callback returned after its own deadline
+    uint32_t long_update;               // Update_All() crossed the deadline
+    uint32_t force_update;
+}sched_stats_t;
+
+void sched_statsReset(void);
+void sched_statsSlack(uint16_t ticks);
+void sched_statsLate(uint16_t ticks);
+void sched_statsUpdate(uint16_t ticks);
+void sched_statsShortCB(void);
+void sched_statsLongUpdate(void);
+void sched_statsForceUpdate(void);
+sched_stats_t *sched_getStats(void);
+uint32_t sched_histPercentile(sched_hist_t *hist, uint8_t pct);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCHED_STATS_H_ */
@@ -0,0 +1,183 @@
+#include <string.h>
+#include "board.h"
+#include "multiprotocol.h"
+#include "telemetry.h"
+
+#define HUB_START_STOP      0x5E
+#define HUB_BYTE_STUFF      0x5D
+#define HUB_STUFF_MASK      0x60
+#define HUB_FRAME_SIZE      3               // id, low byte, high byte
+
+typedef struct telemetry_ring{
+    uint8_t data[TELEMETRY_RING_SIZE][TELEMETRY_PACKET_SIZE];
+    uint8_t len[TELEMETRY_RING_SIZE];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+}telemetry_ring_t;
+
+typedef struct hub_decoder{
+    uint8_t buf[HUB_FRAME_SIZE];
+    uint8_t idx;
+    uint8_t stuff;
+}hub_decoder_t;
+
+static telemetry_t telemetry;
+static telemetry_ring_t ring;
+static hub_decoder_t hub;
+static uint8_t counter;                     // user frame requested to receiver
+static uint8_t retry;
+
+/**
+ * @brief Clear parsed values, counters and pending packets
+ * */
+void telemetry_reset(void){
+    memset(&telemetry, 0, sizeof(telemetry_t));
+    memset(&hub, 0, sizeof(hub_decoder_t));
+    ring.head = ring.tail = 0;
+    counter = 0;
+    retry = 0;
+}
+
+/**
+ * @brief Validate received packet, acknowledge user frame and queue it.
+ * Called from RF slot, so parsing is left for telemetry_process
+ * 
+ * @param packet : data read from RX FIFO including appended status
+ * @param len : number of bytes read
+ * @return : 1 if packet was queued
+ * */
+uint8_t telemetry_frskyPush(const uint8_t *packet, uint8_t len){
+    uint8_t slot;
+
+    if(!(packet[len - 1] & 0x80)){
+        telemetry.bad_crc++;
+        return 0;
+    }
+
+    if(len != TELEMETRY_PACKET_SIZE || packet[0] != len - 3 ||
+        packet[1] != radio.rx_tx_addr[3] || packet[2] != radio.rx_tx_addr[2]){
+        telemetry.bad_addr++;
+        return 0;
+    }
+
+    if(((ring.head + 1) & (TELEMETRY_RING_SIZE - 1)) == ring.tail){
+        telemetry.overflows++;
+        return 0;
+    }
+
+    slot = ring.head;
+    memcpy(ring.data[slot], packet, len);
+    ring.len[slot] = len;
+
+    // User frame sequence from multiprotocol frsky_check_telemetry
+    if(packet[6] > 0 && packet[6] <= TELEMETRY_USER_MAX){
+        if((packet[7] & 0x1F) == (counter & 0x1F)){
+            uint8_t top = 0;
+            if((counter & 0x80) && (counter & 0x1F) != retry){
+                top = 0x80;
+            }
+            counter = ((counter + 1) % 32) | top;       // request next frame
+        }else{
+            retry = counter & 0x1F;                     // wrong sequence, wait for retransmission
+            counter |= 0x80;
+            ring.data[slot][6] = 0;
+        }
+    }else{
+        ring.data[slot][6] = 0;
+    }
+
+    ring.head = (slot + 1) & (TELEMETRY_RING_SIZE - 1);
+    return 1;
+}
+
+/**
+ * @brief Sequence number for the next transmitted packet
+ * */
+uint8_t telemetry_getCounter(void){
+    return counter;
+}
+
+static void telemetry_hubByte(uint8_t data){
+    if(data == HUB_START_STOP){
+        if(hub.idx == HUB_FRAME_SIZE && hub.buf[0] < TELEMETRY_HUB_IDS){
+            telemetry.hub[hub.buf[0]] = hub.buf[1] | (hub.buf[2] << 8);
+            telemetry.hub_valid |= (uint64_t)1 << hub.buf[0];
+            telemetry.hub_frames++;
+        }
+        hub.idx = 0;
+        hub.stuff = 0;
+        return;
+    }
+
+    if(data == HUB_BYTE_STUFF){
+        hub.stuff = 1;
+        return;
+    }
+
+    if(hub.stuff){
+        data ^= HUB_STUFF_MASK;
+        hub.stuff = 0;
+    }
+
+    if(hub.idx < HUB_FRAME_SIZE){
+        hub.buf[hub.idx] = data;
+    }
+
+    if(hub.idx <= HUB_FRAME_SIZE){
+        hub.idx++;                          // frames too long are dropped on next delimiter
+    }
+}
+
+/**
+ * @brief Parse one queued packet, called from main loop
+ * */
+void telemetry_process(void){
+    uint8_t *packet, len, rssi;
+
+    if(ring.tail == ring.head){
+        return;
+    }
+
+    packet = ring.data[ring.tail];
+    len = ring.len[ring.tail];
+
+    telemetry.a1 = packet[3];
+    telemetry.a2 = packet[4];
+    telemetry.rx_rssi = packet[5];
+
+    rssi = packet[len - 2];
+    if(rssi >= 128){
+        telemetry.tx_rssi = (rssi - 256) / 2 - TELEMETRY_RSSI_OFFSET;
+    }else{
+        telemetry.tx_rssi = rssi / 2 - TELEMETRY_RSSI_OFFSET;
+    }
+    telemetry.tx_lqi = packet[len - 1] & 0x7F;
+
+    for(uint8_t i = 0; i < packet[6]; i++){
+        telemetry_hubByte(packet[8 + i]);
+    }
+
+    telemetry.packets++;
+    telemetry.last_packet = getTick();
+    telemetry.link = 1;
+
+    ring.tail = (ring.tail + 1) & (TELEMETRY_RING_SIZE - 1);
+}
+
+/**
+ * @brief Convert analog port reading
+ * 
+ * @param raw : port value
+ * @param ratio : divider ratio on receiver
+ * @return : voltage in mV
+ * */
+uint16_t telemetry_analogMv(uint8_t raw, uint8_t ratio){
+    return ((uint32_t)raw * 3300 * ratio) / 255;
+}
+
+telemetry_t *telemetry_getData(void){
+    if(telemetry.link && getTick() - telemetry.last_packet > TELEMETRY_LINK_TIMEOUT){
+        telemetry.link = 0;
+    }
+    return &telemetry;
+}
@@ -0,0 +1,57 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * FrSky D telemetry.
+ * Packets are validated and acknowledged in the RF slot, then queued
+ * on a ring and parsed from the main loop, one packet per call.
+ *
+ * Packet from receiver:
+ *  [0] length (0x11), [1..2] tx address, [3] A1, [4] A2, [5] RX RSSI,
+ *  [6] user bytes, [7] sequence, [8..17] hub user data,
+ *  [18] RSSI, [19] LQI | CRC_OK appended by CC2500
+ * */
+#define TELEMETRY_RING_SIZE         4       // packets, power of two
+#define TELEMETRY_PACKET_SIZE       (0x11 + 3)
+#define TELEMETRY_USER_MAX          10
+#define TELEMETRY_HUB_IDS           0x40
+#define TELEMETRY_LINK_TIMEOUT      1000    // ms without packets to consider link lost
+#define TELEMETRY_RSSI_OFFSET       69      // dB, CC2500 at ~31kbps
+#define TELEMETRY_A1_RATIO          4       // D series receivers measure their supply through a 4:1 divider
+#define TELEMETRY_A2_RATIO          1
+
+typedef struct telemetry{
+    uint8_t  link;
+    uint8_t  a1;                            // raw analog port readings, 0-255 for 0-3.3V
+    uint8_t  a2;
+    uint8_t  rx_rssi;                       // RSSI reported by receiver
+    int16_t  tx_rssi;                       // dBm, measured by CC2500
+    uint8_t  tx_lqi;
+    uint32_t last_packet;                   // ms
+    uint32_t packets;                       // valid packets parsed
+    uint32_t bad_crc;
+    uint32_t bad_addr;                      // wrong address or length
+    uint32_t overflows;                     // dropped because ring was full
+    uint32_t hub_frames;
+    uint64_t hub_valid;                     // bit set for each hub id received
+    uint16_t hub[TELEMETRY_HUB_IDS];        // last value by hub id
+}telemetry_t;
+
+void telemetry_reset(void);
+uint8_t telemetry_frskyPush(const uint8_t *packet, uint8_t len);
+uint8_t telemetry_getCounter(void);
+void telemetry_process(void);
+uint16_t telemetry_analogMv(uint8_t raw, uint8_t ratio);
+telemetry_t *telemetry_getData(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TELEMETRY_H_ */
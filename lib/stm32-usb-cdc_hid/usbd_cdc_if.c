@@ -46,6 +46,11 @@
 /* USER CODE BEGIN INCLUDE */
 #include "board.h"
 #include "stdout.h"
+#include <string.h>
+#include "bytering.h"
+#ifdef ENABLE_TRACE
+#include "trace.h"
+#endif
 /* USER CODE END INCLUDE */
 
 /** @addtogroup STM32_USB_OTG_DEVICE_LIBRARY
@@ -101,6 +106,15 @@ uint8_t UserRxBufferFS[APP_RX_DATA_SIZE];
 uint8_t UserTxBufferFS[APP_TX_DATA_SIZE];
 
 /* USER CODE BEGIN PRIVATE_VARIABLES */
+_Static_assert((VCP_TX_RING_SIZE & (VCP_TX_RING_SIZE - 1)) == 0, "console ring size must be power of 2");
+
+/* Console text waiting to be sent, taken by IN transfers straight from the ring */
+static uint8_t tx_buf[VCP_TX_RING_SIZE];
+static bytering_t tx_ring = BYTERING_INIT(tx_buf);
+
+static volatile uint16_t tx_inflight;    // bytes on current IN transfer
+static volatile uint8_t tx_source;       // ring they are taken from
+static vcp_tx_stats_t tx_stats;
 /* USER CODE END PRIVATE_VARIABLES */
 
 /**
@@ -127,6 +141,7 @@ static int8_t CDC_Control_FS  (uint8_t cmd, uint8_t* pbuf, uint16_t length);
 static int8_t CDC_Receive_FS  (uint8_t* pbuf, uint32_t *Len);
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
+static void vcp_txAbort(void);
 void vcp_init(void){ }
 uint8_t vcp_nb(char *c){ return fifo_get(&serial_rx_fifo, (uint8_t*)c); }
 uint8_t vcp_kbhit(void){ return fifo_avail(&serial_rx_fifo); }
@@ -137,24 +152,27 @@ char vcp_getchar(void){
   return c;
 }
 
-static void vcp_putAndRetry(uint8_t *data, uint16_t len){
-uint32_t retries = 1000;
-	while(retries--){
-		if(	CDC_Transmit_FS(data, len) == USBD_OK)
-			break;
-	}
+/**
+ * @brief Queue text and start sending it if the endpoint is free,
+ * never waits. Writes that do not fit are dropped whole and counted
+ * */
+static void vcp_write(const uint8_t *data, uint16_t len){
+  if(!bytering_put(&tx_ring, data, len)){
+    tx_stats.overflows++;
+    tx_stats.dropped += len;
+    return;
+  }
+  tx_stats.queued += len;
+
+  vcp_txService();
 }
 
 void vcp_putchar(char c){
-	vcp_putAndRetry((uint8_t*)&c, 1);
+  vcp_write((uint8_t*)&c, 1);
 }
 
 void vcp_puts(const char *str){
-	uint16_t len = 0;
-  	while( *((const char*)(str + len)) != '\0'){
-		len++;	
-	}
-  vcp_putAndRetry((uint8_t*)str, len);
+  vcp_write((const uint8_t*)str, strlen(str));
 }
 
 stdout_t vcom = {
@@ -193,6 +211,7 @@ static int8_t CDC_Init_FS(void)
   /* Set Application Buffers */
   USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, 0);
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+  vcp_txAbort();
   return (USBD_OK);
   /* USER CODE END 3 */ 
 }
@@ -206,6 +225,7 @@ static int8_t CDC_Init_FS(void)
 static int8_t CDC_DeInit_FS(void)
 {
   /* USER CODE BEGIN 4 */ 
+  vcp_txAbort();
   return (USBD_OK);
   /* USER CODE END 4 */ 
 }
@@ -337,6 +357,103 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
+/**
+  * @brief  Start next IN transfer, zero copy from the console text ring
+  *         or, when no text is waiting, from the trace ring. Called when
+  *         text is queued, from the main loop to start a trace stream and
+  *         on IN transfer complete to keep them going
+  * @retval 1 if a transfer was started
+  */
+uint8_t vcp_txService(void)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
+  uint32_t primask = __get_PRIMASK();
+  uint8_t started = 0;
+  uint8_t source = VCP_TX_TEXT;
+  uint8_t *data;
+  uint16_t len;
+
+  __disable_irq();
+  if(hcdc != NULL && hcdc->TxState == 0 && tx_inflight == 0){
+    len = bytering_peek(&tx_ring, &data, CDC_DATA_FS_MAX_PACKET_SIZE);
+#ifdef ENABLE_TRACE
+    if(len == 0){
+      len = trace_peek(&data);
+      source = VCP_TX_TRACE;
+    }
+#endif
+    if(len > 0 && CDC_Transmit_FS(data, len) == USBD_OK){
+      tx_inflight = len;
+      tx_source = source;
+      started = 1;
+    }
+  }
+  __set_PRIMASK(primask);
+  return started;
+}
+
+/**
+  * @brief  IN transfer complete on CDC endpoint, releases sent bytes
+  *         and sends the next chunk. A transfer ending on a full packet
+  *         is closed with a zero length packet when nothing follows,
+  *         otherwise the host keeps waiting for more data
+  */
+void CDC_TxComplete_FS(void)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
+  uint16_t sent = tx_inflight;
+
+  tx_inflight = 0;
+  if(sent > 0){
+    if(tx_source == VCP_TX_TEXT){
+      bytering_consume(&tx_ring, sent);
+      tx_stats.sent += sent;
+    }
+#ifdef ENABLE_TRACE
+    else{
+      trace_consume(sent);
+    }
+#endif
+  }
+  if(!vcp_txService() && sent == CDC_DATA_FS_MAX_PACKET_SIZE && hcdc->TxState == 0){
+    CDC_Transmit_FS(UserTxBufferFS, 0);
+  }
+}
+
+/**
+  * @brief  Forget the IN transfer cut by a USB reset, unplug or new
+  *         configuration, its complete never comes. Its bytes are dropped,
+  *         part of them may already be on the host and the trace reader
+  *         finds its records again after lost bytes, so the next transfer
+  *         starts on what follows them
+  */
+static void vcp_txAbort(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  uint16_t lost;
+
+  __disable_irq();
+  lost = tx_inflight;
+  tx_inflight = 0;
+  if(lost > 0){
+    if(tx_source == VCP_TX_TEXT){
+      bytering_consume(&tx_ring, lost);
+      tx_stats.dropped += lost;
+    }
+#ifdef ENABLE_TRACE
+    else{
+      trace_consume(lost);
+    }
+#endif
+  }
+  tx_source = VCP_TX_TEXT;
+  __set_PRIMASK(primask);
+}
+
+vcp_tx_stats_t *vcp_getTxStats(void)
+{
+  return &tx_stats;
+}
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
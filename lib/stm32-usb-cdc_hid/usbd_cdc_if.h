@@ -67,6 +67,12 @@
   * @{
   */ 
 /* USER CODE BEGIN EXPORTED_DEFINES */
+#define VCP_TX_RING_SIZE    1024        // console text, power of 2
+
+enum vcp_tx_source{
+  VCP_TX_TEXT = 0,
+  VCP_TX_TRACE,
+};
 /* USER CODE END EXPORTED_DEFINES */
 
 /**
@@ -77,6 +83,12 @@
   * @{
   */  
 /* USER CODE BEGIN EXPORTED_TYPES */
+typedef struct vcp_tx_stats{
+  uint32_t queued;                      // text bytes accepted
+  uint32_t sent;                        // text bytes taken by IN transfers
+  uint32_t dropped;                     // text bytes lost on full ring or cut transfer
+  uint32_t overflows;                   // writes dropped
+}vcp_tx_stats_t;
 /* USER CODE END EXPORTED_TYPES */
 
 /**
@@ -112,6 +124,9 @@ extern stdout_t vcom;
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
+uint8_t vcp_txService(void);
+void CDC_TxComplete_FS(void);
+vcp_tx_stats_t *vcp_getTxStats(void);
 /* USER CODE END EXPORTED_FUNCTIONS */
 /**
   * @}
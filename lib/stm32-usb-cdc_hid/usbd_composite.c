@@ -2,6 +2,7 @@
 #include "usbd_desc.h"
 #include "usbd_hid.h"
 #include "usbd_cdc.h"
+#include "usbd_cdc_if.h"
 #include "usbd_ctlreq.h"
 
 static uint8_t USBD_Composite_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
@@ -120,8 +121,14 @@ static uint8_t USBD_Composite_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTyped
 
 static uint8_t USBD_Composite_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum){
     int class_index;
+    uint8_t res;
     class_index = in_endpoint_to_class[epnum];
-    return USBD_Classes[class_index]->DataIn(pdev, epnum);
+    res = USBD_Classes[class_index]->DataIn(pdev, epnum);
+    if((epnum | 0x80) == CDC_IN_EP){
+        // Endpoint is free again, queue next packet
+        CDC_TxComplete_FS();
+    }
+    return res;
 }
 
 static uint8_t USBD_Composite_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum){
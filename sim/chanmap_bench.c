@@ -0,0 +1,245 @@
+/**
+ * ==============================================
+ * @file chanmap_bench.c
+ * @brief Host check of the compiled channel transforms.
+ *
+ * Every 16 bit input is run through the original division based
+ * mappings and through chanmap_apply() for the default calibration,
+ * corner cases and a set of pseudo random calibrations. Any mismatch
+ * is printed and makes the program exit with error.
+ * Then both pipelines are timed on a PPM frame of 8 channels.
+ * ==============================================
+ * */
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "board.h"
+#include "multiprotocol.h"
+#include "game_controller.h"
+#include "chanmap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define bench_stamp()           __rdtsc()
+#define BENCH_UNIT              "cycles"
+#else
+static uint64_t bench_stamp(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#define BENCH_UNIT              "ns"
+#endif
+
+#define BENCH_FRAMES            100000
+#define BENCH_CHANNELS          8
+#define RANDOM_CALIBRATIONS     2000
+
+typedef struct calibration{
+    uint16_t ppm_min, ppm_max;
+    uint16_t ch_min, ch_max;
+    uint16_t ch_min125, ch_max125;
+}calibration_t;
+
+static calibration_t cal;
+static uint32_t rnd_state = 0x1234567;
+static volatile uint16_t sink;
+
+/* Reference implementations, as they were before chanmap */
+static int16_t ref_map16b(int16_t x, int16_t in_min, int16_t in_max, int16_t out_min, int16_t out_max){
+    int32_t y;                          // long on target
+    x -= in_min;
+    y = out_max - out_min;
+    y *= x;
+    x = y / (in_max - in_min);
+    return x + out_min;
+}
+
+static uint16_t ref_ppm(uint16_t val){
+    val = ref_map16b(val, cal.ppm_min * 2, cal.ppm_max * 2, cal.ch_min, cal.ch_max);
+
+    if(val & 0x8000){
+        val = cal.ch_min125;
+    }else if(val > cal.ch_max125){
+        val = cal.ch_max125;
+    }
+    return val;
+}
+
+static int16_t ref_map(int16_t x, int16_t in_min, int16_t in_max, int16_t out_min, int16_t out_max){
+    return ((x - in_min) * (out_max - out_min) / (in_max - in_min)) + out_min;
+}
+
+static uint16_t ref_controller(uint16_t val){
+    if(val < PPM_MIN_PERIOD || val > PPM_MAX_PERIOD){
+        val = (PPM_MAX_PERIOD + PPM_MIN_PERIOD) / 2;
+    }
+    return ref_map(val, PPM_MIN_PERIOD, PPM_MAX_PERIOD, LOGICAL_MINIMUM, LOGICAL_MAXIMUM);
+}
+
+static uint16_t ref_frsky(uint16_t val){
+    return ((val*15) >> 4) + 1290;
+}
+
+static uint32_t xorshift(void){
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+static void ppm_compile(chanmap_t *map){
+    chanmap_compile(map, cal.ppm_min * 2, cal.ppm_max * 2, cal.ch_min, cal.ch_max, cal.ch_min125, cal.ch_max125);
+}
+
+static uint32_t check_ppm(void){
+    chanmap_t map;
+    uint32_t errors = 0;
+
+    if((int16_t)(cal.ppm_min * 2) == (int16_t)(cal.ppm_max * 2)){
+        return 0;                       // reference divides by zero
+    }
+
+    ppm_compile(&map);
+
+    for(uint32_t x = 0; x < 0x10000; x++){
+        uint16_t ref = ref_ppm(x);
+        uint16_t val = chanmap_apply(&map, x);
+        if(ref != val){
+            if(errors++ < 4){
+                printf("ppm [%u %u %u %u %u %u] x=%u ref=%u chanmap=%u\n",
+                    cal.ppm_min, cal.ppm_max, cal.ch_min, cal.ch_max, cal.ch_min125, cal.ch_max125,
+                    x, ref, val);
+            }
+        }
+    }
+    return errors;
+}
+
+static uint32_t check_controller(void){
+    chanmap_t map;
+    uint32_t errors = 0;
+
+    chanmap_compile(&map, PPM_MIN_PERIOD, PPM_MAX_PERIOD, LOGICAL_MINIMUM, LOGICAL_MAXIMUM, LOGICAL_MINIMUM, LOGICAL_MAXIMUM);
+
+    for(uint32_t x = 0; x < 0x10000; x++){
+        uint16_t in = x;
+        if(in < PPM_MIN_PERIOD || in > PPM_MAX_PERIOD){
+            in = (PPM_MAX_PERIOD + PPM_MIN_PERIOD) / 2;
+        }
+        if(ref_controller(x) != chanmap_apply(&map, in)){
+            if(errors++ < 4){
+                printf("controller x=%u ref=%u chanmap=%u\n", x, ref_controller(x), chanmap_apply(&map, in));
+            }
+        }
+    }
+    return errors;
+}
+
+/* channel_data never exceeds CHANNEL_MAX_125, check the positive int16 range */
+static uint32_t check_frsky(void){
+    static const chanmap_t map = CHANMAP_RATIO(0, 1290, 15, 16);
+    uint32_t errors = 0;
+
+    for(uint32_t x = 0; x < 0x8000; x++){
+        if(ref_frsky(x) != chanmap_apply(&map, x)){
+            if(errors++ < 4){
+                printf("frsky x=%u ref=%u chanmap=%u\n", x, ref_frsky(x), chanmap_apply(&map, x));
+            }
+        }
+    }
+    return errors;
+}
+
+static void bench(void){
+    static uint16_t frames[256][BENCH_CHANNELS];
+    chanmap_t map;
+    uint64_t start, ref_time, map_time;
+
+    for(uint32_t f = 0; f < 256; f++){
+        for(uint32_t c = 0; c < BENCH_CHANNELS; c++){
+            frames[f][c] = 1800 + (xorshift() % 2400);
+        }
+    }
+
+    cal = (calibration_t){PPM_MIN_100, PPM_MAX_100, CHANNEL_MIN_100, CHANNEL_MAX_100, CHANNEL_MIN_125, CHANNEL_MAX_125};
+
+    start = bench_stamp();
+    for(uint32_t f = 0; f < BENCH_FRAMES; f++){
+        uint16_t *frame = frames[f & 255];
+        for(uint32_t c = 0; c < BENCH_CHANNELS; c++){
+            sink = ref_frsky(ref_ppm(frame[c]));
+        }
+    }
+    ref_time = bench_stamp() - start;
+
+    start = bench_stamp();
+    for(uint32_t f = 0; f < BENCH_FRAMES; f++){
+        static const chanmap_t frsky = CHANMAP_RATIO(0, 1290, 15, 16);
+        uint16_t *frame = frames[f & 255];
+        if((f & 1023) == 0){
+            ppm_compile(&map);          // calibration reloads are part of the cost
+        }
+        for(uint32_t c = 0; c < BENCH_CHANNELS; c++){
+            sink = chanmap_apply(&frsky, chanmap_apply(&map, frame[c]));
+        }
+    }
+    map_time = bench_stamp() - start;
+
+    printf("frame of %u channels, host %s:\n", BENCH_CHANNELS, BENCH_UNIT);
+    printf("  map16b + clamp   %.1f\n", (double)ref_time / BENCH_FRAMES);
+    printf("  chanmap          %.1f\n", (double)map_time / BENCH_FRAMES);
+}
+
+int main(void){
+    uint32_t errors = 0, calibrations = 0;
+
+    static const calibration_t fixed[] = {
+        {PPM_MIN_100, PPM_MAX_100, CHANNEL_MIN_100, CHANNEL_MAX_100, CHANNEL_MIN_125, CHANNEL_MAX_125},
+        {PPM_MAX_100, PPM_MIN_100, CHANNEL_MIN_100, CHANNEL_MAX_100, CHANNEL_MIN_125, CHANNEL_MAX_125},
+        {PPM_MIN_100, PPM_MAX_100, CHANNEL_MAX_100, CHANNEL_MIN_100, CHANNEL_MIN_125, CHANNEL_MAX_125},
+        {PPM_MIN_100, PPM_MAX_100, 0, 0, 0, 0xFFFF},
+        {0, 0x7FFF, 0, 0xFFFF, 0x1234, 0xFFFF},
+        {1000, 1001, 0, 0xFFFF, 0, 0xFFFF},
+        {0xFFFF, 0, 0x8000, 0x7FFF, 0, 0x7FFF},
+    };
+
+    for(uint32_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++){
+        cal = fixed[i];
+        errors += check_ppm();
+        calibrations++;
+    }
+
+    for(uint32_t i = 0; i < RANDOM_CALIBRATIONS; i++){
+        uint32_t r = xorshift();
+        // half near real radios, half anywhere in 16 bit
+        if(i & 1){
+            cal.ppm_min = 700 + (r & 511);
+            cal.ppm_max = 1800 + ((r >> 9) & 511);
+            cal.ch_min = (r >> 18) & 511;
+            cal.ch_max = 1500 + (xorshift() & 1023);
+            cal.ch_min125 = 0;
+            cal.ch_max125 = 2047;
+        }else{
+            cal.ppm_min = r;
+            cal.ppm_max = r >> 16;
+            r = xorshift();
+            cal.ch_min = r;
+            cal.ch_max = r >> 16;
+            r = xorshift();
+            cal.ch_min125 = r;
+            cal.ch_max125 = r >> 16;
+        }
+        errors += check_ppm();
+        calibrations++;
+    }
+
+    errors += check_controller();
+    errors += check_frsky();
+
+    printf("%u ppm calibrations, controller and frsky transforms checked, %u mismatches\n", calibrations, errors);
+
+    bench();
+
+    return errors ? 1 : 0;
+}
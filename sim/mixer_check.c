@@ -0,0 +1,262 @@
+/**
+ * ==============================================
+ * @file mixer_check.c
+ * @brief Host check of the mixer stage.
+ *
+ * Sweeps sticks over the whole 125% range through the default model,
+ * curves, dual rate, trims, V-tail and elevon presets and compares
+ * every output against a straightforward floating point model of the
+ * same mix. Any output more than MIXER_TOLERANCE away is printed and
+ * makes the program exit with error.
+ * The cost of a full mixer pass is printed at the end.
+ * ==============================================
+ * */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "multiprotocol.h"
+#include "mixer.h"
+
+#define MIXER_TOLERANCE         2       // table interpolation and fixed point rounding
+#define SWEEP_STEP              3
+#define BENCH_PASSES            200000
+
+static uint32_t checks, errors;
+
+static double ref_curve(double x, int8_t expo, uint8_t rate){
+    double span = (CHANNEL_MAX_100 - CHANNEL_MIN_100) / 2;
+    double n = fabs(x) / span;
+    double y;
+
+    if(fabs(x) > 1024){
+        n = 1024 / span;
+    }
+
+    y = span * rate / 100.0 * ((100 - expo) / 100.0 * n + expo / 100.0 * n * n * n);
+    return (x < 0) ? -y : y;
+}
+
+/**
+ * @brief Floating point model of mixer_process
+ * */
+static void ref_mix(const mixer_model_t *model, const uint16_t *in, double *out, uint8_t aux){
+    double center = (CHANNEL_MAX_100 + CHANNEL_MIN_100) / 2;
+    double x[MAX_CHN_NUM];
+    uint32_t mixed = 0;
+
+    for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+        x[i] = in[i] - center;
+        if(i < MIXER_CURVES){
+            const mixer_curve_t *c = &model->curve[i];
+            uint8_t r = (c->sw != MIXER_NO_SWITCH && (aux & (1 << c->sw))) ? 1 : 0;
+            x[i] = ref_curve(x[i], c->expo[r], c->rate[r]) + model->trim[i];
+        }
+    }
+
+    for(uint8_t i = 0; i < model->lines; i++){
+        mixed |= 1 << model->line[i].dst;
+    }
+
+    for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+        out[i] = (mixed & (1 << i)) ? 0 : x[i];
+    }
+
+    for(uint8_t i = 0; i < model->lines; i++){
+        const mixer_line_t *l = &model->line[i];
+        if(l->sw == MIXER_NO_SWITCH || (aux & (1 << l->sw))){
+            out[l->dst] += x[l->src] * l->weight / 100.0;
+        }
+    }
+
+    for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+        out[i] += center;
+        if(out[i] < CHANNEL_MIN_125){
+            out[i] = CHANNEL_MIN_125;
+        }else if(out[i] > CHANNEL_MAX_125){
+            out[i] = CHANNEL_MAX_125;
+        }
+    }
+}
+
+static void compile(const mixer_model_t *model){
+    mixer_compile(model, CHANNEL_MIN_100, CHANNEL_MAX_100, CHANNEL_MIN_125, CHANNEL_MAX_125);
+}
+
+static void compare(const char *name, const mixer_model_t *model, const uint16_t *in, uint8_t aux, double tolerance){
+    uint16_t out[MAX_CHN_NUM];
+    double ref[MAX_CHN_NUM];
+
+    mixer_process(in, out, aux);
+    ref_mix(model, in, ref, aux);
+
+    for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+        checks++;
+        if(fabs(out[i] - ref[i]) > tolerance){
+            if(errors++ < 8){
+                printf("%s: aux=%u in[%u %u %u %u] out[%u]=%u expected %.1f\n",
+                    name, aux, in[0], in[1], in[2], in[3], i, out[i], ref[i]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Move two sticks over the whole range, others centered
+ * */
+static void sweep(const char *name, const mixer_model_t *model, uint8_t a, uint8_t b, uint8_t aux, double tolerance){
+    uint16_t in[MAX_CHN_NUM];
+
+    compile(model);
+
+    for(uint32_t va = CHANNEL_MIN_125; va <= CHANNEL_MAX_125; va += SWEEP_STEP){
+        for(uint32_t vb = CHANNEL_MIN_125; vb <= CHANNEL_MAX_125; vb += SWEEP_STEP * 16){
+            for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+                in[i] = (CHANNEL_MAX_100 + CHANNEL_MIN_100) / 2;
+            }
+            in[a] = va;
+            in[b] = vb;
+            compare(name, model, in, aux, tolerance);
+        }
+    }
+}
+
+static void expect(const char *name, uint32_t cond){
+    checks++;
+    if(!cond){
+        errors++;
+        printf("%s: failed\n", name);
+    }
+}
+
+/**
+ * @brief Default model must not change any value
+ * */
+static void check_passthrough(void){
+    mixer_model_t model;
+    uint16_t in[MAX_CHN_NUM], out[MAX_CHN_NUM];
+
+    mixer_default(&model);
+    compile(&model);
+
+    for(uint32_t v = CHANNEL_MIN_125; v <= CHANNEL_MAX_125; v++){
+        for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+            in[i] = (v + i * 97) % (CHANNEL_MAX_125 + 1);
+        }
+        mixer_process(in, out, v & 7);
+        expect("passthrough", memcmp(in, out, sizeof(in)) == 0);
+    }
+}
+
+static void check_curves(void){
+    mixer_model_t model;
+    uint16_t in[MAX_CHN_NUM], out[MAX_CHN_NUM];
+    uint16_t center = (CHANNEL_MAX_100 + CHANNEL_MIN_100) / 2;
+    int32_t prev = -1;
+
+    mixer_default(&model);
+    model.curve[AILERON].expo[0] = 60;
+    model.curve[AILERON].rate[0] = 100;
+    model.curve[AILERON].expo[1] = 0;
+    model.curve[AILERON].rate[1] = 50;
+    model.curve[AILERON].sw = 1;
+    model.curve[ELEVATOR].expo[0] = model.curve[ELEVATOR].expo[1] = -40;
+    model.curve[RUDDER].rate[0] = model.curve[RUDDER].rate[1] = 125;
+    compile(&model);
+
+    for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+        in[i] = center;
+    }
+
+    // expo keeps end points and center, monotonic and symmetric
+    for(uint32_t v = CHANNEL_MIN_100; v <= CHANNEL_MAX_100; v++){
+        uint16_t mirror;
+        in[AILERON] = v;
+        mixer_process(in, out, 0);
+        expect("expo monotonic", (int32_t)out[AILERON] >= prev);
+        prev = out[AILERON];
+        mirror = out[AILERON];
+        in[AILERON] = 2 * center - v;
+        mixer_process(in, out, 0);
+        expect("expo symmetric", (int32_t)(mirror - center) == (int32_t)(center - out[AILERON]));
+    }
+
+    in[AILERON] = center;
+    mixer_process(in, out, 0);
+    expect("expo center", out[AILERON] == center);
+    in[AILERON] = CHANNEL_MAX_100;
+    mixer_process(in, out, 0);
+    expect("expo end point", out[AILERON] == CHANNEL_MAX_100);
+    mixer_process(in, out, 1 << 1);
+    expect("dual rate end point", out[AILERON] == center + (CHANNEL_MAX_100 - center) / 2);
+
+    sweep("expo", &model, AILERON, ELEVATOR, 0, MIXER_TOLERANCE);
+    sweep("dual rate", &model, AILERON, ELEVATOR, 1 << 1, MIXER_TOLERANCE);
+    sweep("rate 125", &model, RUDDER, THROTTLE, 0, MIXER_TOLERANCE);
+}
+
+static void check_mixes(void){
+    mixer_model_t model;
+
+    mixer_default(&model);
+    model.trim[ELEVATOR] = 25;
+    model.trim[RUDDER] = -40;
+
+    mixer_preset(&model, MIXER_PRESET_VTAIL);
+    sweep("vtail", &model, ELEVATOR, RUDDER, 0, MIXER_TOLERANCE);
+    sweep("vtail", &model, RUDDER, ELEVATOR, 0, MIXER_TOLERANCE);
+
+    mixer_preset(&model, MIXER_PRESET_ELEVON);
+    sweep("elevon", &model, AILERON, ELEVATOR, 0, MIXER_TOLERANCE);
+    sweep("elevon", &model, ELEVATOR, AILERON, 0, MIXER_TOLERANCE);
+
+    // switched line, aux channel mixed into throttle
+    mixer_preset(&model, MIXER_PRESET_NONE);
+    mixer_addLine(&model, THROTTLE, THROTTLE, 100, MIXER_NO_SWITCH);
+    mixer_addLine(&model, CH6, THROTTLE, -30, 2);
+    sweep("switched line off", &model, THROTTLE, CH6, 0, MIXER_TOLERANCE);
+    sweep("switched line on", &model, THROTTLE, CH6, 1 << 2, MIXER_TOLERANCE);
+}
+
+/**
+ * @brief Time a worst case pass, every line active
+ * */
+static void bench(void){
+    mixer_model_t model;
+    uint16_t in[MAX_CHN_NUM], out[MAX_CHN_NUM];
+    struct timespec start, end;
+    double ns;
+
+    mixer_default(&model);
+    for(uint8_t i = 0; i < MIXER_LINES; i++){
+        mixer_addLine(&model, i % MIXER_CURVES, i, 100, i & 1 ? 0 : MIXER_NO_SWITCH);
+    }
+    compile(&model);
+
+    for(uint8_t i = 0; i < MAX_CHN_NUM; i++){
+        in[i] = CHANNEL_MIN_100 + i * 100;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t n = 0; n < BENCH_PASSES; n++){
+        in[n & 3] = CHANNEL_MIN_125 + (n & 2047);
+        mixer_process(in, out, 1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("%u lines, %u channels: %.1f ns per pass on host\n", MIXER_LINES, MAX_CHN_NUM, ns / BENCH_PASSES);
+}
+
+int main(void){
+    check_passthrough();
+    check_curves();
+    check_mixes();
+
+    printf("%u checks, %u errors\n", checks, errors);
+
+    bench();
+
+    return errors ? 1 : 0;
+}
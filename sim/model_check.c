@@ -0,0 +1,336 @@
+/**
+ * ==============================================
+ * @file model_check.c
+ * @brief Host check of the model memory.
+ *
+ * Runs model.c and the eeprom journal over flash pages kept
+ * in a file, every check reopens the file as a power cycle would.
+ * Records are saved, reloaded, overwritten and erased, then the
+ * image is damaged on purpose: single bit flips, wrong version,
+ * size and slot, good CRC over bad values and random garbage.
+ * A damaged slot must read as empty and never as a different model.
+ * Any failure is printed and makes the program exit with error.
+ * ==============================================
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "board.h"
+#include "nvjournal.h"
+#include "multiprotocol.h"
+#include "model.h"
+#include "sim_crc.h"
+
+#define FLASH_SIZE              (NVJ_PAGE_SIZE * NVJ_PAGES)
+#define FLIP_ROUNDS             2000
+#define GARBAGE_ROUNDS          200
+#define HISTORY_LEN             8
+
+/* Flash pages, linker symbols are aliased to them */
+uint32_t flash_page[FLASH_SIZE / 4];
+__asm__(
+    ".globl _seeprom\n .set _seeprom, flash_page\n"
+    ".globl _eeeprom\n .set _eeeprom, flash_page + 2048\n"
+);
+
+static const char *image = "model_check.bin";
+static uint32_t checks, errors;
+static uint32_t rnd_state = 0x2545F491;
+static model_t history[MODEL_NUM][HISTORY_LEN];
+static uint8_t history_len[MODEL_NUM];
+
+static uint32_t xorshift(void){
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+static void image_store(void){
+    FILE *fp = fopen(image, "wb");
+
+    if(fp == NULL || fwrite(flash_page, 1, sizeof(flash_page), fp) != sizeof(flash_page)){
+        fprintf(stderr, "cannot write %s\n", image);
+        exit(1);
+    }
+    fclose(fp);
+}
+
+/**
+ * @brief Power cycle, flash content comes back from file
+ * */
+static void image_reload(void){
+    FILE *fp = fopen(image, "rb");
+
+    memset(flash_page, 0xFF, sizeof(flash_page));
+    if(fp != NULL){
+        if(fread(flash_page, 1, sizeof(flash_page), fp) != sizeof(flash_page)){
+            memset(flash_page, 0xFF, sizeof(flash_page));
+        }
+        fclose(fp);
+    }
+    nvj_init();
+}
+
+static void image_patch(uint32_t offset, uint8_t xor){
+    ((uint8_t*)flash_page)[offset] ^= xor;
+    image_store();
+    image_reload();
+}
+
+/* Board functions used by the eeprom emulation */
+uint32_t flashWrite(uint8_t *dst, uint8_t *data, uint16_t count){
+    uint8_t *start = (uint8_t*)flash_page;
+
+    if(dst < start || dst + count > start + sizeof(flash_page)){
+        return HAL_ERROR;
+    }
+    for(uint16_t i = 0; i < count; i++){
+        dst[i] &= data[i];
+    }
+    image_store();
+    return HAL_OK;
+}
+
+uint32_t flashPageErase(uint32_t address){
+    uint32_t offset = address - (uint32_t)(uintptr_t)flash_page;
+
+    if(offset >= sizeof(flash_page)){
+        return 0;
+    }
+    memset((uint8_t*)flash_page + (offset & ~(NVJ_PAGE_SIZE - 1)), 0xFF, NVJ_PAGE_SIZE);
+    image_store();
+    return 1;
+}
+
+uint32_t crcCalc(const uint32_t *data, uint32_t len){
+    return sim_crc32(data, len);
+}
+
+static void expect(const char *name, uint32_t cond){
+    checks++;
+    if(!cond){
+        if(errors++ < 16){
+            printf("%s: failed\n", name);
+        }
+    }
+}
+
+static uint32_t record_offset(uint8_t slot){
+    return MODEL_STORE_OFFSET + slot * sizeof(model_record_t);
+}
+
+static void make_model(model_t *model, uint8_t seed){
+    memset(model, 0, sizeof(model_t));
+    snprintf(model->name, MODEL_NAME_LEN, "m%u", seed);
+    model->protocol = PROTO_FRSKYD;
+    model->rx_num = seed;
+    model->option = -seed;
+    model->power = seed & 1;
+    model->autobind = (seed >> 1) & 1;
+    model->chan_order = 0x12340000 + seed;
+    model->calib[MODEL_CH_MAX_100] = CHANNEL_MAX_100 - seed;
+    model->calib[MODEL_CH_MIN_100] = CHANNEL_MIN_100 + seed;
+    model->calib[MODEL_CH_MAX_125] = CHANNEL_MAX_125;
+    model->calib[MODEL_CH_MIN_125] = CHANNEL_MIN_125;
+    model->calib[MODEL_PPM_MAX_100] = PPM_MAX_100 + seed;
+    model->calib[MODEL_PPM_MIN_100] = PPM_MIN_100 - seed;
+    model->calib[MODEL_CH_SWITCH] = CHANNEL_SWITCH;
+    model->calib[MODEL_PPM_DEFAULT] = PPM_DEFAULT_VALUE;
+    mixer_default(&model->mixer);
+    mixer_preset(&model->mixer, seed % 3);
+    model->mixer.trim[ELEVATOR] = seed * 3;
+}
+
+static void save(uint8_t slot, const model_t *model){
+    uint8_t known = 0;
+
+    for(uint8_t i = 0; i < history_len[slot]; i++){
+        known |= memcmp(&history[slot][i], model, sizeof(model_t)) == 0;
+    }
+    if(!known && history_len[slot] < HISTORY_LEN){
+        history[slot][history_len[slot]++] = *model;
+    }
+    expect("save", model_save(slot, model));
+    expect("sync", nvj_sync() != 0);
+    image_reload();
+}
+
+/**
+ * @brief Slot must read as the given model, or as empty if model is NULL
+ * */
+static void check_slot(const char *name, uint8_t slot, const model_t *model){
+    model_t loaded;
+    uint8_t res = model_load(slot, &loaded);
+
+    if(model == NULL){
+        expect(name, res == 0);
+    }else{
+        expect(name, res == 1 && memcmp(&loaded, model, sizeof(model_t)) == 0);
+    }
+}
+
+static void check_all(const char *name, model_t *models, uint8_t *stored){
+    for(uint8_t i = 0; i < MODEL_NUM; i++){
+        check_slot(name, i, stored[i] ? &models[i] : NULL);
+    }
+}
+
+/**
+ * @brief Rewrite record through the journal after changing one byte,
+ * with the model CRC fixed when asked to
+ * */
+static void forge(uint8_t slot, uint32_t field, uint8_t xor, uint8_t fix_crc){
+    model_record_t record;
+
+    nvj_read(record_offset(slot), (uint8_t*)&record, sizeof(model_record_t));
+    ((uint8_t*)&record)[field] ^= xor;
+    if(fix_crc){
+        record.crc = crcCalc((uint32_t*)&record, (sizeof(model_record_t) - 4) / 4);
+    }
+    nvj_write(record_offset(slot), (uint8_t*)&record, sizeof(model_record_t));
+    expect("sync", nvj_sync() != 0);
+    image_reload();
+}
+
+/**
+ * @brief After damage on flash a slot may roll back to an older
+ * save or read as empty, but never as something else
+ * */
+static void check_history(const char *name, uint8_t slot){
+    model_t loaded;
+
+    checks++;
+    if(!model_load(slot, &loaded)){
+        return;
+    }
+    for(uint8_t i = 0; i < history_len[slot]; i++){
+        if(memcmp(&loaded, &history[slot][i], sizeof(model_t)) == 0){
+            return;
+        }
+    }
+    if(errors++ < 16){
+        printf("%s: slot %u holds a model never saved\n", name, slot);
+    }
+}
+
+int main(int argc, char **argv){
+    model_t models[MODEL_NUM];
+    uint8_t stored[MODEL_NUM] = {0};
+    uint32_t reference = 0x12345678;
+    uint8_t backup[FLASH_SIZE];
+    uint8_t settings[MODEL_STORE_OFFSET];
+
+    if(argc > 1){
+        image = argv[1];
+    }
+    remove(image);
+    image_reload();
+
+    for(uint8_t i = 0; i < MODEL_STORE_OFFSET; i++){
+        settings[i] = i * 7;
+    }
+    nvj_write(0, settings, MODEL_STORE_OFFSET);
+    nvj_sync();
+    image_reload();
+
+    // Same result as the CRC unit
+    expect("crc", crcCalc(&reference, 1) == 0xDF8A8A2B);
+
+    // Erased flash
+    check_all("erased", models, stored);
+    expect("bad slot", model_load(MODEL_NUM, &models[0]) == 0);
+
+    for(uint8_t i = 0; i < MODEL_NUM; i++){
+        make_model(&models[i], i + 1);
+    }
+
+    // Save one by one, others must not change
+    for(uint8_t i = 0; i < MODEL_NUM; i++){
+        save(i, &models[i]);
+        stored[i] = 1;
+        check_all("save", models, stored);
+    }
+
+    // Overwrite and erase
+    make_model(&models[2], 40);
+    save(2, &models[2]);
+    check_all("overwrite", models, stored);
+    expect("erase", model_erase(1));
+    expect("sync", nvj_sync() != 0);
+    image_reload();
+    stored[1] = 0;
+    check_all("erase", models, stored);
+    save(1, &models[1]);
+    stored[1] = 1;
+
+    // Settings block in front of records is not touched
+    nvj_read(0, backup, MODEL_STORE_OFFSET);
+    expect("settings", memcmp(backup, settings, MODEL_STORE_OFFSET) == 0);
+
+    // Values that would break transforms are refused even with good CRC
+    models[0].calib[MODEL_PPM_MIN_100] = models[0].calib[MODEL_PPM_MAX_100];
+    expect("save bad values", model_save(0, &models[0]) == 0);
+    models[0].calib[MODEL_PPM_MIN_100] = PPM_MIN_100 - 1;
+    forge(0, offsetof(model_record_t, model) + offsetof(model_t, mixer) + offsetof(mixer_model_t, lines), 0x20, 1);
+    check_slot("forged lines", 0, NULL);
+    save(0, &models[0]);
+    forge(0, offsetof(model_record_t, model) + offsetof(model_t, mixer) + offsetof(mixer_model_t, preset), 0x07, 1);
+    check_slot("forged preset", 0, NULL);
+
+    // Header checks
+    save(0, &models[0]);
+    forge(0, offsetof(model_record_t, version), 0x03, 1);
+    check_slot("version", 0, NULL);
+    save(0, &models[0]);
+    forge(0, offsetof(model_record_t, size), 0x04, 1);
+    check_slot("size", 0, NULL);
+    save(0, &models[0]);
+    forge(0, offsetof(model_record_t, slot), 0x01, 1);
+    check_slot("slot", 0, NULL);
+    save(0, &models[0]);
+    check_all("restored", models, stored);
+
+    // Single bit flips anywhere in a record
+    for(uint32_t n = 0; n < FLIP_ROUNDS; n++){
+        uint8_t slot = xorshift() % MODEL_NUM;
+
+        forge(slot, xorshift() % sizeof(model_record_t), 1 << (xorshift() & 7), 0);
+        for(uint8_t i = 0; i < MODEL_NUM; i++){
+            check_slot("bit flip", i, (i == slot) ? NULL : &models[i]);
+        }
+        save(slot, &models[slot]);
+    }
+
+    // Bit flips on flash, journal drops the damaged record and what follows
+    memcpy(backup, flash_page, sizeof(backup));
+    for(uint32_t n = 0; n < FLIP_ROUNDS; n++){
+        image_patch(xorshift() % FLASH_SIZE, 1 << (xorshift() & 7));
+        for(uint8_t i = 0; i < MODEL_NUM; i++){
+            check_history("flash bit flip", i);
+        }
+        memcpy(flash_page, backup, sizeof(backup));
+        image_store();
+        image_reload();
+    }
+    check_all("restored", models, stored);
+
+    // Garbage pages, nothing may load
+    for(uint32_t n = 0; n < GARBAGE_ROUNDS; n++){
+        for(uint32_t i = 0; i < FLASH_SIZE / 4; i++){
+            flash_page[i] = xorshift();
+        }
+        image_store();
+        image_reload();
+        memset(stored, 0, sizeof(stored));
+        check_all("garbage", models, stored);
+    }
+
+    printf("%u checks, %u errors, record %u bytes, %u slots\n",
+        checks, errors, (uint32_t)sizeof(model_record_t), MODEL_NUM);
+
+    remove(image);
+    return errors ? 1 : 0;
+}
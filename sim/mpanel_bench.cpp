@@ -0,0 +1,419 @@
+/**
+ * ==============================================
+ * @file mpanel_bench.cpp
+ * @brief Host check of the message panel drawing.
+ *
+ * Characters, icons and rectangles are drawn at random positions,
+ * clipped ones included, through the panel and through the per pixel
+ * drawing it had before on a reference frame buffer. The reference
+ * reads icons and the seven segment font from the rows they are
+ * converted from at compile time. The panel page transfers are decoded
+ * into a model of the display memory and after each update it must
+ * match the reference. Drawing on the live screen must not change the
+ * display until it is shown. Any mismatch is printed and
+ * makes the program exit with error.
+ * Then MpanelDro::update() is timed on both, for the seven segment and
+ * the small font values on the main screen.
+ * ==============================================
+ * */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "board.h"
+#include "mpanel.h"
+#include <strfunc.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define bench_stamp()           __rdtsc()
+#define BENCH_UNIT              "cycles"
+#else
+static uint64_t bench_stamp(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#define BENCH_UNIT              "ns"
+#endif
+
+#define ROUNDS                  20000
+#define DRAWS_PER_ROUND         4
+#define BENCH_UPDATES           100000
+
+static uint8_t ref_fb[MPANEL_PAGES][MPANEL_W];
+static uint8_t ref_dirty_x0[MPANEL_PAGES], ref_dirty_x1[MPANEL_PAGES];
+static uint8_t live_fb[MPANEL_PAGES][MPANEL_W];    // reference of the live screen
+static uint8_t disp[MPANEL_PAGES][MPANEL_W];   // display memory model
+static uint32_t tick, transfers, bad_packets;
+static uint32_t rnd_state = 0x1234567;
+
+MPANEL_BITMAP(ico_volt_data, 7, 8,
+    0x7f,0x5d,0x5d,0x5d,0x5d,0x6b,0x77,0x7f
+);
+
+MPANEL_BITMAP(ico_amph_data, 10, 8,
+    0x03,0xff,0x03,0x3f,0x02,0xd7,0x02,0xd7,0x02,0x13,0x02,0xd5,0x02,0xd5,0x03,0xff
+);
+
+MPANEL_BITMAP(ico_lowbat_data, 29, 7,
+    0x1f,0xff,0xff,0xff,0x17,0xff,0xff,0xff,0x17,0x9b,0xb7,0xb1,0x17,0x6b,
+    0xb3,0x5b,0x17,0x6a,0xb5,0x1b,0x11,0x9d,0x71,0x5b,0x1f,0xff,0xff,0xff
+);
+
+MPANEL_BITMAP(ico_tall_data, 9, 19,
+    0x01,0xff,0x01,0x01,0x01,0x7d,0x01,0x45,0x01,0x45,0x01,0x7d,0x01,0x01,
+    0x00,0xfe,0x00,0x82,0x00,0xba,0x00,0x82,0x00,0xfe,0x00,0x10,0x00,0x38,
+    0x00,0x7c,0x00,0xfe,0x01,0xff,0x01,0x55,0x00,0xaa
+);
+
+static const struct {
+    const idata_t *icon;
+    const uint8_t *rows;
+}icons[] = {
+    {&ico_volt_data, ico_volt_data_rows},
+    {&ico_amph_data, ico_amph_data_rows},
+    {&ico_lowbat_data, ico_lowbat_data_rows},
+    {&ico_tall_data, ico_tall_data_rows},
+};
+
+/* Seven segment font as rows, the source of the panel font */
+static const uint8_t seven_seg_rows[] = {
+0x7f,0xe0,0xff,0xf0,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xff,0xf0,0x7f,0xe0,
+0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,
+0xff,0xe0,0xff,0xf0,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0xff,0xf0,0xff,0xf0,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xff,0xf0,0x7f,0xf0,
+0xff,0xe0,0xff,0xf0,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0xff,0xf0,0xff,0xf0,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0xff,0xf0,0xff,0xe0,
+0x00,0x00,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xff,0xf0,0xff,0xf0,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,
+0x7f,0xf0,0xff,0xf0,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xff,0xf0,0xff,0xf0,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0xff,0xf0,0xff,0xe0,
+0x7f,0xf0,0xff,0xf0,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xff,0xe0,0xff,0xf0,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xff,0xf0,0x7f,0xe0,
+0xff,0xe0,0xff,0xf0,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,
+0x3f,0xe0,0xff,0xf0,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xff,0xf0,0xff,0xf0,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xff,0xf0,0x7f,0xe0,
+0x7f,0xe0,0xff,0xf0,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xc0,0x30,0xff,0xf0,0xff,0xf0,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x00,0x30,0x7f,0xf0,0x7f,0xe0,
+0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+};
+
+static font_t ref_seven_seg = {
+    .w = 12,
+    .h = 20,
+    .data = seven_seg_rows,
+    .data_len = sizeof(seven_seg_rows),
+    .bpl = 2,
+    .offset = '0',
+    .spacing = 1
+};
+
+#define ICON_NUM                (sizeof(icons) / sizeof(icons[0]))
+
+/* Target services used by the panel */
+extern "C" {
+I2C_HandleTypeDef hi2c2;
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data, uint16_t size, uint32_t timeout){
+    return HAL_OK;
+}
+
+/**
+ * Page transfers complete at once, the address window commands are
+ * decoded and the data written to the display model
+ * */
+uint8_t I2C_Queue(i2c_block_t *blk){
+    static const uint8_t cmd[] = {0x80, 0x21, 0x80, 0, 0x80, 0, 0x80, 0x22, 0x80, 0, 0x80, 0, 0x40};
+    const uint8_t *p = blk->data;
+    uint8_t x0 = p[3], x1 = p[5], page = p[9];
+
+    for(uint8_t i = 0; i < MPANEL_CMD_SIZE; i++){
+        if(cmd[i] && p[i] != cmd[i]){
+            bad_packets++;
+        }
+    }
+
+    if(blk->address != MPANEL_I2C_ADDRESS || page >= MPANEL_PAGES || p[11] != page ||
+        x0 > x1 || x1 >= MPANEL_W || blk->size != MPANEL_CMD_SIZE + x1 - x0 + 1){
+        bad_packets++;
+    }else{
+        memcpy(&disp[page][x0], p + MPANEL_CMD_SIZE, x1 - x0 + 1);
+    }
+
+    transfers++;
+    blk->state = I2C_BLOCK_IDLE;
+    return 1;
+}
+
+uint8_t I2C_IsBusy(void){
+    return 0;
+}
+
+uint32_t getTick(void){
+    return tick;
+}
+
+void __disable_irq(void){}
+void __enable_irq(void){}
+}
+
+/* Reference drawing, per pixel as it was before the blitter */
+static void __attribute__((noinline)) ref_pixel(uint16_t x, uint16_t y, uint16_t color){
+    uint8_t page, *p, value;
+
+    if(x >= MPANEL_W || y >= MPANEL_H){
+        return;
+    }
+
+    page = y >> 3;
+    p = &ref_fb[page][x];
+    value = (color != BLACK) ? *p | (1 << (y & 7)) : *p & ~(1 << (y & 7));
+
+    if(value == *p){
+        return;
+    }
+
+    *p = value;
+    if(x < ref_dirty_x0[page]){
+        ref_dirty_x0[page] = x;
+    }
+    if(x > ref_dirty_x1[page]){
+        ref_dirty_x1[page] = x;
+    }
+}
+
+static void ref_fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color){
+    for(uint16_t i = x; i < x + w; i++){
+        for(uint16_t j = y; j < y + h; j++){
+            ref_pixel(i, j, color);
+        }
+    }
+}
+
+static void ref_drawIcon(uint16_t x, uint16_t y, const idata_t *data, const uint8_t *p){
+    for(uint8_t h = y; h < y + data->hight; h++, p++){
+        uint8_t line = *p;
+        uint8_t mask = (data->width-1) % 8;
+        mask = (1 << mask);
+        for(uint8_t w = x; w < x + data->width; w++, mask >>= 1){
+            if(mask == 0){
+                mask = 0x80;
+                line = *(++p);
+            }
+            if(line & mask)
+                ref_pixel(w, h, WHITE);
+            else
+                ref_pixel(w, h, BLACK);
+        }
+    }
+}
+
+static uint16_t ref_drawChar(uint16_t x, uint16_t y, uint8_t c, font_t *font){
+    const uint8_t *p;
+
+    if(c == '.' && font == &ref_seven_seg){
+        ref_fillRect(x-1, y, 4, 20, BLACK);
+        ref_fillRect(x, y + 20 - 2, 2, 2, WHITE);
+        return x + 3;
+    }
+
+    c -= font->offset;
+    p = font->data + (c * font->h * font->bpl);
+
+    if(p + font->h * font->bpl > font->data + font->data_len)
+        return x;
+
+    for(uint16_t h = y; h < y + font->h; h++, p++){
+        uint8_t line = *p;
+        for(uint16_t w = x, bc = 0; w < x + font->w; w++, bc++){
+            if(bc == 8){
+                bc = 0;
+                line = *(++p);
+            }
+            if(line & (0x80>>bc))
+                ref_pixel(w, h, WHITE);
+            else
+                ref_pixel(w, h, BLACK);
+        }
+    }
+    return x + font->w + font->spacing;
+}
+
+static void ref_print(uint16_t x, uint16_t y, font_t *font, const char *fmt, ...){
+    char buf[PANEL_MAX_LEN];
+    uint8_t i = 0;
+    va_list arp;
+    va_start(arp, fmt);
+    strformater(buf, fmt, arp);
+    va_end(arp);
+
+    while(buf[i] != '\0'){
+        x = ref_drawChar(x, y, buf[i++], font);
+    }
+}
+
+static uint32_t rnd(void){
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+static uint32_t compare(uint32_t round){
+    uint32_t errors = 0;
+
+    while(!requestLcdUpdate()){
+        tick++;
+    }
+
+    for(uint8_t page = 0; page < MPANEL_PAGES; page++){
+        for(uint8_t x = 0; x < MPANEL_W; x++){
+            if(disp[page][x] != ref_fb[page][x]){
+                if(errors < 8){
+                    printf("round %u: page %u column %u is %02x, expected %02x\n",
+                        round, page, x, disp[page][x], ref_fb[page][x]);
+                }
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+/**
+ * @brief Same random item drawn on panel and reference
+ * */
+static void draw_random(void){
+    uint16_t x = rnd() % (MPANEL_W + 8);
+    uint16_t y = rnd() % (MPANEL_H + 4);
+    uint16_t w = rnd() % 40, h = rnd() % 24;
+    uint16_t color = rnd() & 1;
+    uint8_t icon = rnd() % ICON_NUM;
+    uint32_t value = rnd();
+
+    switch(rnd() % 5){
+        case 0:
+            MPANEL_fillRect(x, y, w, h, color);
+            ref_fillRect(x, y, w, h, color);
+            break;
+
+        case 1:
+            MPANEL_drawIcon(x, y, icons[icon].icon);
+            ref_drawIcon(x, y, icons[icon].icon, icons[icon].rows);
+            break;
+
+        case 2:
+            MPANEL_print(x, y, &font_seven_seg, "%.2f", (value % 10000) / 100.0);
+            ref_print(x, y, &ref_seven_seg, "%.2f", (value % 10000) / 100.0);
+            break;
+
+        case 3:
+            MPANEL_print(x, y, &pixelDustFont, "%3uMA", value % 1000);
+            ref_print(x, y, &pixelDustFont, "%3uMA", value % 1000);
+            break;
+
+        default:
+            MPANEL_print(x, y, &pixelDustFont, "V%u.%u", value % 10, (value >> 8) % 100);
+            ref_print(x, y, &pixelDustFont, "V%u.%u", value % 10, (value >> 8) % 100);
+            break;
+    }
+}
+
+/**
+ * @brief Random drawing on both, display model must follow reference
+ * */
+static uint32_t check_draw(void){
+    uint32_t errors = compare(0);
+
+    for(uint32_t round = 1; round <= ROUNDS && errors == 0; round++){
+        for(uint8_t i = 0; i < DRAWS_PER_ROUND; i++){
+            draw_random();
+        }
+        errors += compare(round);
+    }
+
+    if(bad_packets){
+        printf("%u malformed page transfers\n", bad_packets);
+        errors++;
+    }
+
+    printf("draw: %u rounds, %u page transfers, %u errors\n", ROUNDS, transfers, errors);
+    return errors;
+}
+
+/**
+ * @brief Drawing on the live screen while main is shown must not reach
+ * the display, showing a screen sends all of it
+ * */
+static uint32_t check_screens(void){
+    static uint8_t main_fb[MPANEL_PAGES][MPANEL_W];
+    uint32_t errors = 0;
+
+    for(uint32_t round = 1; round <= ROUNDS / 100 && errors == 0; round++){
+        memcpy(main_fb, ref_fb, sizeof(ref_fb));
+        memcpy(ref_fb, live_fb, sizeof(ref_fb));
+
+        MPANEL_setTarget(MPANEL_SCREEN_LIVE);
+        for(uint8_t i = 0; i < DRAWS_PER_ROUND; i++){
+            draw_random();
+        }
+        MPANEL_setTarget(MPANEL_SCREEN_MAIN);
+        memcpy(live_fb, ref_fb, sizeof(ref_fb));
+
+        memcpy(ref_fb, main_fb, sizeof(ref_fb));
+        errors += compare(round);
+
+        MPANEL_show(MPANEL_SCREEN_LIVE);
+        memcpy(ref_fb, live_fb, sizeof(ref_fb));
+        errors += compare(round);
+
+        MPANEL_show(MPANEL_SCREEN_MAIN);
+        memcpy(ref_fb, main_fb, sizeof(ref_fb));
+        errors += compare(round);
+    }
+
+    printf("screens: %u rounds, %u errors\n", ROUNDS / 100, errors);
+    return errors;
+}
+
+/**
+ * @brief Cycles per value update, new value on every call
+ * */
+static void bench_dro(const char *name, MpanelDro *dro, uint16_t x, uint16_t y, const char *fmt, font_t *font, uint8_t is_float){
+    uint64_t start, panel, ref;
+
+    start = bench_stamp();
+    for(uint32_t i = 0; i < BENCH_UPDATES; i++){
+        if(is_float){
+            dro->update((i % 1000) / 100.0f);
+        }else{
+            dro->update((uint32_t)(i % 1000));
+        }
+    }
+    panel = bench_stamp() - start;
+
+    start = bench_stamp();
+    for(uint32_t i = 0; i < BENCH_UPDATES; i++){
+        if(is_float){
+            ref_print(x, y, font, fmt, (i % 1000) / 100.0f);
+        }else{
+            ref_print(x, y, font, fmt, (uint32_t)(i % 1000));
+        }
+    }
+    ref = bench_stamp() - start;
+
+    printf("%-10s per pixel %6.0f %s/update, blitter %6.0f %s/update, %.1fx\n", name,
+        (double)ref / BENCH_UPDATES, BENCH_UNIT,
+        (double)panel / BENCH_UPDATES, BENCH_UNIT,
+        (double)ref / panel);
+}
+
+int main(void){
+    MpanelDro dro_bat(1, 0, "%.2f", &font_seven_seg);
+    MpanelDro dro_ma(1, 24, "%3uMA", &pixelDustFont);
+    uint32_t errors;
+
+    MPANEL_init();
+    errors = check_draw();
+    errors += check_screens();
+
+    bench_dro("seven seg", &dro_bat, 1, 0, "%.2f", &ref_seven_seg, 1);
+    bench_dro("pixeldust", &dro_ma, 1, 24, "%3uMA", &pixelDustFont, 0);
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,325 @@
+/**
+ * ==============================================
+ * @file nvj_check.c
+ * @brief Host check of the eeprom journal under power loss.
+ *
+ * Random saves are committed with nvj_step() on a model of the two
+ * flash pages, each step gets a random time budget and is sometimes
+ * allowed to erase, more writes come in while a commit is in progress.
+ * A step must never program longer than its budget nor erase unless
+ * allowed. Power is cut at random points: the half-word being
+ * programmed gets only part of its bits cleared, an erase in progress
+ * leaves the page with random content, and nothing after the cut reaches
+ * flash. After every cut the journal is mounted again and its content
+ * must match either the last completed commit or the one that was cut.
+ * Clean restarts must always give back the last commit.
+ * Flash usage is compared with rewriting the whole page on each save.
+ * Before that, a flat image left by the former eeprom emulation is
+ * imported with a power cut on every flash operation in turn, the old
+ * page must stay readable until the journal holds the whole image.
+ * Any failure is printed and makes the program exit with error.
+ * ==============================================
+ * */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "board.h"
+#include "nvjournal.h"
+#include "model.h"
+#include "sim_crc.h"
+
+#define FLASH_SIZE              (NVJ_PAGE_SIZE * NVJ_PAGES)
+#define SAVES                   50000
+#define CUT_ONE_IN              8       // saves with a power cut
+#define CUT_MAX_OPS             400     // cut happens within this many flash operations
+#define RESTART_ONE_IN          16
+#define MODEL_SAVE_ONE_IN       10
+#define MODELS_IN_USE           2
+#define STEP_MAX_US             2000    // budget given to a step, up to
+#define ERASE_ONE_IN            4       // steps allowed to erase
+#define LATE_WRITE_ONE_IN       16      // steps followed by writes for next commit
+#define HALFWORD_US             52
+#define LEGACY_FLAG             29      // bind flag on settings block
+#define LEGACY_FLAG_VALUE       0xF0
+#define ERASE_US                20000
+
+/* Flash pages, linker symbols are aliased to them */
+uint32_t flash_page[FLASH_SIZE / 4];
+__asm__(
+    ".globl _seeprom\n .set _seeprom, flash_page\n"
+    ".globl _eeeprom\n .set _eeeprom, flash_page + 2048\n"
+);
+
+static struct {
+    int32_t  ops_left;                  // flash operations until power cut, -1 if not armed
+    uint8_t  cut;
+    uint64_t halfwords;
+    uint32_t erases[NVJ_PAGES];
+    uint32_t step_us;                   // flash time on current step
+    uint8_t  step_erases;
+}power;
+
+static uint32_t checks, errors;
+static uint32_t rnd_state = 0x6C078965;
+
+static uint32_t xorshift(void){
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+/**
+ * @brief Count one flash operation, returns 1 if power goes away now
+ * */
+static uint8_t power_lost(void){
+    if(power.ops_left < 0){
+        return 0;
+    }
+    if(power.ops_left-- == 0){
+        power.cut = 1;
+        return 1;
+    }
+    return 0;
+}
+
+uint32_t flashWrite(uint8_t *dst, uint8_t *data, uint16_t count){
+    uint8_t *start = (uint8_t*)flash_page;
+
+    if(dst < start || dst + count > start + sizeof(flash_page) || power.cut){
+        return HAL_ERROR;
+    }
+
+    for(uint16_t i = 0; i < count; i += 2){
+        if(power_lost()){
+            // torn half-word, only some bits got programmed
+            uint16_t partial = xorshift();
+            dst[i] &= data[i] | partial;
+            dst[i + 1] &= data[i + 1] | (partial >> 8);
+            return HAL_ERROR;
+        }
+        dst[i] &= data[i];
+        dst[i + 1] &= data[i + 1];
+        power.halfwords++;
+        power.step_us += NVJ_HALFWORD_US;
+    }
+    return HAL_OK;
+}
+
+uint32_t flashPageErase(uint32_t address){
+    uint32_t offset = address - (uint32_t)(uintptr_t)flash_page;
+    uint8_t *page;
+
+    if(offset >= sizeof(flash_page) || power.cut){
+        return 0;
+    }
+
+    page = (uint8_t*)flash_page + (offset & ~(NVJ_PAGE_SIZE - 1));
+    power.erases[offset / NVJ_PAGE_SIZE]++;
+    power.step_erases++;
+
+    if(power_lost()){
+        // erase stopped half way, bits are set at random
+        for(uint16_t i = 0; i < NVJ_PAGE_SIZE; i++){
+            page[i] |= xorshift();
+        }
+        return 0;
+    }
+
+    memset(page, 0xFF, NVJ_PAGE_SIZE);
+    return 1;
+}
+
+uint32_t crcCalc(const uint32_t *data, uint32_t len){
+    return sim_crc32(data, len);
+}
+
+static void expect(const char *name, uint32_t cond){
+    checks++;
+    if(!cond){
+        if(errors++ < 16){
+            printf("%s: failed\n", name);
+        }
+    }
+}
+
+static void write(uint8_t *pending, uint16_t address, const uint8_t *data, uint16_t len){
+    memcpy(&pending[address], data, len);
+    expect("write", nvj_write(address, data, len) == len);
+}
+
+/**
+ * @brief Changes as the radio does them: mostly a few bytes on
+ * the settings block, sometimes a whole record on one of
+ * the first model slots, or its erase
+ * */
+static void random_writes(uint8_t *pending){
+    uint8_t data[sizeof(model_record_t)];
+
+    if(xorshift() % MODEL_SAVE_ONE_IN){
+        uint16_t len = 1 + (xorshift() & 3);
+        for(uint16_t i = 0; i < len; i++){
+            data[i] = xorshift();
+        }
+        write(pending, xorshift() % (EEPROM_SIZE - len + 1), data, len);
+    }else{
+        uint8_t slot = xorshift() % MODELS_IN_USE;
+        uint8_t fill = (xorshift() & 7) == 0;
+        for(uint16_t i = 0; i < sizeof(data); i++){
+            data[i] = fill ? 0xFF : xorshift();
+        }
+        write(pending, MODEL_STORE_OFFSET + slot * sizeof(model_record_t), data, sizeof(data));
+    }
+}
+
+/**
+ * @brief One step with random budget, checks time and erase limits
+ * */
+static uint8_t step(uint32_t *steps){
+    uint32_t budget = xorshift() % STEP_MAX_US;
+    uint8_t allow_erase = xorshift() % ERASE_ONE_IN == 0;
+    uint8_t res;
+
+    power.step_us = 0;
+    power.step_erases = 0;
+    res = nvj_step(budget, allow_erase);
+    (*steps)++;
+
+    expect("step within budget", power.step_us <= budget || power.step_erases);
+    expect("erase only when allowed", allow_erase || power.step_erases == 0);
+    return res;
+}
+
+static uint8_t image_equals(const uint8_t *expected){
+    uint8_t image[NVJ_SIZE];
+
+    nvj_read(0, image, NVJ_SIZE);
+    return memcmp(image, expected, NVJ_SIZE) == 0;
+}
+
+/**
+ * @brief Import old flat page, power cut after each flash operation in
+ * turn until one import completes
+ * */
+static void check_legacy(void){
+    static uint8_t legacy[NVJ_SIZE];
+    const uint8_t *old;
+    uint32_t cut_at = 0;
+
+    for(uint16_t i = 0; i < NVJ_SIZE; i++){
+        legacy[i] = (i < MODEL_STORE_OFFSET + MODELS_IN_USE * sizeof(model_record_t)) ? xorshift() : 0xFF;
+    }
+    legacy[LEGACY_FLAG] = LEGACY_FLAG_VALUE;
+    // garbage from an interrupted write on second page
+    memset(flash_page, 0xFF, sizeof(flash_page));
+    memcpy(flash_page, legacy, NVJ_SIZE);
+    memset((uint8_t*)flash_page + NVJ_PAGE_SIZE, 0x5A, 64);
+
+    while(1){
+        power.ops_left = cut_at++;
+        nvj_init();
+        old = nvj_legacy();
+        if(old != NULL){
+            expect("legacy page intact", memcmp(old, legacy, NVJ_SIZE) == 0);
+            nvj_import(old, NVJ_SIZE);
+        }else{
+            expect("legacy imported", image_equals(legacy));
+        }
+        power.ops_left = -1;
+        if(!power.cut){
+            break;
+        }
+        power.cut = 0;
+    }
+
+    nvj_init();
+    expect("legacy import", nvj_legacy() == NULL && nvj_getStats()->page == 1 && image_equals(legacy));
+    printf("legacy page imported, power cut on each of %u flash operations\n", cut_at - 1);
+
+    memset(flash_page, 0xFF, sizeof(flash_page));
+    memset(power.erases, 0, sizeof(power.erases));
+    power.halfwords = 0;
+}
+
+int main(void){
+    static uint8_t committed[NVJ_SIZE], inflight[NVJ_SIZE], pending[NVJ_SIZE];
+    uint32_t cuts = 0, rolled_back = 0, restarts = 0, steps = 0;
+    uint8_t res;
+    nvj_stats_t *stats;
+    double journal_us, rewrite_us;
+
+    memset(flash_page, 0xFF, sizeof(flash_page));
+    memset(committed, 0xFF, NVJ_SIZE);
+    memset(pending, 0xFF, NVJ_SIZE);
+    power.ops_left = -1;
+
+    check_legacy();
+
+    nvj_init();
+    expect("blank", image_equals(committed));
+
+    for(uint32_t n = 0; n < SAVES; n++){
+        random_writes(pending);
+
+        if(xorshift() % CUT_ONE_IN == 0){
+            power.ops_left = xorshift() % CUT_MAX_OPS;
+        }
+
+        // snapshot is taken on first step
+        nvj_commit();
+        memcpy(inflight, pending, NVJ_SIZE);
+
+        do{
+            res = step(&steps);
+            if(res == NVJ_STEP_BUSY && xorshift() % LATE_WRITE_ONE_IN == 0){
+                random_writes(pending);
+            }
+        }while(res == NVJ_STEP_BUSY);
+
+        if(power.cut){
+            // power back, mount from what reached flash
+            expect("fail on cut", res == NVJ_STEP_FAIL);
+            power.cut = 0;
+            power.ops_left = -1;
+            cuts++;
+            nvj_init();
+            if(image_equals(committed)){
+                rolled_back++;
+            }else{
+                expect("torn commit is all or nothing", image_equals(inflight));
+            }
+            nvj_read(0, committed, NVJ_SIZE);
+            memcpy(pending, committed, NVJ_SIZE);
+            continue;
+        }
+
+        power.ops_left = -1;
+        expect("commit", res != NVJ_STEP_FAIL && image_equals(pending));
+        memcpy(committed, inflight, NVJ_SIZE);
+
+        if(xorshift() % RESTART_ONE_IN == 0){
+            // writes done while committing are lost
+            restarts++;
+            nvj_init();
+            expect("restart", image_equals(committed));
+            memcpy(pending, committed, NVJ_SIZE);
+        }
+    }
+
+    stats = nvj_getStats();
+    journal_us = (double)power.halfwords * HALFWORD_US + (double)(power.erases[0] + power.erases[1]) * ERASE_US;
+    rewrite_us = (double)SAVES * ((NVJ_PAGE_SIZE / 2) * HALFWORD_US + ERASE_US);
+
+    printf("%u saves, %u power cuts (%u back to last commit, %u with cut one), %u restarts\n",
+        SAVES, cuts, rolled_back, cuts - rolled_back, restarts);
+    printf("%.1f steps per save, budget up to %uus, erase allowed on one in %u\n",
+        (double)steps / SAVES, STEP_MAX_US, ERASE_ONE_IN);
+    printf("erases page 0: %u page 1: %u, one per %.1f saves\n",
+        power.erases[0], power.erases[1], (double)SAVES / (power.erases[0] + power.erases[1]));
+    printf("flash time per save: %.2f ms, whole page rewrite %.2f ms\n",
+        journal_us / SAVES / 1000, rewrite_us / SAVES / 1000);
+    printf("last mount: page %u seq %u, %u bytes used\n", stats->page, stats->seq, stats->used);
+    printf("%u checks, %u errors\n", checks, errors);
+
+    return errors ? 1 : 0;
+}
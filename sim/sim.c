@@ -0,0 +1,1418 @@
+/**
+ * ==============================================
+ * @file sim.c
+ * @brief Host peripheral model for the laser4+ firmware.
+ *
+ * Replaces laser4_plus_board.c on x86-64 Linux. Time is virtual and
+ * only moves when the firmware touches a peripheral or waits, so a run
+ * is fully deterministic and not bound to wall clock time.
+ *
+ * Environment:
+ *  SIM_TIME        Simulated run time in seconds (default 10)
+ *  SIM_PPM         File with one PPM frame per line, channel values in us,
+ *                  replayed in loop. A built-in stick sweep is used otherwise
+ *  SIM_SWITCHES    Bitmask of switches held pressed, AUX1 = 1, AUX2 = 2, AUX3 = 4
+ *  SIM_PUSH        Comma separated times in ms where the encoder push, AUX3,
+ *                  is pressed, each optionally followed by :<ms> held,
+ *                  SIM_PUSH_MS otherwise
+ *  SIM_REPORT      File for the json scheduler report, stderr if not given
+ *  SIM_CLI_AT      Simulated time in ms from which stdin is fed to the console
+ *  SIM_CLI_GAP     Simulated time in ms stdin is held after each line
+ *  SIM_SPI_LOG     File where every CC2500 transaction is recorded, one per line:
+ *                  time in us, header, payload bytes sent or received
+ *  SIM_TELEM       File with received packets as read from the RX FIFO, one per
+ *                  line in hex, replayed in loop on each RX slot. Address and
+ *                  sequence bytes are replaced to match the transmitter
+ *  SIM_FLASH       File backing the emulated eeprom pages, loaded at start and
+ *                  rewritten on every flash program or erase
+ *  SIM_DEADLINE_US Exit with error if a protocol callback starts later than this
+ *                  after its deadline or returns after the next one
+ *  SIM_I2C_ERRORS  Fail one display transfer in this many, as a missing acknowledge
+ *  SIM_TRACE       File where the binary trace stream is written, tracing is
+ *                  enabled from start. Drained on each sleep, as USB would
+ * ==============================================
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "board.h"
+#include "usart.h"
+#include "iface_cc2500.h"
+#include "nvjournal.h"
+#include "sim_crc.h"
+#include "profiler.h"
+#include "trace.h"
+#ifdef ENABLE_SCHED_STATS
+#include "sched_stats.h"
+#endif
+#ifdef ENABLE_DISPLAY
+#include "mpanel.h"
+#include "livepanel.h"
+#endif
+
+#define SIM_CPU_FREQ            72000000UL
+#define SIM_CYCLES_PER_TICK     (SIM_CPU_FREQ / 2000000UL)  // TIMER_BASE runs at 0.5us
+#define SIM_CYCLES_PER_MS       (SIM_CPU_FREQ / 1000UL)
+#define SIM_RUN_MA              36.0    // typical supply current at 72MHz, peripherals on
+#define SIM_SLEEP_MA            14.4    // same on sleep mode
+#define SIM_ACCESS_CYCLES       SIM_CYCLES_PER_TICK         // cost of one peripheral access
+#define SIM_LOOP_CYCLES         (SIM_CYCLES_PER_TICK * 4)   // main loop overhead
+#define SIM_POLL_THRESHOLD      8                           // consecutive TIMER_BASE accesses seen as busy wait
+#define SIM_DEFAULT_TIME        10
+#define SIM_EEPROM_SIZE         (NVJ_PAGE_SIZE * NVJ_PAGES)
+#define SIM_SPI_BYTE_CYCLES     (8 * 32)                    // SPI2 at 2.25MHz
+#define SIM_CC25_CAL_CYCLES     (721 * (SIM_CPU_FREQ / 1000000UL))  // synthesizer calibration
+#define SIM_I2C_BYTE_CYCLES     (9 * (SIM_CPU_FREQ / I2C_CLOCK))    // I2C2 data and ack
+
+#define SIM_PPM_FRAME_US        22500
+#define SIM_PPM_MAX_FRAMES      1024
+#define SIM_PPM_CHANNELS        MAX_PPM_CHANNELS
+
+#define SIM_GPIO_PORTS          3
+#define SIM_CC25_FIFO_SIZE      64
+#define SIM_TELEM_MAX_PACKETS   256
+#define SIM_PUSH_MAX            16
+#define SIM_PUSH_MS             100
+
+typedef struct {
+    uint64_t next_edge;         // cycle count of next falling edge
+    uint8_t  edge;              // edge index within frame
+    uint32_t frame;             // frame index on replay table
+    uint32_t nframes;
+    uint16_t table[SIM_PPM_MAX_FRAMES][SIM_PPM_CHANNELS];
+    uint64_t frame_start;
+    volatile uint16_t *capture; // input capture buffer, NULL if capture is not running
+    uint16_t capture_len;
+    uint16_t capture_idx;
+}simppm_t;
+
+typedef struct {
+    uint8_t regs[0x40];
+    uint8_t patable;
+    uint8_t header;             // current header
+    uint8_t header_valid;       // 0 if waiting for a new header
+    uint8_t txfifo[SIM_CC25_FIFO_SIZE];
+    uint8_t txlen;
+    uint8_t rxfifo[SIM_CC25_FIFO_SIZE];
+    uint8_t rxlen;
+    uint8_t rxpos;
+    uint8_t tx_addr[2];         // address bytes of last transmitted packet
+    uint8_t tx_seq;             // telemetry sequence requested on last packet
+    uint8_t cs;
+    uint64_t cal_end;           // cycle count where running calibration ends
+}simcc25_t;
+
+typedef struct {
+    uint8_t table[SIM_TELEM_MAX_PACKETS][SIM_CC25_FIFO_SIZE];
+    uint8_t len[SIM_TELEM_MAX_PACKETS];
+    uint32_t npackets;
+    uint32_t next;
+}simtelem_t;
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t end;
+    uint8_t  primask;
+    uint8_t  in_isr;
+    uint8_t  exti_pending;
+    void (*exti_cb)(void);
+    uint32_t tim3_last;         // last TIMER_BASE count seen by the model
+    uint32_t tim3_sr;           // TIMER_BASE status flags, rc_w0
+    uint32_t tim3_polls;        // consecutive TIMER_BASE accesses from thread mode
+    uint64_t cli_at;            // stdin is held until this cycle count
+    uint64_t cli_gap;           // cycles stdin is held after each line
+    uint32_t deadline_us;       // allowed callback lateness, 0 if not checked
+    uint32_t wdt_interval;      // ms, 0 if disabled
+    uint64_t push[SIM_PUSH_MAX];    // cycle count of each encoder push
+    uint64_t push_len[SIM_PUSH_MAX];    // cycles each push is held
+    uint8_t  npush;
+    uint8_t  switches;          // SIM_SWITCHES
+    uint64_t wdt_reload;
+    simppm_t ppm;
+    simcc25_t cc25;
+    simtelem_t telem;
+#ifdef ENABLE_DISPLAY
+    struct {
+        i2c_block_t *blk[I2C_QUEUE_SIZE];
+        uint8_t head;
+        uint8_t tail;
+        i2c_block_t *active;
+        uint64_t done;          // end of active transfer
+        uint32_t transfers;
+        uint32_t error_every;   // fail one transfer in this many, 0 never
+    }i2c;
+#endif
+    FILE *spi_log;
+    FILE *trace;
+    const char *flash_file;
+    struct {
+        uint32_t accesses;
+        uint32_t exti_irqs;
+        uint32_t exti_lost;
+        uint32_t ppm_frames;
+        uint32_t spi_transactions;
+        uint32_t spi_bytes;
+        uint64_t spi_cycles;
+        uint32_t rf_packets;
+        uint32_t rf_miscal;
+        uint32_t rf_received;
+        uint32_t cc25_cal;
+        uint32_t ppm_out_frames;
+        uint32_t lcd_bytes;
+        uint32_t i2c_errors;
+        uint32_t sleeps;
+        uint64_t idle_cycles;
+    }stats;
+}sim_t;
+
+static sim_t sim;
+
+static GPIO_TypeDef sim_gpio[SIM_GPIO_PORTS];
+static TIM_TypeDef sim_tim[4];
+static DMA_TypeDef sim_dma;
+static DMA_Channel_TypeDef sim_dma_ch[7];
+static ADC_TypeDef sim_adc;
+static IWDG_TypeDef sim_iwdg;
+static CRC_TypeDef sim_crc;
+
+const uint32_t sim_uid[3] = {0x0031FF36, 0x3233470D, 0x43152043};
+
+/* Emulated eeprom flash page, linker symbols are aliased to it */
+uint32_t sim_eeprom[SIM_EEPROM_SIZE / 4];
+__asm__(
+    ".globl _seeprom\n .set _seeprom, sim_eeprom\n"
+    ".globl _eeeprom\n .set _eeeprom, sim_eeprom + 2048\n"
+);
+
+uint32_t SystemCoreClock = SIM_CPU_FREQ;
+
+#ifdef ENABLE_DISPLAY
+I2C_HandleTypeDef hi2c2;
+#endif
+
+static void sim_advance(uint64_t cycles);
+static void sim_flashLoad(void);
+#ifdef ENABLE_DISPLAY
+static void sim_i2cUpdate(void);
+#endif
+static void sim_cc25Select(void);
+
+#ifdef ENABLE_SCHED_STATS
+static void sim_reportHist(FILE *fp, const char *name, sched_hist_t *hist){
+    fprintf(fp,
+        "    \"%s\": {\"count\": %u, \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, \"bin_us\": %.1f, \"bins\": [",
+        name, hist->count,
+        sched_histPercentile(hist, 50) / 2.0f,
+        sched_histPercentile(hist, 99) / 2.0f,
+        hist->max / 2.0f,
+        (1 << hist->shift) / 2.0f
+    );
+    // Trailing empty bins are omitted
+    int last = SCHED_HIST_BINS - 1;
+    while(last >= 0 && hist->bins[last] == 0){
+        last--;
+    }
+    for(int i = 0; i <= last; i++){
+        fprintf(fp, "%s%u", i ? ", " : "", hist->bins[i]);
+    }
+    fprintf(fp, "]}");
+}
+
+/**
+ * @brief Write scheduler statistics as json
+ * */
+static void sim_reportSched(void){
+    sched_stats_t *st = sched_getStats();
+    const char *file = getenv("SIM_REPORT");
+    FILE *fp = stderr;
+
+    if(file != NULL){
+        fp = fopen(file, "w");
+        if(fp == NULL){
+            fprintf(stderr, "sim: cannot open %s\n", file);
+            return;
+        }
+    }
+
+    fprintf(fp, "{\n  \"time_ms\": %llu,\n  \"sched\": {\n",
+        (unsigned long long)(sim.cycles / SIM_CYCLES_PER_MS));
+    fprintf(fp, "    \"callbacks\": %u,\n    \"short_cb\": %u,\n    \"long_update\": %u,\n    \"force_update\": %u,\n",
+        st->callbacks, st->short_cb, st->long_update, st->force_update);
+    sim_reportHist(fp, "slack", &st->slack);
+    fprintf(fp, ",\n");
+    sim_reportHist(fp, "late", &st->late);
+    fprintf(fp, ",\n");
+    sim_reportHist(fp, "update", &st->update);
+    fprintf(fp, "\n  }\n}\n");
+
+    if(fp != stderr){
+        fclose(fp);
+    }
+}
+#endif
+
+/**
+ * @brief Take all queued trace records, stands for the CDC IN transfers
+ * */
+static void sim_traceDrain(void){
+    uint8_t *data;
+    uint16_t len;
+
+    if(sim.trace == NULL){
+        return;
+    }
+
+    while((len = trace_peek(&data)) > 0){
+        fwrite(data, 1, len, sim.trace);
+        trace_consume(len);
+    }
+}
+
+/**
+ * @brief Print run summary and terminate the simulation
+ * */
+static void __attribute__((noreturn)) sim_exit(int code){
+    double busy = sim.cycles ? 1.0 - (double)sim.stats.idle_cycles / sim.cycles : 1.0;
+
+    fflush(stdout);
+    fprintf(stderr,
+        "\n--- sim report ---\n"
+        "time_ms          %llu\n"
+        "accesses         %u\n"
+        "ppm_frames       %u\n"
+        "exti_irqs        %u\n"
+        "exti_lost        %u\n"
+        "spi_transactions %u\n"
+        "spi_bytes        %u\n"
+        "spi_time_us      %llu\n"
+        "rf_packets       %u\n"
+        "rf_miscal        %u\n"
+        "rf_received      %u\n"
+        "cc25_cal         %u\n"
+        "ppm_out_frames   %u\n"
+        "lcd_bytes        %u\n"
+#ifdef ENABLE_DISPLAY
+        "lcd_updates      %u\n"
+        "lcd_bytes_avg    %.1f\n"
+        "lcd_bytes_max    %u\n"
+        "lcd_coalesced    %u\n"
+        "lcd_failed       %u\n"
+        "i2c_errors       %u\n"
+        "live_frames      %u\n"
+        "live_overruns    %u\n"
+        "live_late        %u\n"
+        "live_frame_us    %u\n"
+#endif
+        "sleeps           %u\n"
+        "cpu_busy_pct     %.1f\n"
+        "mcu_ma_est       %.1f\n",
+        (unsigned long long)(sim.cycles / SIM_CYCLES_PER_MS),
+        sim.stats.accesses,
+        sim.stats.ppm_frames,
+        sim.stats.exti_irqs,
+        sim.stats.exti_lost,
+        sim.stats.spi_transactions,
+        sim.stats.spi_bytes,
+        (unsigned long long)(sim.stats.spi_cycles / (SIM_CPU_FREQ / 1000000UL)),
+        sim.stats.rf_packets,
+        sim.stats.rf_miscal,
+        sim.stats.rf_received,
+        sim.stats.cc25_cal,
+        sim.stats.ppm_out_frames,
+        sim.stats.lcd_bytes,
+#ifdef ENABLE_DISPLAY
+        MPANEL_getStats()->updates,
+        MPANEL_getStats()->updates ? (double)MPANEL_getStats()->bytes / MPANEL_getStats()->updates : 0.0,
+        MPANEL_getStats()->max_bytes,
+        MPANEL_getStats()->coalesced,
+        MPANEL_getStats()->failed,
+        sim.stats.i2c_errors,
+        LIVE_getStats()->frames,
+        LIVE_getStats()->overruns,
+        LIVE_getStats()->late,
+        LIVE_getStats()->max_us,
+#endif
+        sim.stats.sleeps,
+        busy * 100.0,
+        busy * SIM_RUN_MA + (1.0 - busy) * SIM_SLEEP_MA
+    );
+#ifdef ENABLE_SCHED_STATS
+    sim_reportSched();
+    if(sim.deadline_us){
+        sched_stats_t *st = sched_getStats();
+        if(st->short_cb || st->late.max > sim.deadline_us * 2){
+            fprintf(stderr, "deadline missed: %u short callbacks, %uus late\n", st->short_cb, st->late.max / 2);
+            code = 1;
+        }else{
+            fprintf(stderr, "deadlines met: %u callbacks, %uus late max\n", st->callbacks, st->late.max / 2);
+        }
+    }
+#endif
+    if(sim.spi_log != NULL){
+        fclose(sim.spi_log);
+    }
+    if(sim.trace != NULL){
+        sim_traceDrain();
+        fprintf(stderr, "trace: %u records, %u dropped, %u bytes\n",
+            trace_getStats()->records, trace_getStats()->dropped, trace_getStats()->bytes);
+        fclose(sim.trace);
+    }
+    exit(code);
+}
+
+/**
+ * @brief PPM input model
+ *
+ * Produces falling edges on PB5 following the frame table, edge 0 marks
+ * the end of the sync gap and each following edge closes one channel.
+ * */
+static void sim_ppmDefaultTable(void){
+    simppm_t *ppm = &sim.ppm;
+    // Sticks sweep end to end in ~2s, aux channels stay centered
+    ppm->nframes = 90;
+    for(uint32_t f = 0; f < ppm->nframes; f++){
+        uint32_t pos = (f < 45) ? f : 90 - f;
+        for(uint8_t ch = 0; ch < SIM_PPM_CHANNELS; ch++){
+            ppm->table[f][ch] = 1500;
+        }
+        ppm->table[f][0] = 1000 + pos * 1000 / 45;
+        ppm->table[f][1] = 2000 - pos * 1000 / 45;
+        ppm->table[f][2] = 1000 + pos * 1000 / 45;
+        ppm->table[f][3] = 1500 + (pos & 1) * 10;
+    }
+}
+
+static void sim_ppmLoad(const char *file){
+    simppm_t *ppm = &sim.ppm;
+    FILE *fp = fopen(file, "r");
+    char line[128];
+
+    if(fp == NULL){
+        fprintf(stderr, "sim: cannot open %s\n", file);
+        exit(1);
+    }
+
+    ppm->nframes = 0;
+
+    while(fgets(line, sizeof(line), fp) != NULL && ppm->nframes < SIM_PPM_MAX_FRAMES){
+        char *p = line;
+        uint8_t ch;
+        if(*p == '#'){
+            continue;
+        }
+        for(ch = 0; ch < SIM_PPM_CHANNELS; ch++){
+            char *end;
+            long us = strtol(p, &end, 10);
+            if(end == p){
+                break;
+            }
+            ppm->table[ppm->nframes][ch] = (uint16_t)us;
+            p = end;
+        }
+        if(ch > 0){
+            // missing channels stay centered
+            for(; ch < SIM_PPM_CHANNELS; ch++){
+                ppm->table[ppm->nframes][ch] = 1500;
+            }
+            ppm->nframes++;
+        }
+    }
+    fclose(fp);
+
+    if(ppm->nframes == 0){
+        fprintf(stderr, "sim: no frames on %s\n", file);
+        exit(1);
+    }
+}
+
+static void sim_ppmNextEdge(void){
+    simppm_t *ppm = &sim.ppm;
+
+    if(ppm->edge < SIM_PPM_CHANNELS){
+        ppm->next_edge += (uint64_t)ppm->table[ppm->frame][ppm->edge] * (SIM_CPU_FREQ / 1000000UL);
+        ppm->edge++;
+        return;
+    }
+    // Last channel closed, wait for next frame
+    ppm->frame = (ppm->frame + 1) % ppm->nframes;
+    ppm->frame_start += (uint64_t)SIM_PPM_FRAME_US * (SIM_CPU_FREQ / 1000000UL);
+    ppm->next_edge = ppm->frame_start;
+    ppm->edge = 0;
+    sim.stats.ppm_frames++;
+}
+
+/**
+ * @brief Deliver pending interrupts if they are not masked
+ * */
+static void sim_dispatch(void){
+    if(sim.primask || sim.in_isr){
+        return;
+    }
+
+    if((sim_tim[2].DIER & TIMER_BASE_CCIE) && (sim.tim3_sr & TIMER_BASE_CCIF)){
+        // TIMER_BASE_IRQHandler only masks its interrupt
+        sim_tim[2].DIER &= ~TIMER_BASE_CCIE;
+    }
+
+    if(sim.exti_pending && sim.exti_cb != NULL){
+        PROF_START(start);
+        sim.exti_pending = 0;
+        sim.in_isr = 1;
+        sim.stats.exti_irqs++;
+        sim.exti_cb();
+        sim.in_isr = 0;
+        PROF_END(PROF_EXTI, start);
+    }
+
+#ifdef ENABLE_DISPLAY
+    sim_i2cUpdate();
+#endif
+}
+
+/**
+ * @brief Update TIMER_BASE counter and compare flag
+ * */
+static void sim_timerUpdate(void){
+    TIM_TypeDef *tim = &sim_tim[2];
+    uint32_t now = (uint32_t)(sim.cycles / SIM_CYCLES_PER_TICK);
+    uint32_t elapsed = now - sim.tim3_last;
+
+    if(elapsed == 0){
+        return;
+    }
+
+    // Compare match happened if the scheduler compare was crossed since last update
+    uint16_t dist = (uint16_t)(tim->TIMER_BASE_CCR - sim.tim3_last);
+    if((dist != 0 && dist <= elapsed) || elapsed > 0xFFFF){
+        sim.tim3_sr |= TIMER_BASE_CCIF;
+    }
+
+    sim.tim3_last = now;
+    tim->CNT = now & 0xFFFF;
+    tim->SR = sim.tim3_sr;
+}
+
+/**
+ * @brief Move virtual time forward, stopping at every input event
+ * */
+static void sim_advance(uint64_t cycles){
+    uint64_t target = sim.cycles + cycles;
+
+    do{
+        uint64_t step = target;
+
+        if(sim.ppm.next_edge > sim.cycles && sim.ppm.next_edge < step){
+            step = sim.ppm.next_edge;
+        }
+
+        if(sim.end < step){
+            step = sim.end;
+        }
+
+        sim.cycles = step;
+
+        while(sim.ppm.next_edge <= sim.cycles){
+            if(sim.ppm.capture != NULL){
+                // TIMER_BASE CH1 capture copied by DMA
+                sim.ppm.capture[sim.ppm.capture_idx] = (uint16_t)(sim.ppm.next_edge / SIM_CYCLES_PER_TICK);
+                if(++sim.ppm.capture_idx == sim.ppm.capture_len){
+                    sim.ppm.capture_idx = 0;
+                }
+            }else{
+                if(sim.exti_pending){
+                    sim.stats.exti_lost++;
+                }
+                sim.exti_pending = sim.exti_cb != NULL;
+            }
+            sim_ppmNextEdge();
+        }
+
+        sim_timerUpdate();
+
+        if(sim.wdt_interval && (sim.cycles - sim.wdt_reload) > (uint64_t)sim.wdt_interval * SIM_CYCLES_PER_MS){
+            fprintf(stderr, "sim: watchdog reset at %llums\n", (unsigned long long)(sim.cycles / SIM_CYCLES_PER_MS));
+            sim_exit(2);
+        }
+
+        if(sim.cycles >= sim.end){
+            sim_exit(0);
+        }
+
+        sim_dispatch();
+    }while(sim.cycles < target);
+}
+
+/**
+ * @brief Apply pending register writes to the model
+ *
+ * Writes land on plain memory after sim_periph() returns, so they are
+ * picked up on the next access.
+ * */
+static void sim_sync(void){
+    for(uint8_t i = 0; i < SIM_GPIO_PORTS; i++){
+        GPIO_TypeDef *port = &sim_gpio[i];
+        if(port->BSRR){
+            port->ODR |= port->BSRR & 0xFFFF;
+            port->ODR &= ~(port->BSRR >> 16);
+            port->BSRR = 0;
+        }
+        if(port->BRR){
+            port->ODR &= ~port->BRR;
+            port->BRR = 0;
+        }
+    }
+
+    // Status flags are cleared by writing zero
+    TIM_TypeDef *tim = &sim_tim[2];
+    if(tim->SR != sim.tim3_sr){
+        sim.tim3_sr &= tim->SR;
+        tim->SR = sim.tim3_sr;
+    }
+    tim->TIMER_BASE_CCR &= 0xFFFF;
+
+    sim_cc25Select();
+}
+
+/**
+ * @brief Skip a busy wait on TIMER_BASE up to the next compare match or input edge
+ * */
+static void sim_skipIdle(void){
+    uint32_t now = (uint32_t)(sim.cycles / SIM_CYCLES_PER_TICK);
+    uint32_t dist = (uint16_t)(sim_tim[2].TIMER_BASE_CCR - now);
+    uint64_t next;
+
+    if(sim.tim3_sr & TIMER_BASE_CCIF){
+        return;
+    }
+
+    next = (uint64_t)(now + (dist ? dist : 0x10000)) * SIM_CYCLES_PER_TICK;
+
+    if(sim.ppm.next_edge < next){
+        next = sim.ppm.next_edge;
+    }
+
+    if(next > sim.cycles){
+        sim_advance(next - sim.cycles);
+    }
+}
+
+/**
+ * @brief Encoder push level at current time, held by SIM_SWITCHES otherwise
+ * */
+static void sim_pushUpdate(void){
+    uint8_t pressed = (sim.switches & 4) != 0;
+
+    for(uint8_t i = 0; i < sim.npush; i++){
+        if(sim.cycles >= sim.push[i] && sim.cycles < sim.push[i] + sim.push_len[i]){
+            pressed = 1;
+        }
+    }
+
+    if(pressed){
+        sim_gpio[1].IDR &= ~(1 << HW_SW_AUX3_PIN);
+    }else{
+        sim_gpio[1].IDR |= 1 << HW_SW_AUX3_PIN;
+    }
+}
+
+void *sim_periph(sim_periph_e id){
+    sim_sync();
+    sim.stats.accesses++;
+
+    if(id == SIM_TIM3 && !sim.in_isr && !sim.primask){
+        if(++sim.tim3_polls > SIM_POLL_THRESHOLD){
+            sim_skipIdle();
+        }
+    }else{
+        sim.tim3_polls = 0;
+    }
+
+    sim_advance(SIM_ACCESS_CYCLES);
+
+    switch(id){
+        case SIM_GPIOA: return &sim_gpio[0];
+        case SIM_GPIOB:
+            if(sim.npush){
+                sim_pushUpdate();
+            }
+            return &sim_gpio[1];
+        case SIM_GPIOC: return &sim_gpio[2];
+        case SIM_TIM1: return &sim_tim[0];
+        case SIM_TIM2: return &sim_tim[1];
+        case SIM_TIM3: return &sim_tim[2];
+        case SIM_TIM4: return &sim_tim[3];
+        case SIM_DMA1: return &sim_dma;
+        case SIM_DMA1_CH1:
+        case SIM_DMA1_CH2:
+        case SIM_DMA1_CH3:
+        case SIM_DMA1_CH4:
+        case SIM_DMA1_CH5:
+        case SIM_DMA1_CH6:
+        case SIM_DMA1_CH7: return &sim_dma_ch[id - SIM_DMA1_CH1];
+        case SIM_ADC1: return &sim_adc;
+        case SIM_IWDG: return &sim_iwdg;
+        case SIM_CRC: return &sim_crc;
+        default: break;
+    }
+    fprintf(stderr, "sim: invalid peripheral %d\n", id);
+    sim_exit(1);
+    return NULL;
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq){ }
+void NVIC_DisableIRQ(IRQn_Type irq){ }
+
+void NVIC_SystemReset(void){
+    fprintf(stderr, "sim: system reset requested\n");
+    sim_exit(0);
+}
+
+void __disable_irq(void){
+    sim.primask = 1;
+}
+
+void __enable_irq(void){
+    sim.primask = 0;
+    sim_dispatch();
+}
+
+/**
+ * @brief Sleep until an interrupt is raised: SysTick, scheduler compare if
+ * its interrupt is enabled or a PPM edge on EXTI. Pending interrupts wake
+ * the core even with PRIMASK set, the handler runs once it is cleared.
+ * */
+void __WFI(void){
+    TIM_TypeDef *tim = &sim_tim[2];
+    uint64_t start = sim.cycles;
+    uint64_t next = (sim.cycles / SIM_CYCLES_PER_MS + 1) * SIM_CYCLES_PER_MS;
+
+    sim_sync();
+    sim_traceDrain();
+    sim.stats.sleeps++;
+    sim.tim3_polls = 0;
+
+    if(sim.exti_pending){
+        return;
+    }
+
+    if(tim->DIER & TIMER_BASE_CCIE){
+        uint32_t now = (uint32_t)(sim.cycles / SIM_CYCLES_PER_TICK);
+        uint32_t dist = (uint16_t)(tim->TIMER_BASE_CCR - now);
+        uint64_t match = (uint64_t)(now + (dist ? dist : 0x10000)) * SIM_CYCLES_PER_TICK;
+
+        if(sim.tim3_sr & TIMER_BASE_CCIF){
+            return;
+        }
+        if(match < next){
+            next = match;
+        }
+    }
+
+    if(sim.ppm.capture == NULL && sim.exti_cb != NULL && sim.ppm.next_edge < next){
+        next = sim.ppm.next_edge;
+    }
+
+    // I2C transfer complete interrupt
+    if(sim.i2c.active != NULL && sim.i2c.done < next){
+        next = sim.i2c.done;
+    }
+
+    if(next > sim.cycles){
+        sim_advance(next - sim.cycles);
+    }
+    sim.stats.idle_cycles += sim.cycles - start;
+}
+
+uint32_t HAL_GetTick(void){
+    return getTick();
+}
+
+/**
+ * @brief Load telemetry packets to be replayed
+ * */
+static void sim_telemLoad(const char *file){
+    simtelem_t *tlm = &sim.telem;
+    FILE *fp = fopen(file, "r");
+    char line[256];
+
+    if(fp == NULL){
+        fprintf(stderr, "sim: cannot open %s\n", file);
+        exit(1);
+    }
+
+    while(fgets(line, sizeof(line), fp) != NULL && tlm->npackets < SIM_TELEM_MAX_PACKETS){
+        char *p = line;
+        uint8_t len = 0;
+        if(*p == '#'){
+            continue;
+        }
+        while(len < SIM_CC25_FIFO_SIZE){
+            char *end;
+            unsigned long val = strtoul(p, &end, 16);
+            if(end == p){
+                break;
+            }
+            tlm->table[tlm->npackets][len++] = (uint8_t)val;
+            p = end;
+        }
+        if(len > 0){
+            tlm->len[tlm->npackets++] = len;
+        }
+    }
+    fclose(fp);
+}
+
+/**
+ * @brief Receiver answer, placed on RX FIFO when entering RX
+ * */
+static void sim_telemReceive(void){
+    simcc25_t *cc = &sim.cc25;
+    simtelem_t *tlm = &sim.telem;
+    uint8_t *packet;
+
+    if(tlm->npackets == 0){
+        return;
+    }
+
+    packet = tlm->table[tlm->next];
+    memcpy(cc->rxfifo, packet, tlm->len[tlm->next]);
+    cc->rxlen = tlm->len[tlm->next];
+    cc->rxpos = 0;
+
+    if(cc->rxlen > 7){
+        cc->rxfifo[1] = cc->tx_addr[0];
+        cc->rxfifo[2] = cc->tx_addr[1];
+        cc->rxfifo[7] = cc->tx_seq & 0x1F;
+    }
+
+    tlm->next = (tlm->next + 1) % tlm->npackets;
+    sim.stats.rf_received++;
+}
+
+/**
+ * @brief CC2500 model, keeps register contents and counts transmitted packets
+ * */
+static void sim_cc25Reset(void){
+    simcc25_t *cc = &sim.cc25;
+    memset(cc->regs, 0, sizeof(cc->regs));
+    cc->regs[CC2500_0E_FREQ1] = 0xC4;
+    cc->regs[CC2500_35_MARCSTATE] = 0x01;
+    cc->txlen = 0;
+    cc->rxlen = 0;
+    cc->rxpos = 0;
+    cc->cal_end = 0;
+}
+
+/**
+ * @brief Synthesizer calibration results for a channel. Arbitrary but
+ * channel dependent, so stale values are detected on transmission
+ * */
+static void sim_cc25Fscal(uint8_t chan, uint8_t fscal[3]){
+    fscal[0] = 0x08 | ((chan >> 5) & 0x07);     // FSCAL3[3:0]
+    fscal[1] = (chan < 0x80) ? 0x0A : 0x2A;     // FSCAL2, VCO high core
+    fscal[2] = 0x30 - (chan / 6);               // FSCAL1
+}
+
+static void sim_cc25Calibrate(void){
+    simcc25_t *cc = &sim.cc25;
+    uint8_t fscal[3];
+
+    sim_cc25Fscal(cc->regs[CC2500_0A_CHANNR], fscal);
+    cc->regs[CC2500_23_FSCAL3] = (cc->regs[CC2500_23_FSCAL3] & 0xF0) | fscal[0];
+    cc->regs[CC2500_24_FSCAL2] = fscal[1];
+    cc->regs[CC2500_25_FSCAL1] = fscal[2];
+    cc->cal_end = sim.cycles + SIM_CC25_CAL_CYCLES;
+    sim.stats.cc25_cal++;
+}
+
+/**
+ * @brief Going to RX or TX, calibrates if MCSM0.FS_AUTOCAL is set
+ * 
+ * @return : 1 if synthesizer registers match the current channel
+ * */
+static uint8_t sim_cc25Settle(void){
+    simcc25_t *cc = &sim.cc25;
+    uint8_t fscal[3];
+
+    if((cc->regs[CC2500_18_MCSM0] & 0x30) == 0x10){
+        sim_cc25Calibrate();
+    }
+
+    sim_cc25Fscal(cc->regs[CC2500_0A_CHANNR], fscal);
+    return (cc->regs[CC2500_23_FSCAL3] & 0x0F) == fscal[0] &&
+            cc->regs[CC2500_24_FSCAL2] == fscal[1] &&
+            cc->regs[CC2500_25_FSCAL1] == fscal[2];
+}
+
+static void sim_cc25Strobe(uint8_t cmd){
+    simcc25_t *cc = &sim.cc25;
+    switch(cmd){
+        case CC2500_SRES:
+            sim_cc25Reset();
+            break;
+        case CC2500_SFTX:
+            cc->txlen = 0;
+            break;
+        case CC2500_SFRX:
+            cc->rxlen = 0;
+            cc->rxpos = 0;
+            break;
+        case CC2500_SCAL:
+            sim_cc25Calibrate();
+            break;
+        case CC2500_SRX:
+            sim_cc25Settle();
+            sim_telemReceive();
+            break;
+        case CC2500_STX:
+            if(!sim_cc25Settle()){
+                sim.stats.rf_miscal++;
+            }
+            if(cc->txlen){
+                sim.stats.rf_packets++;
+            }
+            if(cc->txlen > 4){
+                cc->tx_addr[0] = cc->txfifo[1];
+                cc->tx_addr[1] = cc->txfifo[2];
+                cc->tx_seq = cc->txfifo[4];
+            }
+            cc->txlen = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+static void sim_cc25Select(void){
+    uint8_t cs = (sim_gpio[1].ODR >> CC25_CS_PIN) & 1;
+    if(cs != sim.cc25.cs){
+        sim.cc25.cs = cs;
+        sim.cc25.header_valid = 0;
+        if(cs == 0){
+            sim.stats.spi_transactions++;
+        }
+    }
+}
+
+static uint8_t sim_cc25Transfer(uint8_t data, uint8_t write){
+    simcc25_t *cc = &sim.cc25;
+    uint8_t addr;
+
+    sim_sync();
+    sim_cc25Select();
+    sim.stats.spi_bytes++;
+
+    if(cc->cs){
+        return 0xFF;
+    }
+
+    if(!cc->header_valid){
+        addr = data & 0x3F;
+        if(addr >= 0x30 && addr <= 0x3D && !(data & CC2500_READ_BURST)){
+            sim_cc25Strobe(addr);
+            return 0x0F;
+        }
+        cc->header = data;
+        cc->header_valid = 1;
+        return 0x0F;
+    }
+
+    addr = cc->header & 0x3F;
+
+    if(cc->header & CC2500_READ_SINGLE){
+        uint8_t val = (addr == CC2500_3E_PATABLE) ? cc->patable : cc->regs[addr];
+        if(addr == CC2500_3B_RXBYTES){
+            val = cc->rxlen - cc->rxpos;
+        }else if(addr == CC2500_3F_RXFIFO){
+            val = (cc->rxpos < cc->rxlen) ? cc->rxfifo[cc->rxpos++] : 0;
+        }else if(addr == CC2500_35_MARCSTATE && sim.cycles < cc->cal_end){
+            val = 0x05;     // MANCAL
+        }
+        if(!(cc->header & 0x40)){
+            cc->header_valid = 0;
+        }else if(addr < 0x30){
+            cc->header++;
+        }
+        return val;
+    }
+
+    if(write){
+        if(addr == CC2500_3F_TXFIFO){
+            if(cc->txlen < SIM_CC25_FIFO_SIZE){
+                cc->txfifo[cc->txlen++] = data;
+            }
+        }else if(addr == CC2500_3E_PATABLE){
+            cc->patable = data;
+        }else{
+            cc->regs[addr] = data;
+            if(cc->header & 0x40){
+                cc->header++;
+            }
+        }
+        if(!(cc->header & 0x40)){
+            cc->header_valid = 0;
+        }
+    }
+    return 0x0F;
+}
+
+/**
+ * @brief Board API
+ * */
+void laser4Init(void){
+    const char *str;
+
+    sim.end = (uint64_t)SIM_DEFAULT_TIME * 1000 * SIM_CYCLES_PER_MS;
+    str = getenv("SIM_TIME");
+    if(str != NULL){
+        sim.end = (uint64_t)(atof(str) * 1000) * SIM_CYCLES_PER_MS;
+    }
+
+    // Switches have pull-ups, pressed reads as zero
+    for(uint8_t i = 0; i < SIM_GPIO_PORTS; i++){
+        sim_gpio[i].IDR = 0xFFFF;
+    }
+    str = getenv("SIM_SWITCHES");
+    if(str != NULL){
+        sim.switches = strtoul(str, NULL, 0);
+        if(sim.switches & 1) sim_gpio[2].IDR &= ~(1 << HW_SW_AUX1_PIN);
+        if(sim.switches & 2) sim_gpio[2].IDR &= ~(1 << HW_SW_AUX2_PIN);
+        if(sim.switches & 4) sim_gpio[1].IDR &= ~(1 << HW_SW_AUX3_PIN);
+    }
+
+    str = getenv("SIM_PUSH");
+    while(str != NULL && *str != '\0' && sim.npush < SIM_PUSH_MAX){
+        char *end;
+        sim.push[sim.npush] = strtoull(str, &end, 0) * SIM_CYCLES_PER_MS;
+        sim.push_len[sim.npush] = (uint64_t)SIM_PUSH_MS * SIM_CYCLES_PER_MS;
+        if(*end == ':'){
+            sim.push_len[sim.npush] = strtoull(end + 1, &end, 0) * SIM_CYCLES_PER_MS;
+        }
+        sim.npush++;
+        str = (*end == ',') ? end + 1 : NULL;
+    }
+
+    str = getenv("SIM_CLI_AT");
+    if(str != NULL){
+        sim.cli_at = strtoull(str, NULL, 0) * SIM_CYCLES_PER_MS;
+    }
+
+    str = getenv("SIM_CLI_GAP");
+    if(str != NULL){
+        sim.cli_gap = strtoull(str, NULL, 0) * SIM_CYCLES_PER_MS;
+    }
+
+    str = getenv("SIM_DEADLINE_US");
+    if(str != NULL){
+        sim.deadline_us = strtoul(str, NULL, 0);
+    }
+
+    str = getenv("SIM_SPI_LOG");
+    if(str != NULL){
+        sim.spi_log = fopen(str, "w");
+        if(sim.spi_log == NULL){
+            fprintf(stderr, "sim: cannot open %s\n", str);
+        }
+    }
+
+#ifdef ENABLE_DISPLAY
+    str = getenv("SIM_I2C_ERRORS");
+    if(str != NULL){
+        sim.i2c.error_every = strtoul(str, NULL, 0);
+    }
+#endif
+
+    str = getenv("SIM_TRACE");
+    if(str != NULL){
+        sim.trace = fopen(str, "wb");
+        if(sim.trace == NULL){
+            fprintf(stderr, "sim: cannot open %s\n", str);
+        }else{
+            trace_enable(1);
+        }
+    }
+
+    str = getenv("SIM_TELEM");
+    if(str != NULL){
+        sim_telemLoad(str);
+    }
+
+    str = getenv("SIM_PPM");
+    if(str != NULL){
+        sim_ppmLoad(str);
+    }else{
+        sim_ppmDefaultTable();
+    }
+    sim.ppm.frame_start = 0;
+    sim.ppm.next_edge = 0;
+    sim.ppm.edge = 0;
+
+    memset(sim_eeprom, 0xFF, sizeof(sim_eeprom));
+    sim.flash_file = getenv("SIM_FLASH");
+    sim_flashLoad();
+    sim_cc25Reset();
+    sim.cc25.cs = 1;
+    sim.cc25.header_valid = 0;
+
+    // stdin is polled by the cli
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+}
+
+void gpioInit(GPIO_TypeDef *port, uint8_t pin, uint8_t mode){ }
+
+void gpioAttachInterrupt(GPIO_TypeDef *port, uint8_t pin, uint8_t edge, void(*cb)(void)){
+    if(cb == NULL){
+        return;
+    }
+    sim.exti_cb = cb;
+}
+
+void gpioRemoveInterrupt(GPIO_TypeDef *port, uint8_t pin){
+    sim.exti_cb = NULL;
+    sim.exti_pending = 0;
+}
+
+#ifdef ENABLE_PPM_CAPTURE
+void ppmCaptureStart(volatile uint16_t *buf, uint16_t len){
+    sim.ppm.capture_idx = 0;
+    sim.ppm.capture_len = len;
+    sim.ppm.capture = buf;
+}
+
+void ppmCaptureStop(void){
+    sim.ppm.capture = NULL;
+}
+
+uint16_t ppmCaptureIndex(void){
+    sim_advance(SIM_ACCESS_CYCLES);
+    return sim.ppm.capture_idx;
+}
+#endif
+
+void delayMs(uint32_t ms){
+    sim_advance((uint64_t)ms * SIM_CYCLES_PER_MS);
+}
+
+uint32_t getTick(void){
+    return (uint32_t)(sim.cycles / SIM_CYCLES_PER_MS);
+}
+
+/**
+ * @brief Host time scaled to cpu cycles, so profiler figures are the
+ * time the host takes to run the firmware code, not virtual time
+ * */
+uint32_t getCycleCount(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec) * (SIM_CPU_FREQ / 1000000UL) / 1000);
+}
+
+uint8_t SPI_Burst(uint8_t header, const uint8_t *tx, uint8_t *rx, uint16_t len){
+    uint64_t start;
+    uint8_t status, data;
+
+    CC25_CS_TRUE;
+    start = sim.cycles;
+
+    sim_advance(SIM_SPI_BYTE_CYCLES);
+    status = sim_cc25Transfer(header, 1);
+
+    if(sim.spi_log != NULL){
+        fprintf(sim.spi_log, "%llu %02x",
+            (unsigned long long)(start / (SIM_CPU_FREQ / 1000000UL)), header);
+    }
+
+    for(uint16_t i = 0; i < len; i++){
+        sim_advance(SIM_SPI_BYTE_CYCLES);
+        data = sim_cc25Transfer((tx != NULL) ? tx[i] : 0, tx != NULL);
+        if(rx != NULL){
+            rx[i] = data;
+        }
+        if(sim.spi_log != NULL){
+            fprintf(sim.spi_log, " %02x", (tx != NULL) ? tx[i] : data);
+        }
+    }
+
+    if(sim.spi_log != NULL){
+        fputc('\n', sim.spi_log);
+    }
+
+    sim.stats.spi_cycles += sim.cycles - start;
+    CC25_CS_FALSE;
+
+    return status;
+}
+
+/**
+ * @brief Flash image persistence, a missing file reads as erased flash
+ * */
+static void sim_flashLoad(void){
+    FILE *fp;
+
+    if(sim.flash_file == NULL){
+        return;
+    }
+
+    fp = fopen(sim.flash_file, "rb");
+    if(fp != NULL){
+        if(fread(sim_eeprom, 1, sizeof(sim_eeprom), fp) != sizeof(sim_eeprom)){
+            fprintf(stderr, "sim: %s is shorter than flash page\n", sim.flash_file);
+        }
+        fclose(fp);
+    }
+}
+
+static void sim_flashStore(void){
+    FILE *fp;
+
+    if(sim.flash_file == NULL){
+        return;
+    }
+
+    fp = fopen(sim.flash_file, "wb");
+    if(fp == NULL){
+        fprintf(stderr, "sim: cannot write %s\n", sim.flash_file);
+        return;
+    }
+    fwrite(sim_eeprom, 1, sizeof(sim_eeprom), fp);
+    fclose(fp);
+}
+
+uint32_t flashWrite(uint8_t *dst, uint8_t *data, uint16_t count){
+    uint8_t *start = (uint8_t*)sim_eeprom;
+
+    if(dst < start || dst + count > start + sizeof(sim_eeprom)){
+        return HAL_ERROR;
+    }
+    // Programming can only clear bits
+    for(uint16_t i = 0; i < count; i++){
+        dst[i] &= data[i];
+    }
+    sim_flashStore();
+    // ~52us per half-word
+    sim_advance((uint64_t)(count / 2) * 52 * (SIM_CPU_FREQ / 1000000UL));
+    return HAL_OK;
+}
+
+uint32_t flashPageErase(uint32_t address){
+    // address is truncated to 32 bit on host, offset is still right
+    uint32_t offset = address - (uint32_t)(uintptr_t)sim_eeprom;
+
+    if(offset >= sizeof(sim_eeprom)){
+        return 0;
+    }
+    memset((uint8_t*)sim_eeprom + (offset & ~(NVJ_PAGE_SIZE - 1)), 0xFF, NVJ_PAGE_SIZE);
+    sim_flashStore();
+    sim_advance(20 * SIM_CYCLES_PER_MS);
+    return 1;
+}
+
+void enableWatchDog(uint32_t interval){
+    sim.wdt_interval = interval;
+    sim.wdt_reload = sim.cycles;
+}
+
+void reloadWatchDog(void){
+    sim.wdt_reload = sim.cycles;
+    sim_advance(SIM_LOOP_CYCLES);
+}
+
+uint32_t readSwitches(void){
+    return (HW_SW_AUX1_VAL << 0) | (HW_SW_AUX2_VAL << 1) | (HW_SW_AUX3_VAL << 2);
+}
+
+/**
+ * @brief Battery model, a 4.1V cell discharging with constant current
+ * */
+static float sim_vdiv = 0.164f;
+static float sim_rsense = 0.09f;
+
+float adcGetResolution(void){ return 0.805f; }
+void adcSetVdivRacio(float r){ sim_vdiv = r; }
+float adcGetVdivRacio(void){ return sim_vdiv; }
+void adcSetSenseResistor(float rs){ sim_rsense = rs; }
+float adcGetSenseResistor(void){ return sim_rsense; }
+uint32_t adcCalibrate(void){ return 1; }
+float getInstantCurrent(void){ return (float)batteryGetCurrent(); }
+
+uint32_t batteryGetVoltage(void){
+    return 4100 - (uint32_t)(sim.cycles / (SIM_CYCLES_PER_MS * 60000UL));
+}
+
+uint32_t batteryGetCurrent(void){
+    return 120;
+}
+
+uint32_t batteryReadVoltage(uint32_t *dst){
+    *dst = batteryGetVoltage();
+    return 1;
+}
+
+uint32_t batteryReadCurrent(uint32_t *dst){
+    *dst = batteryGetCurrent();
+    return 1;
+}
+
+uint32_t batteryReadVI(vires_t *dst){
+    dst->vbat = batteryGetVoltage();
+    dst->cur = batteryGetCurrent();
+    return 1;
+}
+
+void ppmOut(uint16_t *data){
+    sim.stats.ppm_out_frames++;
+}
+
+void buzPlayTone(uint16_t freq, uint16_t duration){ }
+void buzPlay(tone_t *tones){ }
+uint16_t buzSetLevel(uint16_t level){ return level; }
+void buzWaitEnd(void){ }
+
+uint32_t xrand(void){
+    return (uint32_t)(sim.cycles * 2654435761UL);
+}
+
+uint32_t crcCalc(const uint32_t *data, uint32_t len){
+    return sim_crc32(data, len);
+}
+
+#ifdef ENABLE_DISPLAY
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data, uint16_t size, uint32_t timeout){
+    sim.stats.lcd_bytes += size;
+    return HAL_OK;
+}
+
+/**
+ * @brief DMA transfer queue, same policy as the board: queued blocks
+ * taken back by their owner are skipped, failed transfers are retried
+ * I2C_RETRIES times. Each transfer takes address byte plus data on the bus
+ * */
+static void sim_i2cStart(void){
+    i2c_block_t *blk;
+
+    while(sim.i2c.active == NULL && sim.i2c.tail != sim.i2c.head){
+        blk = sim.i2c.blk[sim.i2c.tail++ & (I2C_QUEUE_SIZE - 1)];
+        if(blk->state != I2C_BLOCK_QUEUED){
+            continue;
+        }
+        blk->state = I2C_BLOCK_ACTIVE;
+        sim.i2c.active = blk;
+        sim.i2c.done = sim.cycles + (uint64_t)(blk->size + 1) * SIM_I2C_BYTE_CYCLES;
+        sim.stats.lcd_bytes += blk->size;
+    }
+}
+
+/**
+ * @brief Transfer complete or error interrupt
+ * */
+static void sim_i2cUpdate(void){
+    i2c_block_t *blk = sim.i2c.active;
+
+    if(blk == NULL || sim.cycles < sim.i2c.done){
+        return;
+    }
+
+    sim.i2c.active = NULL;
+    sim.i2c.transfers++;
+
+    if(sim.i2c.error_every && (sim.i2c.transfers % sim.i2c.error_every) == 0){
+        sim.stats.i2c_errors++;
+        if(blk->retries < I2C_RETRIES){
+            blk->retries++;
+            sim.i2c.active = blk;
+            sim.i2c.done = sim.cycles + (uint64_t)(blk->size + 1) * SIM_I2C_BYTE_CYCLES;
+            sim.stats.lcd_bytes += blk->size;
+            return;
+        }
+        blk->state = I2C_BLOCK_FAILED;
+    }else{
+        blk->state = I2C_BLOCK_IDLE;
+    }
+    sim_i2cStart();
+}
+
+uint8_t I2C_Queue(i2c_block_t *blk){
+    if((uint8_t)(sim.i2c.head - sim.i2c.tail) >= I2C_QUEUE_SIZE){
+        return 0;
+    }
+    blk->state = I2C_BLOCK_QUEUED;
+    blk->retries = 0;
+    sim.i2c.blk[sim.i2c.head++ & (I2C_QUEUE_SIZE - 1)] = blk;
+    sim_i2cStart();
+    return 1;
+}
+
+/**
+ * @brief Reading the busy state takes time while set, so polling loops
+ * see the transfers end
+ * */
+uint8_t I2C_IsBusy(void){
+    if(sim.i2c.active != NULL || sim.i2c.tail != sim.i2c.head){
+        sim_advance(SIM_ACCESS_CYCLES);
+        return 1;
+    }
+    return 0;
+}
+
+void I2C_WriteBlock(uint16_t address, uint8_t *data, uint16_t size){
+    static i2c_block_t blk;
+
+    if(blk.state == I2C_BLOCK_QUEUED || blk.state == I2C_BLOCK_ACTIVE){
+        return;
+    }
+    blk.address = address;
+    blk.data = data;
+    blk.size = size;
+    I2C_Queue(&blk);
+}
+#endif
+
+/**
+ * @brief Console on host stdio
+ * */
+void usart_init(void){ }
+
+static void sim_putchar(char c){
+    putchar(c);
+}
+
+static void sim_puts(const char *str){
+    fputs(str, stdout);
+}
+
+static uint8_t sim_getCharNonBlocking(char *c){
+    if(sim.cycles < sim.cli_at || read(STDIN_FILENO, c, 1) != 1){
+        return 0;
+    }
+    if(*c == '\n'){
+        sim.cli_at = sim.cycles + sim.cli_gap;
+    }
+    return 1;
+}
+
+static char sim_getchar(void){
+    char c;
+    while(!sim_getCharNonBlocking(&c)){
+        sim_advance(SIM_CYCLES_PER_MS);
+    }
+    return c;
+}
+
+static uint8_t sim_kbhit(void){
+    return 0;
+}
+
+stdout_t pcom = {
+    .init = usart_init,
+    .xgetchar = sim_getchar,
+    .xputchar = sim_putchar,
+    .xputs = sim_puts,
+    .getCharNonBlocking = sim_getCharNonBlocking,
+    .kbhit = sim_kbhit,
+    .user_ctx = NULL
+};
@@ -0,0 +1,22 @@
+#ifndef _SIM_CRC_H_
+#define _SIM_CRC_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Same result as the CRC unit: polynomial 0x04C11DB7,
+ * starting from 0xFFFFFFFF, one 32 bit word at a time MSB first.
+ * */
+static inline uint32_t sim_crc32(const uint32_t *data, uint32_t len){
+    uint32_t crc = 0xFFFFFFFF;
+
+    while(len--){
+        crc ^= *data++;
+        for(uint8_t i = 0; i < 32; i++){
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+#endif /* _SIM_CRC_H_ */
@@ -0,0 +1,223 @@
+/**
+ * ==============================================
+ * @file stm32f1xx_hal.h
+ * @brief Host replacement for the STM32F1 device and HAL headers.
+ *
+ * Only the registers and HAL symbols used by the application are
+ * declared. Every peripheral instance macro goes through sim_periph(),
+ * which advances the virtual clock by one bus access and runs the
+ * peripheral model before handing back the register block.
+ * ==============================================
+ * */
+#ifndef _sim_stm32f1xx_hal_h_
+#define _sim_stm32f1xx_hal_h_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define __IO                    volatile
+#define __ALIGN_BEGIN
+#define __ALIGN_END
+
+typedef struct {
+    __IO uint32_t CRL;
+    __IO uint32_t CRH;
+    __IO uint32_t IDR;
+    __IO uint32_t ODR;
+    __IO uint32_t BSRR;
+    __IO uint32_t BRR;
+    __IO uint32_t LCKR;
+}GPIO_TypeDef;
+
+typedef struct {
+    __IO uint32_t CR1;
+    __IO uint32_t CR2;
+    __IO uint32_t SMCR;
+    __IO uint32_t DIER;
+    __IO uint32_t SR;
+    __IO uint32_t EGR;
+    __IO uint32_t CCMR1;
+    __IO uint32_t CCMR2;
+    __IO uint32_t CCER;
+    __IO uint32_t CNT;
+    __IO uint32_t PSC;
+    __IO uint32_t ARR;
+    __IO uint32_t RCR;
+    __IO uint32_t CCR1;
+    __IO uint32_t CCR2;
+    __IO uint32_t CCR3;
+    __IO uint32_t CCR4;
+    __IO uint32_t BDTR;
+    __IO uint32_t DCR;
+    __IO uint32_t DMAR;
+}TIM_TypeDef;
+
+typedef struct {
+    __IO uint32_t ISR;
+    __IO uint32_t IFCR;
+}DMA_TypeDef;
+
+typedef struct {
+    __IO uint32_t CCR;
+    __IO uint32_t CNDTR;
+    __IO uint32_t CPAR;
+    __IO uint32_t CMAR;
+}DMA_Channel_TypeDef;
+
+typedef struct {
+    __IO uint32_t SR;
+    __IO uint32_t CR1;
+    __IO uint32_t CR2;
+    __IO uint32_t SMPR1;
+    __IO uint32_t SMPR2;
+    __IO uint32_t JOFR[4];
+    __IO uint32_t HTR;
+    __IO uint32_t LTR;
+    __IO uint32_t SQR1;
+    __IO uint32_t SQR2;
+    __IO uint32_t SQR3;
+    __IO uint32_t JSQR;
+    __IO uint32_t JDR[4];
+    __IO uint32_t DR;
+}ADC_TypeDef;
+
+typedef struct {
+    __IO uint32_t KR;
+    __IO uint32_t PR;
+    __IO uint32_t RLR;
+    __IO uint32_t SR;
+}IWDG_TypeDef;
+
+typedef struct {
+    __IO uint32_t DR;
+    __IO uint32_t IDR;
+    __IO uint32_t CR;
+}CRC_TypeDef;
+
+typedef enum {
+    SIM_GPIOA = 0,
+    SIM_GPIOB,
+    SIM_GPIOC,
+    SIM_TIM1,
+    SIM_TIM2,
+    SIM_TIM3,
+    SIM_TIM4,
+    SIM_DMA1,
+    SIM_DMA1_CH1,
+    SIM_DMA1_CH2,
+    SIM_DMA1_CH3,
+    SIM_DMA1_CH4,
+    SIM_DMA1_CH5,
+    SIM_DMA1_CH6,
+    SIM_DMA1_CH7,
+    SIM_ADC1,
+    SIM_IWDG,
+    SIM_CRC,
+    SIM_PERIPH_NUM
+}sim_periph_e;
+
+void *sim_periph(sim_periph_e id);
+
+#define GPIOA                   ((GPIO_TypeDef*)sim_periph(SIM_GPIOA))
+#define GPIOB                   ((GPIO_TypeDef*)sim_periph(SIM_GPIOB))
+#define GPIOC                   ((GPIO_TypeDef*)sim_periph(SIM_GPIOC))
+#define TIM1                    ((TIM_TypeDef*)sim_periph(SIM_TIM1))
+#define TIM2                    ((TIM_TypeDef*)sim_periph(SIM_TIM2))
+#define TIM3                    ((TIM_TypeDef*)sim_periph(SIM_TIM3))
+#define TIM4                    ((TIM_TypeDef*)sim_periph(SIM_TIM4))
+#define DMA1                    ((DMA_TypeDef*)sim_periph(SIM_DMA1))
+#define DMA1_Channel1           ((DMA_Channel_TypeDef*)sim_periph(SIM_DMA1_CH1))
+#define DMA1_Channel2           ((DMA_Channel_TypeDef*)sim_periph(SIM_DMA1_CH2))
+#define DMA1_Channel3           ((DMA_Channel_TypeDef*)sim_periph(SIM_DMA1_CH3))
+#define DMA1_Channel4           ((DMA_Channel_TypeDef*)sim_periph(SIM_DMA1_CH4))
+#define DMA1_Channel5           ((DMA_Channel_TypeDef*)sim_periph(SIM_DMA1_CH5))
+#define DMA1_Channel6           ((DMA_Channel_TypeDef*)sim_periph(SIM_DMA1_CH6))
+#define DMA1_Channel7           ((DMA_Channel_TypeDef*)sim_periph(SIM_DMA1_CH7))
+#define ADC1                    ((ADC_TypeDef*)sim_periph(SIM_ADC1))
+#define IWDG                    ((IWDG_TypeDef*)sim_periph(SIM_IWDG))
+#define CRC                     ((CRC_TypeDef*)sim_periph(SIM_CRC))
+
+/* Unique device id, backed by a constant on the host */
+extern const uint32_t sim_uid[3];
+#define UID_BASE                ((uintptr_t)sim_uid)
+
+/* TIM bits */
+#define TIM_CR1_CEN             (1 << 0)
+#define TIM_CR1_DIR             (1 << 4)
+#define TIM_CR1_ARPE            (1 << 7)
+#define TIM_DIER_UIE            (1 << 0)
+#define TIM_DIER_CC1IE          (1 << 1)
+#define TIM_DIER_CC2IE          (1 << 2)
+#define TIM_DIER_CC3IE          (1 << 3)
+#define TIM_DIER_CC4IE          (1 << 4)
+#define TIM_DIER_UDE            (1 << 8)
+#define TIM_DIER_CC1DE          (1 << 9)
+#define TIM_SR_UIF              (1 << 0)
+#define TIM_SR_CC1IF            (1 << 1)
+#define TIM_SR_CC2IF            (1 << 2)
+#define TIM_SR_CC3IF            (1 << 3)
+#define TIM_SR_CC4IF            (1 << 4)
+#define TIM_EGR_UG              (1 << 0)
+
+/* DMA bits */
+#define DMA_CCR_EN              (1 << 0)
+#define DMA_CCR_TCIE            (1 << 1)
+#define DMA_CCR_HTIE            (1 << 2)
+#define DMA_CCR_DIR             (1 << 4)
+#define DMA_CCR_CIRC            (1 << 5)
+#define DMA_CCR_MINC            (1 << 7)
+#define DMA_CCR_PSIZE_0         (1 << 8)
+#define DMA_CCR_MSIZE_0         (1 << 10)
+#define DMA_CCR_PL              (3 << 12)
+
+/* Interrupts */
+typedef enum {
+    SysTick_IRQn            = -1,
+    DMA1_Channel1_IRQn      = 11,
+    DMA1_Channel4_IRQn      = 14,
+    DMA1_Channel5_IRQn      = 15,
+    DMA1_Channel6_IRQn      = 16,
+    DMA1_Channel7_IRQn      = 17,
+    USB_LP_CAN1_RX0_IRQn    = 20,
+    EXTI9_5_IRQn            = 23,
+    TIM2_IRQn               = 28,
+    TIM3_IRQn               = 29,
+    TIM4_IRQn               = 30,
+    I2C2_EV_IRQn            = 33,
+    I2C2_ER_IRQn            = 34,
+    USART1_IRQn             = 37,
+}IRQn_Type;
+
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_SystemReset(void) __attribute__((noreturn));
+void __disable_irq(void);
+void __enable_irq(void);
+void __WFI(void);
+#define __NOP()
+#define __DMB()                 __asm volatile("" ::: "memory")
+
+/* HAL */
+typedef enum {
+    HAL_OK       = 0x00U,
+    HAL_ERROR    = 0x01U,
+    HAL_BUSY     = 0x02U,
+    HAL_TIMEOUT  = 0x03U
+}HAL_StatusTypeDef;
+
+typedef struct {
+    void *Instance;
+}I2C_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t addr, uint8_t *data, uint16_t size, uint32_t timeout);
+uint32_t HAL_GetTick(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _sim_stm32f1xx_hal_h_ */
@@ -0,0 +1,160 @@
+/**
+ * ==============================================
+ * @file telem_check.c
+ * @brief Host check of the FrSky D telemetry receive path.
+ *
+ * Replays the receiver packets of a SIM_TELEM file, as read from the
+ * CC2500 RX FIFO, through telemetry_frskyPush() and telemetry_process()
+ * a few times over. Analog ports, RSSI, bad CRC count and every hub
+ * value listed on the sample header must decode as listed, and each
+ * user frame must be acknowledged by the sequence the transmitter sends
+ * next. A user frame with a wrong sequence must hold the counter until
+ * it is sent again. Any failure is printed and makes the program exit
+ * with error.
+ * ==============================================
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "multiprotocol.h"
+#include "telemetry.h"
+
+#define TELEM_FILE_MAX          64
+#define TELEM_PASSES            4
+#define TELEM_USER_FRAMES       6       // per pass, sequence 0 to 5
+#define TELEM_BAD_CRC           5       // per pass
+
+radio_t radio;
+static uint32_t tick;
+
+static uint8_t packet[TELEM_FILE_MAX][TELEMETRY_PACKET_SIZE];
+static uint8_t packet_len[TELEM_FILE_MAX];
+static uint8_t npackets;
+static uint32_t checks, errors;
+
+uint32_t getTick(void){
+    return tick;
+}
+
+static void expect(const char *name, uint32_t cond){
+    checks++;
+    if(!cond){
+        if(errors++ < 16){
+            printf("%s: failed\n", name);
+        }
+    }
+}
+
+/**
+ * @brief Load packets, one per line in hex, as the sim replays them
+ * */
+static void load(const char *file){
+    FILE *fp = fopen(file, "r");
+    char line[256];
+
+    if(fp == NULL){
+        printf("cannot open %s\n", file);
+        exit(1);
+    }
+
+    while(fgets(line, sizeof(line), fp) != NULL && npackets < TELEM_FILE_MAX){
+        char *p = line;
+        uint8_t len = 0;
+        if(*p == '#'){
+            continue;
+        }
+        while(len < TELEMETRY_PACKET_SIZE){
+            char *end;
+            unsigned long val = strtoul(p, &end, 16);
+            if(end == p){
+                break;
+            }
+            packet[npackets][len++] = (uint8_t)val;
+            p = end;
+        }
+        if(len > 0){
+            packet_len[npackets++] = len;
+        }
+    }
+    fclose(fp);
+}
+
+/**
+ * @brief One packet through the RF slot and the main loop. User frames
+ * must move the requested sequence past their own
+ * */
+static void receive(const uint8_t *data, uint8_t len, uint32_t *acks){
+    uint8_t user = len == TELEMETRY_PACKET_SIZE && (data[len - 1] & 0x80) && data[6] > 0;
+
+    tick += 9;
+    if(telemetry_frskyPush(data, len) && user){
+        expect("user frame acknowledged", (telemetry_getCounter() & 0x1F) == ((data[7] + 1) & 0x1F));
+        (*acks)++;
+    }
+    telemetry_process();
+}
+
+int main(int argc, char **argv){
+    telemetry_t *tlm;
+    uint8_t wrong[TELEMETRY_PACKET_SIZE];
+    uint32_t acks = 0;
+    uint8_t counter;
+
+    load(argc > 1 ? argv[1] : "sim/telemetry_frsky_d.txt");
+    expect("packets loaded", npackets > 0);
+
+    // receiver answers to this transmitter
+    radio.rx_tx_addr[3] = packet[0][1];
+    radio.rx_tx_addr[2] = packet[0][2];
+
+    for(uint8_t pass = 0; pass < TELEM_PASSES; pass++){
+        telemetry_reset();
+        acks = 0;
+        for(uint8_t i = 0; i < npackets; i++){
+            receive(packet[i], packet_len[i], &acks);
+        }
+
+        tlm = telemetry_getData();
+        expect("all user frames acknowledged", acks == TELEM_USER_FRAMES);
+        expect("next sequence", telemetry_getCounter() == TELEM_USER_FRAMES);
+        expect("bad crc", tlm->bad_crc == TELEM_BAD_CRC);
+        expect("bad address", tlm->bad_addr == 0);
+        expect("link", tlm->link);
+        expect("A1", tlm->a1 == 0x9A);
+        expect("A2", tlm->a2 == 0x40);
+        expect("RX RSSI", tlm->rx_rssi == 0x6D);
+        expect("TX RSSI", tlm->tx_rssi == -81);
+        expect("LQI", tlm->tx_lqi == 0x1D);
+        expect("temp1", tlm->hub[0x02] == 25);
+        expect("temp2", tlm->hub[0x05] == 31);
+        expect("altitude", tlm->hub[0x10] == 350);
+        expect("current", tlm->hub[0x28] == 35);
+        expect("voltage", tlm->hub[0x3A] == 12 && tlm->hub[0x3B] == 6);
+        expect("hub ids", tlm->hub_valid == ((1ULL << 0x02) | (1ULL << 0x05) | (1ULL << 0x10) |
+                                            (1ULL << 0x28) | (1ULL << 0x3A) | (1ULL << 0x3B)));
+    }
+
+    // A lost user frame, next one comes with an old sequence
+    memcpy(wrong, packet[0], TELEMETRY_PACKET_SIZE);
+    counter = telemetry_getCounter();
+    wrong[7] = (counter + 3) & 0x1F;
+    telemetry_frskyPush(wrong, TELEMETRY_PACKET_SIZE);
+    telemetry_process();
+    expect("wrong sequence held", (telemetry_getCounter() & 0x1F) == counter && (telemetry_getCounter() & 0x80));
+    wrong[7] = counter;
+    telemetry_frskyPush(wrong, TELEMETRY_PACKET_SIZE);
+    telemetry_process();
+    expect("retransmission acknowledged", (telemetry_getCounter() & 0x1F) == ((counter + 1) & 0x1F));
+
+    tlm = telemetry_getData();
+    printf("%u packets per pass, %u user frames acknowledged, %u bad crc, %u hub frames\n",
+        npackets, acks, tlm->bad_crc, tlm->hub_frames);
+    printf("A1 %umV A2 %umV, RX RSSI %u, TX RSSI %ddBm, %u.%uV %uC %uC %um %u.%uA\n",
+        telemetry_analogMv(tlm->a1, TELEMETRY_A1_RATIO), telemetry_analogMv(tlm->a2, TELEMETRY_A2_RATIO),
+        tlm->rx_rssi, tlm->tx_rssi, tlm->hub[0x3A], tlm->hub[0x3B], tlm->hub[0x02], tlm->hub[0x05],
+        tlm->hub[0x10], tlm->hub[0x28] / 10, tlm->hub[0x28] % 10);
+    printf("%u checks, %u errors\n", checks, errors);
+
+    return errors ? 1 : 0;
+}
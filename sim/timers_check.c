@@ -0,0 +1,219 @@
+/**
+ * ==============================================
+ * @file timers_check.c
+ * @brief Host check of the software timer wheel.
+ *
+ * Timers are started and stopped at random against a reference list
+ * that knows when each one must expire. Time moves one tick at a time
+ * and sometimes jumps further than the wheel size. Actions stop their
+ * own timer or start others. Each expiry must happen on the tick it
+ * is due, or on the first processTimers() call after a jump. Stale
+ * handles must never stop a running timer, a full pool must return
+ * SWTIM_NONE and nextTimerExpiry() must match the reference.
+ * Any failure is printed and makes the program exit with error.
+ * ==============================================
+ * */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "board.h"
+
+#define ROUNDS                  200000
+#define MAX_TIME                100
+#define JUMP_ONE_IN             64
+#define JUMP_MAX                (SWTIM_SLOTS * 4)
+
+typedef struct {
+    uint32_t handle;
+    uint32_t expire;
+    uint32_t time;
+    uint8_t  reload;
+    uint8_t  live;
+    uint8_t  stop_self;                 // action stops its own timer
+    uint8_t  start_other;               // action starts a new timer
+}ref_t;
+
+static ref_t ref[SWTIM_NUM];
+static uint32_t ticks;
+static uint32_t checks, errors, fired, jumps, stale_stops;
+static uint32_t rnd_state = 0x1B873593;
+static uint8_t jumped;
+
+static uint32_t xorshift(void){
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+uint32_t getTick(void){
+    return ticks;
+}
+
+static void expect(const char *name, uint32_t cond){
+    checks++;
+    if(!cond){
+        if(errors++ < 16){
+            printf("%s: failed at tick %u\n", name, ticks);
+        }
+    }
+}
+
+static void start(void);
+
+/**
+ * @brief Timer expired, one action per reference entry
+ * */
+static void action(uint8_t k){
+    ref_t *r = &ref[k];
+
+    fired++;
+    expect("fired while stopped", r->live);
+    if(jumped){
+        expect("late after jump", (int32_t)(ticks - r->expire) >= 0);
+    }else{
+        expect("on time", ticks == r->expire);
+    }
+
+    if(r->stop_self){
+        // entry is free right away
+        stopTimer(r->handle);
+        r->live = 0;
+        if(r->start_other){
+            start();
+        }
+        return;
+    }
+
+    // entry is only free after the action returns
+    if(r->start_other){
+        start();
+    }
+
+    if(r->reload){
+        r->expire = ticks + r->time;
+    }else{
+        r->live = 0;
+    }
+}
+
+#define ACTION(_K) static void action##_K(void){ action(_K); }
+ACTION(0) ACTION(1) ACTION(2) ACTION(3) ACTION(4) ACTION(5) ACTION(6) ACTION(7)
+ACTION(8) ACTION(9) ACTION(10) ACTION(11) ACTION(12) ACTION(13) ACTION(14) ACTION(15)
+
+static void (*const actions[SWTIM_NUM])(void) = {
+    action0, action1, action2, action3, action4, action5, action6, action7,
+    action8, action9, action10, action11, action12, action13, action14, action15
+};
+
+static uint8_t live_count(void){
+    uint8_t n = 0;
+
+    for(uint8_t k = 0; k < SWTIM_NUM; k++){
+        n += ref[k].live;
+    }
+    return n;
+}
+
+static void start(void){
+    uint32_t time = 1 + xorshift() % MAX_TIME;
+    uint8_t reload = xorshift() & 1;
+    uint32_t handle;
+    uint8_t k;
+
+    for(k = 0; k < SWTIM_NUM; k++){
+        if(!ref[k].live){
+            break;
+        }
+    }
+
+    if(k == SWTIM_NUM){
+        expect("full pool", startTimer(time, 0, action0) == SWTIM_NONE);
+        return;
+    }
+
+    handle = startTimer(time, reload ? SWTIM_AUTO_RELOAD : 0, actions[k]);
+    expect("start", handle != SWTIM_NONE);
+    if(handle == SWTIM_NONE){
+        return;
+    }
+
+    ref[k].handle = handle;
+    ref[k].expire = ticks + time;
+    ref[k].time = time;
+    ref[k].reload = reload;
+    ref[k].live = 1;
+    ref[k].stop_self = (xorshift() % 8) == 0;
+    ref[k].start_other = (xorshift() % 8) == 0;
+}
+
+/**
+ * @brief Stop a live timer, or use a stale handle
+ * */
+static void stop(void){
+    ref_t *r = &ref[xorshift() % SWTIM_NUM];
+
+    if(r->live){
+        stopTimer(r->handle);
+        r->live = 0;
+    }else{
+        // stale, never valid or out of range handles must not stop anything
+        stale_stops++;
+        stopTimer(r->handle);
+        stopTimer(SWTIM_NONE);
+        stopTimer((xorshift() & ~0xFF) | SWTIM_NUM);
+    }
+}
+
+static uint32_t ref_next(void){
+    uint32_t next = SWTIM_NO_EXPIRY;
+
+    for(uint8_t k = 0; k < SWTIM_NUM; k++){
+        if(ref[k].live){
+            uint32_t left = ((int32_t)(ref[k].expire - ticks) > 0) ? ref[k].expire - ticks : 0;
+            if(left < next){
+                next = left;
+            }
+        }
+    }
+    return next;
+}
+
+int main(void){
+    // Start near wrap around
+    ticks = 0xFFFFF000;
+
+    for(uint32_t n = 0; n < ROUNDS; n++){
+        uint32_t op = xorshift() % 8;
+
+        if(op < 3){
+            start();
+        }else if(op < 5){
+            stop();
+        }
+
+        expect("next expiry", nextTimerExpiry() == ref_next());
+
+        if(xorshift() % JUMP_ONE_IN == 0){
+            ticks += 1 + xorshift() % JUMP_MAX;
+            jumped = 1;
+            jumps++;
+        }else{
+            ticks++;
+        }
+
+        processTimers();
+        jumped = 0;
+
+        // Nothing due may be left behind
+        for(uint8_t k = 0; k < SWTIM_NUM; k++){
+            expect("missed expiry", !ref[k].live || (int32_t)(ref[k].expire - ticks) > 0);
+        }
+    }
+
+    printf("%u rounds, %u expiries, %u jumps, %u stale stops, %u running at end\n",
+        ROUNDS, fired, jumps, stale_stops, live_count());
+    printf("%u checks, %u errors\n", checks, errors);
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,199 @@
+/**
+ * ==============================================
+ * @file trace_decode.c
+ * @brief Host decoder for the binary trace stream.
+ *
+ * Reads the stream as captured from the USB serial port, or written by
+ * the simulation with SIM_TRACE, and prints one CSV line per record:
+ *
+ *   ms,type,values...
+ *
+ * Time is unwrapped from the 16 bit record stamp. Bytes that do not
+ * start a valid record, console text or a damaged record, are skipped
+ * until the next sync byte. With -t only records of that type are
+ * printed, preceded by a header line.
+ *
+ * usage: trace_decode [-t channels|callback|rf|battery] [file]
+ * ==============================================
+ * */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "trace.h"
+
+#define BUF_SIZE                (TRACE_HEADER + 255 + 1)
+
+static const char *const type_names[] = {
+    NULL,
+    "channels",
+    "callback",
+    "rf",
+    "battery",
+};
+
+static const char *const type_headers[] = {
+    NULL,
+    "ms,type,ch1,ch2,...",
+    "ms,type,start,late,next",
+    "ms,type,tx,rx,bad_crc,missed,tx_rssi,rx_rssi",
+    "ms,type,mv,ma",
+};
+
+#define TYPE_NUM                (sizeof(type_names) / sizeof(type_names[0]))
+
+static uint16_t get16(const uint8_t *src){
+    return src[0] | (src[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *src){
+    return get16(src) | ((uint32_t)get16(src + 2) << 16);
+}
+
+/**
+ * @brief Checks payload size against record type
+ * */
+static int valid_len(uint8_t type, uint8_t len){
+    switch(type){
+        case TRACE_CHANNELS: return len <= TRACE_MAX_PAYLOAD && (len & 1) == 0;
+        case TRACE_CALLBACK: return len == 6;
+        case TRACE_RF:       return len == 19;
+        case TRACE_BATTERY:  return len == 4;
+    }
+    return 0;
+}
+
+static void print_record(uint64_t ms, uint8_t type, const uint8_t *p, uint8_t len){
+    printf("%llu,%s", (unsigned long long)ms, type_names[type]);
+
+    switch(type){
+        case TRACE_CHANNELS:
+            for(uint8_t i = 0; i < len; i += 2){
+                printf(",%u", get16(p + i));
+            }
+            break;
+
+        case TRACE_CALLBACK:
+            printf(",%u,%u,%u", get16(p), get16(p + 2), get16(p + 4));
+            break;
+
+        case TRACE_RF:
+            printf(",%u,%u,%u,%u,%d,%u", get32(p), get32(p + 4), get32(p + 8),
+                get32(p + 12), (int16_t)get16(p + 16), p[18]);
+            break;
+
+        case TRACE_BATTERY:
+            printf(",%u,%u", get16(p), get16(p + 2));
+            break;
+    }
+    putchar('\n');
+}
+
+int main(int argc, char **argv){
+    static uint8_t buf[BUF_SIZE];
+    FILE *fp = stdin;
+    uint32_t fill = 0, records = 0, skipped = 0;
+    uint64_t ms = 0;
+    uint16_t last = 0;
+    uint8_t filter = 0, first = 1;
+    size_t n;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-t") == 0 && i + 1 < argc){
+            i++;
+            for(uint8_t t = 1; t < TYPE_NUM; t++){
+                if(strcmp(argv[i], type_names[t]) == 0){
+                    filter = t;
+                }
+            }
+            if(filter == 0){
+                fprintf(stderr, "unknown record type %s\n", argv[i]);
+                return 1;
+            }
+        }else if(fp == stdin){
+            fp = fopen(argv[i], "rb");
+            if(fp == NULL){
+                fprintf(stderr, "cannot open %s\n", argv[i]);
+                return 1;
+            }
+        }else{
+            fprintf(stderr, "usage: %s [-t channels|callback|rf|battery] [file]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(filter){
+        puts(type_headers[filter]);
+    }
+
+    while((n = fread(buf + fill, 1, sizeof(buf) - fill, fp)) > 0 || fill >= TRACE_HEADER){
+        uint32_t pos = 0;
+        uint8_t eof = n == 0;
+
+        fill += n;
+
+        while(pos < fill){
+            uint8_t *rec = buf + pos;
+            uint32_t size;
+            uint8_t sum = 0;
+
+            if(rec[0] != TRACE_SYNC){
+                pos++;
+                skipped++;
+                continue;
+            }
+
+            if(fill - pos < TRACE_HEADER){
+                break;
+            }
+
+            if(rec[1] == 0 || rec[1] >= TYPE_NUM || !valid_len(rec[1], rec[2])){
+                pos++;
+                skipped++;
+                continue;
+            }
+
+            size = TRACE_HEADER + rec[2] + 1;
+            if(fill - pos < size){
+                break;
+            }
+
+            for(uint32_t i = 1; i < size - 1; i++){
+                sum ^= rec[i];
+            }
+            if(sum != rec[size - 1]){
+                pos++;
+                skipped++;
+                continue;
+            }
+
+            // records are in time order, stamp only wraps forward
+            ms += (uint16_t)(get16(rec + 3) - last);
+            if(first){
+                ms = get16(rec + 3);
+                first = 0;
+            }
+            last = get16(rec + 3);
+
+            if(filter == 0 || filter == rec[1]){
+                print_record(ms, rec[1], rec + TRACE_HEADER, rec[2]);
+            }
+            records++;
+            pos += size;
+        }
+
+        // Keep an incomplete record for next read, drop it at end of input
+        if(eof){
+            skipped += fill - pos;
+            break;
+        }
+        fill -= pos;
+        memmove(buf, buf + pos, fill);
+    }
+
+    if(fp != stdin){
+        fclose(fp);
+    }
+
+    fprintf(stderr, "%u records, %u bytes skipped\n", records, skipped);
+    return 0;
+}